@@ -0,0 +1,114 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+#include "CoreRuntime.h"
+
+/*
+ * Core scaling benchmark: every core runs a fixed number of tokens, each
+ * doing a little local work and then moving to the next core through the
+ * SPSC rings. Prints tasks per second for 1..N cores; with nothing shared
+ * between cores this should grow linearly while there are CPUs to run on.
+ *
+ *     bench_core_scaling [max cores] [hops per token] [work per hop]
+ */
+
+#define SCALING_TOKENS 64
+
+namespace
+{
+        struct Token
+        {
+                struct ExecutorTask base;
+                CoreRuntime        *runtime;
+                std::atomic<int>   *left;
+                int                 hops;
+                int                 work;
+                unsigned long       sum;
+        };
+
+        void hop(struct ExecutorTask *task)
+        {
+                struct Token *token = reinterpret_cast<struct Token *>(task);
+                const int     core  = token->runtime->currentCore();
+                const int     next  = (core + 1) % token->runtime->cores();
+
+                for (int i = 0; i < token->work; i++)
+                        token->sum = token->sum * 31 + i;
+
+                if (--token->hops == 0)
+                {
+                        token->left->fetch_sub(1, std::memory_order_release);
+                        return;
+                }
+
+                /* A full ring means the next core is behind: work here. */
+                if (token->runtime->post(next, task) < 0)
+                        token->runtime->post(core, task);
+        }
+
+        void run(int cores, int hops, int work)
+        {
+                struct CoreParams  params = {};
+                std::vector<Token> tokens(cores * SCALING_TOKENS);
+                std::atomic<int>   left(tokens.size());
+
+                params.cores        = cores;
+                params.maxOpenFiles = 1024;
+                params.pin = cores <= sysconf(_SC_NPROCESSORS_ONLN);
+
+                CoreRuntime runtime(&params);
+
+                if (runtime.start() < 0)
+                {
+                        perror("start");
+                        return;
+                }
+
+                auto start = std::chrono::steady_clock::now();
+
+                for (size_t i = 0; i < tokens.size(); i++)
+                {
+                        tokens[i].base.routine = hop;
+                        tokens[i].runtime      = &runtime;
+                        tokens[i].left         = &left;
+                        tokens[i].hops         = hops;
+                        tokens[i].work         = work;
+                        tokens[i].sum          = i;
+                        runtime.post(i % cores, &tokens[i].base);
+                }
+
+                while (left.load(std::memory_order_acquire) > 0)
+                        std::this_thread::sleep_for(
+                                std::chrono::microseconds(100));
+
+                std::chrono::duration<double> secs =
+                        std::chrono::steady_clock::now() - start;
+
+                printf("%3d cores %12.0f tasks/s\n", cores,
+                       (double) tokens.size() * hops / secs.count());
+                runtime.stop();
+        }
+} // namespace
+
+int main(int argc, char **argv)
+{
+        const int online = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        const int cores  = argc > 1 ? atoi(argv[1]) : online;
+        const int hops   = argc > 2 ? atoi(argv[2]) : 20000;
+        const int work   = argc > 3 ? atoi(argv[3]) : 200;
+
+        for (int n = 1; n <= cores; n++)
+                run(n, hops, work);
+
+        return 0;
+}
@@ -0,0 +1,203 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "Coroutine.h"
+#include "TaskScheduler.h"
+
+/*
+ * Echo benchmark: the same poller echoes small messages back over many
+ * connections, once from plain poller callbacks and once from one
+ * coroutine per connection awaiting CoSocket reads and writes. Clients
+ * keep one message in flight per connection. Prints round trips per
+ * second for each.
+ *
+ *     bench_coroutine_echo [connections] [rounds]
+ */
+
+#define ECHO_MESSAGE 64
+
+namespace
+{
+        /* Echoes every read from within the poller callback. */
+        class RawEcho : public PollerTask
+        {
+            public:
+                RawEcho(TaskScheduler *scheduler, int fd)
+                    : m_scheduler(scheduler), m_fd(fd), m_message()
+                {
+                        struct PollerData data = {};
+
+                        data.operation     = PD_OP_READ;
+                        data.flags         = PD_FL_PERSISTENT;
+                        data.fd            = fd;
+                        data.createMessage = RawEcho::createMessage;
+                        data.context       = static_cast<PollerTask *>(this);
+                        scheduler->getPoller()->add(&data, -1);
+                }
+
+                void handle(struct PollerResult *) override {}
+
+            private:
+                struct EchoMessage
+                {
+                        RawEcho             *echo;
+                        struct PollerMessage base;
+                };
+
+                static PollerMessage *createMessage(void *context)
+                {
+                        RawEcho *echo = static_cast<RawEcho *>(
+                                static_cast<PollerTask *>(context));
+
+                        echo->m_message.echo        = echo;
+                        echo->m_message.base.append = RawEcho::append;
+                        return &echo->m_message.base;
+                }
+
+                static int append(const void *buf, size_t *n,
+                                  PollerMessage *msg)
+                {
+                        char    *p    = reinterpret_cast<char *>(msg);
+                        RawEcho *echo = reinterpret_cast<EchoMessage *>(
+                                                p - offsetof(EchoMessage, base))
+                                                ->echo;
+                        IOBuf    out;
+
+                        out.append(buf, *n);
+                        echo->m_scheduler->getPoller()->send(echo->m_fd, &out);
+                        return 1;
+                }
+
+                TaskScheduler     *m_scheduler;
+                int                m_fd;
+                struct EchoMessage m_message;
+        };
+
+        CoTask coEcho(TaskScheduler *scheduler, int fd)
+        {
+                CoSocket socket(scheduler, fd);
+                char     buf[ECHO_MESSAGE * 4];
+                ssize_t  n;
+
+                while ((n = co_await socket.read(buf, sizeof buf)) > 0)
+                        co_await socket.write(buf, n);
+        }
+
+        void client(const std::vector<int> &fds, int rounds)
+        {
+                char   msg[ECHO_MESSAGE];
+                char   buf[ECHO_MESSAGE];
+                size_t got;
+
+                memset(msg, 'x', sizeof msg);
+                for (int i = 0; i < rounds; i++)
+                {
+                        for (int fd : fds)
+                        {
+                                if (write(fd, msg, sizeof msg) != sizeof msg)
+                                        return;
+                        }
+
+                        for (int fd : fds)
+                        {
+                                for (got = 0; got < sizeof buf;)
+                                {
+                                        ssize_t n = read(fd, buf + got,
+                                                         sizeof buf - got);
+
+                                        if (n <= 0)
+                                                return;
+
+                                        got += n;
+                                }
+                        }
+                }
+        }
+
+        void run(const char *name, bool coroutine, int conns, int rounds)
+        {
+                const int                             nclients = 4;
+                TaskScheduler                         scheduler(1, 65536);
+                std::vector<std::unique_ptr<RawEcho>> raw;
+                std::vector<std::vector<int>>         clientFds(nclients);
+                std::vector<int>                      fds;
+                std::vector<std::thread>              clients;
+                int                                   sv[2];
+
+                if (scheduler.start() < 0)
+                {
+                        perror("start");
+                        return;
+                }
+
+                for (int i = 0; i < conns; i++)
+                {
+                        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+                        {
+                                perror("socketpair");
+                                return;
+                        }
+
+                        fcntl(sv[0], F_SETFL, O_NONBLOCK);
+                        fds.push_back(sv[0]);
+                        fds.push_back(sv[1]);
+                        clientFds[i % nclients].push_back(sv[1]);
+                        if (coroutine)
+                                coEcho(&scheduler, sv[0]);
+                        else
+                                raw.emplace_back(
+                                        new RawEcho(&scheduler, sv[0]));
+                }
+
+                auto start = std::chrono::steady_clock::now();
+
+                for (int i = 0; i < nclients; i++)
+                        clients.emplace_back(client, std::cref(clientFds[i]),
+                                             rounds);
+
+                for (std::thread &t : clients)
+                        t.join();
+
+                std::chrono::duration<double> secs =
+                        std::chrono::steady_clock::now() - start;
+
+                printf("%-10s %8.0f round trips/s\n", name,
+                       (double) conns * rounds / secs.count());
+
+                /* EOF ends each coroutine and removes each raw node. */
+                for (size_t i = 1; i < fds.size(); i += 2)
+                        shutdown(fds[i], SHUT_WR);
+
+                scheduler.stop();
+                for (int fd : fds)
+                        close(fd);
+        }
+} // namespace
+
+int main(int argc, char **argv)
+{
+        const int conns  = argc > 1 ? atoi(argv[1]) : 64;
+        const int rounds = argc > 2 ? atoi(argv[2]) : 20000;
+
+        for (int i = 0; i < 2; i++)
+        {
+                run("callback", false, conns, rounds);
+                run("coroutine", true, conns, rounds);
+        }
+
+        return 0;
+}
@@ -0,0 +1,188 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+#include "Poller.h"
+
+/*
+ * Read-path benchmark. "rpc" spreads small writes over many connections,
+ * "bulk" streams through one. Each runs with fixed read and epoll batch
+ * sizes (the old behaviour) and with adaptive ones, and prints throughput,
+ * read() and epoll_wait() calls from PollerStats, and cache misses when
+ * perf_event_open() is allowed.
+ *
+ *     bench_poller_read [rpc|bulk]
+ */
+
+namespace
+{
+        std::atomic<size_t> received;
+
+        int append(const void *, size_t *, PollerMessage *)
+        {
+                return 1;
+        }
+
+        PollerMessage *createMessage(void *context)
+        {
+                return static_cast<Arena *>(context)->createMessage(0, append);
+        }
+
+        void callback(PollerResult *res, void *)
+        {
+                if (res->state == PR_ST_SUCCESS && res->data.message)
+                        received += res->data.message->bytes;
+
+                delete reinterpret_cast<PollerNode *>(res);
+        }
+
+        int openCacheMisses()
+        {
+                struct perf_event_attr attr = {};
+
+                attr.type           = PERF_TYPE_HARDWARE;
+                attr.size           = sizeof attr;
+                attr.config         = PERF_COUNT_HW_CACHE_MISSES;
+                attr.disabled       = 1;
+                attr.inherit        = 1; /* the poller thread starts later */
+                attr.exclude_kernel = 1;
+                attr.exclude_hv     = 1;
+                return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        }
+
+        void writeAll(int fd, const char *p, size_t n)
+        {
+                ssize_t ret;
+
+                while (n > 0)
+                {
+                        ret = write(fd, p, n);
+                        if (ret > 0)
+                        {
+                                p += ret;
+                                n -= ret;
+                        } else
+                                std::this_thread::yield();
+                }
+        }
+
+        void run(const char *scenario, bool adaptive, int conns, size_t chunk,
+                 size_t total)
+        {
+                PollerParams                        params = {};
+                PollerStats                         stats;
+                std::vector<std::unique_ptr<Arena>> arenas;
+                std::vector<int>                    fds;
+                std::vector<int>                    peers;
+                std::string                         buf(chunk, 'x');
+                long long                           misses = -1;
+                int                                 perf   = openCacheMisses();
+                int                                 sv[2];
+
+                params.maxOpenFiles = 65536;
+                params.callback     = callback;
+                if (!adaptive)
+                {
+                        params.readSizeMin = POLLER_BUFSIZE;
+                        params.eventsMin   = POLLER_EVENTS_MAX;
+                }
+
+                Poller poller(&params);
+
+                received = 0;
+                poller.start();
+                for (int i = 0; i < conns; i++)
+                {
+                        PollerData data = {};
+
+                        socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+                        arenas.emplace_back(new Arena());
+                        data.operation     = PD_OP_READ;
+                        data.flags         = PD_FL_PERSISTENT;
+                        data.fd            = sv[0];
+                        data.createMessage = createMessage;
+                        data.context       = arenas.back().get();
+                        poller.add(&data, -1);
+                        fds.push_back(sv[0]);
+                        peers.push_back(sv[1]);
+                }
+
+                if (perf >= 0)
+                        ioctl(perf, PERF_EVENT_IOC_ENABLE, 0);
+
+                auto start = std::chrono::steady_clock::now();
+
+                for (size_t sent = 0; sent < total;)
+                {
+                        for (int fd : peers)
+                        {
+                                writeAll(fd, buf.data(), chunk);
+                                sent += chunk;
+                        }
+                }
+
+                while (received < total)
+                        std::this_thread::yield();
+
+                auto end = std::chrono::steady_clock::now();
+
+                if (perf >= 0)
+                {
+                        ioctl(perf, PERF_EVENT_IOC_DISABLE, 0);
+                        if (read(perf, &misses, sizeof misses) != sizeof misses)
+                                misses = -1;
+                        close(perf);
+                }
+
+                poller.getStats(&stats);
+                poller.stop();
+                for (int i = 0; i < conns; i++)
+                {
+                        close(fds[i]);
+                        close(peers[i]);
+                }
+
+                const double secs =
+                        std::chrono::duration<double>(end - start).count();
+
+                printf("%-5s %-9s %9.1f MB/s %10zu reads %9.0f B/read "
+                       "%8zu waits %12s misses\n",
+                       scenario, adaptive ? "adaptive" : "fixed",
+                       total / secs / 1e6, stats.readCalls,
+                       (double) stats.readBytes / stats.readCalls,
+                       stats.waitCalls,
+                       misses < 0 ? "n/a" : std::to_string(misses).c_str());
+        }
+} // namespace
+
+int main(int argc, char **argv)
+{
+        const char *which = argc > 1 ? argv[1] : "";
+
+        for (bool adaptive : {false, true})
+        {
+                if (!*which || strcmp(which, "rpc") == 0)
+                        run("rpc", adaptive, 256, 64, 64 << 20);
+
+                if (!*which || strcmp(which, "bulk") == 0)
+                        run("bulk", adaptive, 1, 1 << 20, 1 << 30);
+        }
+
+        return 0;
+}
@@ -0,0 +1,208 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+#include "Poller.h"
+
+/*
+ * Skewed-load benchmark. A few "elephant" connections stream many
+ * messages, many "mice" send a few each, and every message costs the
+ * callback some CPU. "sharded" runs one single-threaded poller per thread
+ * with connections dealt round-robin, which puts every elephant on the
+ * first poller; "leader/follower" runs one poller with the same number of
+ * threads sharing its epoll instance. Prints messages per second and, for
+ * leader/follower, the share of the threads' busy time spent holding the
+ * poller state: the part that cannot run in parallel, whatever the core
+ * count.
+ *
+ *     bench_poller_skew [threads] [elephants] [work per message]
+ */
+
+#define SKEW_MESSAGE 64
+#define SKEW_MICE 64
+#define SKEW_ELEPHANT_MESSAGES 50000
+#define SKEW_MOUSE_MESSAGES 100
+
+namespace
+{
+        std::atomic<long>   remaining;
+        std::promise<void> *finished;
+        int                 workPerMessage;
+
+        int append(const void *, size_t *n, PollerMessage *msg)
+        {
+                if (msg->bytes + *n < SKEW_MESSAGE)
+                        return 0;
+
+                *n = SKEW_MESSAGE - msg->bytes;
+                return 1;
+        }
+
+        PollerMessage *createMessage(void *)
+        {
+                PollerMessage *msg = static_cast<PollerMessage *>(
+                        malloc(sizeof (PollerMessage)));
+
+                msg->append    = append;
+                msg->appendBuf = nullptr;
+                msg->arena     = nullptr;
+                return msg;
+        }
+
+        void callback(PollerResult *res, void *)
+        {
+                volatile unsigned long sum = 0;
+
+                if (res->state == PR_ST_SUCCESS)
+                {
+                        for (int i = 0; i < workPerMessage; i++)
+                                sum = sum + i;
+
+                        free(res->data.message);
+                        if (remaining.fetch_sub(1) == 1)
+                                finished->set_value();
+                }
+
+                delete reinterpret_cast<PollerNode *>(res);
+        }
+
+        void writer(int fd, int messages)
+        {
+                char msg[SKEW_MESSAGE];
+
+                memset(msg, 'x', sizeof msg);
+                for (int i = 0; i < messages; i++)
+                {
+                        if (write(fd, msg, sizeof msg) != sizeof msg)
+                                return;
+                }
+        }
+
+        void run(const char *name, bool leaderFollower, int threads,
+                 int elephants)
+        {
+                const double total =
+                        (double) elephants * SKEW_ELEPHANT_MESSAGES +
+                        (double) SKEW_MICE * SKEW_MOUSE_MESSAGES;
+                const int conns = elephants + SKEW_MICE;
+                const int npoll = leaderFollower ? 1 : threads;
+                std::vector<std::unique_ptr<Poller>> pollers;
+                std::vector<int>                     fds;
+                std::vector<std::thread>             writers;
+                std::promise<void>                   done;
+                struct PollerParams                  params = {};
+                struct PollerData                    data   = {};
+                int                                  sv[2];
+
+                params.maxOpenFiles = 65536;
+                params.callback     = callback;
+                params.threads      = leaderFollower ? threads : 1;
+                for (int i = 0; i < npoll; i++)
+                {
+                        pollers.emplace_back(new Poller(&params));
+                        if (pollers.back()->start() < 0)
+                        {
+                                perror("start");
+                                return;
+                        }
+                }
+
+                finished  = &done;
+                remaining = (long) total;
+
+                data.operation     = PD_OP_READ;
+                data.flags         = PD_FL_PERSISTENT;
+                data.createMessage = createMessage;
+                for (int i = 0; i < conns; i++)
+                {
+                        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) < 0)
+                        {
+                                perror("socketpair");
+                                return;
+                        }
+
+                        fcntl(sv[0], F_SETFL, O_NONBLOCK);
+                        fds.push_back(sv[0]);
+                        fds.push_back(sv[1]);
+
+                        /* Elephants are dealt first: all to poller 0. */
+                        data.fd = sv[0];
+                        pollers[(i < elephants ? 0 : i) % pollers.size()]
+                                ->add(&data, -1);
+                }
+
+                auto start = std::chrono::steady_clock::now();
+
+                for (int i = 0; i < elephants; i++)
+                        writers.emplace_back(writer, fds[2 * i + 1],
+                                             SKEW_ELEPHANT_MESSAGES);
+
+                writers.emplace_back(
+                        [&]
+                        {
+                                for (int r = 0; r < SKEW_MOUSE_MESSAGES; r++)
+                                {
+                                        for (int i = elephants; i < conns; i++)
+                                                writer(fds[2 * i + 1], 1);
+                                }
+                        });
+
+                done.get_future().wait();
+
+                std::chrono::duration<double> secs =
+                        std::chrono::steady_clock::now() - start;
+
+                for (std::thread &t : writers)
+                        t.join();
+
+                printf("%-16s %2d threads %10.0f messages/s", name, threads,
+                       total / secs.count());
+                if (leaderFollower)
+                {
+                        struct PollerStats stats;
+
+                        pollers[0]->getStats(&stats);
+                        printf("  %4.1f%% serial",
+                               100.0 * stats.stateTime / stats.busyTime);
+                }
+
+                printf("\n");
+
+                for (auto &poller : pollers)
+                        poller->stop();
+
+                for (int fd : fds)
+                        close(fd);
+        }
+} // namespace
+
+int main(int argc, char **argv)
+{
+        const int online    = (int) sysconf(_SC_NPROCESSORS_ONLN);
+        const int threads   = argc > 1 ? atoi(argv[1]) : std::max(online, 2);
+        const int elephants = argc > 2 ? atoi(argv[2]) : 4;
+
+        workPerMessage = argc > 3 ? atoi(argv[3]) : 2000;
+        for (int i = 0; i < 2; i++)
+        {
+                run("sharded", false, threads, elephants);
+                run("leader/follower", true, threads, elephants);
+        }
+
+        return 0;
+}
@@ -0,0 +1,113 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <stdlib.h>
+
+#include "Arena.h"
+#include "Poller.h"
+
+static_assert(sizeof(Arena) <= 64, "an idle Arena should stay small");
+
+Arena::Arena(const size_t chunkSize) :
+        m_chunkSize(chunkSize), m_capacity(0), m_first(nullptr),
+        m_current(nullptr), m_ptr(nullptr), m_end(nullptr), m_live(0)
+{
+}
+
+Arena::~Arena()
+{
+        struct ArenaChunk *chunk;
+
+        while (m_first)
+        {
+                chunk   = m_first;
+                m_first = chunk->next;
+                free(chunk);
+        }
+}
+
+void *Arena::allocSlow(const size_t size)
+{
+        struct ArenaChunk *next;
+        size_t             chunkSize;
+
+        /* Reuse the chunks kept from before the last reset first. */
+        next = m_current ? m_current->next : m_first;
+        if (!next || next->size < size)
+        {
+                chunkSize = size > m_chunkSize ? size : m_chunkSize;
+                next      = static_cast<struct ArenaChunk *>(
+                        malloc(sizeof(struct ArenaChunk) + chunkSize));
+                if (!next)
+                        return nullptr;
+
+                next->size = chunkSize;
+                if (m_current)
+                {
+                        next->next      = m_current->next;
+                        m_current->next = next;
+                } else
+                {
+                        next->next = m_first;
+                        m_first    = next;
+                }
+
+                m_capacity += chunkSize;
+        }
+
+        m_current = next;
+        m_ptr     = reinterpret_cast<char *>(next + 1) + size;
+        m_end     = reinterpret_cast<char *>(next + 1) + next->size;
+        return next + 1;
+}
+
+struct PollerMessage *Arena::createMessage(
+        const size_t size,
+        int (*append)(const void *, size_t *, struct PollerMessage *))
+{
+        struct PollerMessage *msg = static_cast<struct PollerMessage *>(
+                this->alloc(sizeof(struct PollerMessage) + size));
+
+        if (msg)
+        {
+                msg->append    = append;
+                msg->appendBuf = nullptr;
+                msg->arena     = this;
+                m_live++;
+        }
+
+        return msg;
+}
+
+void Arena::release()
+{
+        if (--m_live == 0)
+                this->reset();
+}
+
+void Arena::trim()
+{
+        struct ArenaChunk *chunk;
+
+        if (m_live != 0)
+                return;
+
+        while (m_first)
+        {
+                chunk   = m_first;
+                m_first = chunk->next;
+                free(chunk);
+        }
+
+        m_capacity = 0;
+        this->reset();
+}
+
+void Arena::reset()
+{
+        m_live    = 0;
+        m_current = nullptr;
+        m_ptr     = nullptr;
+        m_end     = nullptr;
+}
@@ -0,0 +1,89 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+
+#define ARENA_CHUNK_SIZE 4096
+#define ARENA_ALIGN 16
+
+struct PollerMessage;
+
+/*
+ * Per-connection bump allocator for inbound messages. A message created by
+ * createMessage() lives in one allocation together with its inline body;
+ * parsed fields and body fragments come from alloc(). Everything is dropped
+ * at once, in O(1), when the last live message is released. The poller
+ * releases a message right after its result has been delivered, so the
+ * callback must copy out (or detach) whatever it keeps.
+ *
+ * Chunks are kept across resets, so a connection in steady state does not
+ * call malloc at all.
+ */
+class Arena
+{
+    public:
+        explicit Arena(size_t chunkSize = ARENA_CHUNK_SIZE);
+
+        ~Arena();
+
+        Arena(const Arena &) = delete;
+
+        Arena &operator=(const Arena &) = delete;
+
+        void *alloc(size_t size)
+        {
+                size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+                if ((size_t) (m_end - m_ptr) >= size)
+                {
+                        void *p = m_ptr;
+
+                        m_ptr += size;
+                        return p;
+                }
+
+                return allocSlow(size);
+        }
+
+        /*
+         * The message header is followed by size bytes of inline data, and
+         * message->arena points back here.
+         */
+        struct PollerMessage *createMessage(
+                size_t size,
+                int (*append)(const void *, size_t *, struct PollerMessage *));
+
+        void release();
+
+        void reset();
+
+        /* Gives the chunks back to malloc, if no message is live. */
+        void trim();
+
+        size_t capacity() const { return m_capacity; }
+
+    private:
+        struct ArenaChunk
+        {
+                struct ArenaChunk *next;
+                size_t             size;
+        };
+
+        static_assert(sizeof(struct ArenaChunk) % ARENA_ALIGN == 0,
+                      "chunk data must stay aligned");
+
+        void *allocSlow(size_t size);
+
+        size_t             m_chunkSize;
+        size_t             m_capacity;
+        struct ArenaChunk *m_first;
+        struct ArenaChunk *m_current;
+        char              *m_ptr;
+        char              *m_end;
+        int                m_live;
+};
+
+#endif // ARENA_H
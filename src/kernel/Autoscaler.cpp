@@ -0,0 +1,124 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <algorithm>
+#include <climits>
+
+#include "Autoscaler.h"
+
+Autoscaler::Autoscaler(Poller *poller, Executor *executor,
+                       const struct AutoscalerParams *params) :
+        PeriodicController(pick(params->interval, AUTOSCALER_INTERVAL)),
+        m_poller(poller), m_executor(executor), m_busyTime(0), m_idleTime(0),
+        m_completed(0)
+{
+        m_highBusy   = pick(params->highBusy, AUTOSCALER_HIGH_BUSY);
+        m_lowBusy    = pick(params->lowBusy, AUTOSCALER_LOW_BUSY);
+        m_maxWait    = pick(params->maxWait, AUTOSCALER_MAX_WAIT);
+        m_minPoller  = std::max(params->minPollerThreads, 1);
+        m_maxPoller  = pick(params->maxPollerThreads, INT_MAX);
+        m_minWorkers = std::max(params->minWorkers, 1);
+        m_maxWorkers = pick(params->maxWorkers, INT_MAX);
+}
+
+Autoscaler::~Autoscaler()
+{
+        this->stop();
+}
+
+/* The next thread count, or active itself. */
+int Autoscaler::step(const int active, const int min, const int max,
+                     const bool up, const bool down) const
+{
+        if (up && active < max)
+                return active + 1;
+
+        if (down && !up && active > min)
+                return active - 1;
+
+        return active;
+}
+
+int Autoscaler::adjust(const double pollerBusy, const double workerBusy,
+                       const double wait)
+{
+        int change = 0;
+        int active, next;
+
+        /* Past the pool size, setThreads() refuses: that is the bound. */
+        if (m_poller)
+        {
+                active = m_poller->threads();
+                next   = this->step(active, m_minPoller, m_maxPoller,
+                                    pollerBusy > m_highBusy,
+                                    pollerBusy < m_lowBusy);
+                if (next != active && m_poller->setThreads(next) == 0)
+                        change += next - active;
+        }
+
+        if (m_executor)
+        {
+                active = m_executor->threads();
+                next   = this->step(active, m_minWorkers, m_maxWorkers,
+                                    workerBusy > m_highBusy ||
+                                            wait > m_maxWait,
+                                    workerBusy < m_lowBusy);
+                if (next != active && m_executor->setThreads(next) == 0)
+                        change += next - active;
+        }
+
+        return change;
+}
+
+void Autoscaler::begin()
+{
+        struct PollerStats   pstats;
+        struct ExecutorStats estats;
+
+        if (m_poller)
+        {
+                m_poller->getStats(&pstats);
+                m_busyTime = pstats.busyTime;
+        }
+
+        if (m_executor)
+        {
+                m_executor->getStats(&estats);
+                m_idleTime  = estats.idleTime;
+                m_completed = estats.completed;
+        }
+}
+
+void Autoscaler::pass(const double wall)
+{
+        struct PollerStats   pstats;
+        struct ExecutorStats estats;
+        double               pollerBusy = 0, workerBusy = 0, wait = 0;
+        double               rate;
+
+        if (m_poller)
+        {
+                m_poller->getStats(&pstats);
+                pollerBusy = (pstats.busyTime - m_busyTime) /
+                             (wall * m_poller->threads());
+                m_busyTime = pstats.busyTime;
+        }
+
+        if (m_executor)
+        {
+                m_executor->getStats(&estats);
+                /* Signed: a worker just woken may lag a pass. */
+                workerBusy = 1 - ((double) estats.idleTime - m_idleTime) /
+                                         (wall * estats.threads);
+                rate = (estats.completed - m_completed) / wall * 1e3;
+                if (estats.queued > 0)
+                        wait = rate > 0 ? estats.queued / rate
+                                        : m_maxWait + 1;
+
+                m_idleTime  = estats.idleTime;
+                m_completed = estats.completed;
+        }
+
+        this->adjust(pollerBusy, workerBusy, wait);
+}
@@ -0,0 +1,92 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef AUTOSCALER_H
+#define AUTOSCALER_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Executor.h"
+#include "PeriodicController.h"
+#include "Poller.h"
+
+#define AUTOSCALER_INTERVAL 1000
+#define AUTOSCALER_HIGH_BUSY 0.75
+#define AUTOSCALER_LOW_BUSY 0.25
+#define AUTOSCALER_MAX_WAIT 1000
+
+struct AutoscalerParams
+{
+        int    interval; /* milliseconds between passes */
+        double highBusy; /* utilization (0 to 1) that adds a thread */
+        double lowBusy;  /* and that parks one */
+        int    maxWait;  /* microseconds queued that adds a worker */
+
+        /* Bounds on the active threads; zero is 1 and all of them. */
+        int minPollerThreads;
+        int maxPollerThreads;
+        int minWorkers;
+        int maxWorkers;
+};
+
+/*
+ * Resizes a leader/follower poller and an executor to their load, within
+ * bounds, through their setThreads(). The threads themselves are created
+ * by start() up to PollerParams.threads and the executor's pool size;
+ * the ones not needed park, off the CPU.
+ *
+ * Every interval it samples the poller's utilization (busy time over
+ * wall time of its active threads), the executor's (the same, less the
+ * time workers slept) and the executor's queue. Latency of a queued
+ * callback is taken as queued tasks over the rate they complete at. A
+ * thread is added when utilization is above highBusy, or for the
+ * executor when that wait is over maxWait; one is parked when
+ * utilization is below lowBusy. One step each per pass. Zero fields pick
+ * the AUTOSCALER_* defaults.
+ *
+ * Either may be null. Both must be running, and outlive the autoscaler.
+ */
+class Autoscaler final : public PeriodicController
+{
+    public:
+        Autoscaler(Poller *poller, Executor *executor,
+                   const struct AutoscalerParams *params);
+
+        ~Autoscaler();
+
+        Autoscaler(const Autoscaler &) = delete;
+
+        Autoscaler &operator=(const Autoscaler &) = delete;
+
+        /*
+         * One pass, given the utilizations and the estimated wait in
+         * microseconds. Returns threads added less threads parked.
+         */
+        int adjust(double pollerBusy, double workerBusy, double wait);
+
+    private:
+        void begin() override;
+
+        void pass(double wall) override;
+
+        int step(int active, int min, int max, bool up, bool down) const;
+
+        Poller   *m_poller;
+        Executor *m_executor;
+        double    m_highBusy;
+        double    m_lowBusy;
+        int       m_maxWait;
+        int       m_minPoller;
+        int       m_maxPoller;
+        int       m_minWorkers;
+        int       m_maxWorkers;
+
+        /* At the last pass. */
+        size_t m_busyTime;
+        size_t m_idleTime;
+        size_t m_completed;
+};
+
+#endif // AUTOSCALER_H
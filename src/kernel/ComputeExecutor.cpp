@@ -0,0 +1,226 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <time.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include "ComputeExecutor.h"
+
+namespace
+{
+        int64_t __compute_now(const clockid_t clock)
+        {
+                struct timespec ts;
+
+                clock_gettime(clock, &ts);
+                return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        }
+
+        /* The wait histogram bucket of ns nanoseconds. */
+        int __compute_bucket(const int64_t ns)
+        {
+                const uint64_t us = ns > 0 ? ns / 1000 : 0;
+                int            i  = 0;
+
+                while (i < COMPUTE_WAIT_BUCKETS - 1 && (us >> i) != 0)
+                        i++;
+
+                return i;
+        }
+} // namespace
+
+ComputeExecutor::ComputeExecutor(Executor *executor) :
+        m_executor(executor), m_vtime(0), m_inflight(0)
+{
+}
+
+int ComputeExecutor::addQueue(const std::string &name, const int weight)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (weight < 1)
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        for (auto &queue : m_queues)
+        {
+                if (queue->name == name)
+                {
+                        errno = EEXIST;
+                        return -1;
+                }
+        }
+
+        std::unique_ptr<Queue> queue(new Queue());
+
+        queue->name   = name;
+        queue->weight = weight;
+        queue->vtime  = m_vtime;
+        queue->cost   = COMPUTE_INITIAL_COST;
+        queue->head   = nullptr;
+        queue->tail   = nullptr;
+        m_queues.push_back(std::move(queue));
+        return (int) m_queues.size() - 1;
+}
+
+int ComputeExecutor::findQueue(const std::string &name) const
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (size_t i = 0; i < m_queues.size(); i++)
+        {
+                if (m_queues[i]->name == name)
+                        return (int) i;
+        }
+
+        errno = ENOENT;
+        return -1;
+}
+
+int ComputeExecutor::setWeight(const int queue, const int weight)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (queue < 0 || (size_t) queue >= m_queues.size() || weight < 1)
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        m_queues[queue]->weight = weight;
+        return 0;
+}
+
+int ComputeExecutor::submit(const int queue, struct ComputeTask *task)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        struct Queue               *q;
+
+        if (queue < 0 || (size_t) queue >= m_queues.size())
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        q                  = m_queues[queue].get();
+        task->base.routine = ComputeExecutor::run;
+        task->executor     = this;
+        task->next         = nullptr;
+        task->queue        = queue;
+        task->queuedAt     = __compute_now(CLOCK_MONOTONIC);
+
+        /* Idle until now: no credit for the time it asked for nothing. */
+        if (!q->head)
+        {
+                q->vtime = std::max(q->vtime, m_vtime);
+                q->head  = task;
+        } else
+                q->tail->next = task;
+
+        q->tail = task;
+        q->queued++;
+        this->dispatch();
+        return 0;
+}
+
+int ComputeExecutor::getStats(const int queue,
+                              struct ComputeQueueStats *stats) const
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const struct Queue         *q;
+
+        if (queue < 0 || (size_t) queue >= m_queues.size())
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        q                = m_queues[queue].get();
+        stats->weight    = q->weight;
+        stats->queued    = q->queued;
+        stats->completed = q->completed;
+        stats->runTime   = q->runTime;
+        memcpy(stats->wait, q->wait, sizeof stats->wait);
+        return 0;
+}
+
+/* Under m_mutex: hands tasks on while the executor has threads for them. */
+void ComputeExecutor::dispatch()
+{
+        struct Queue       *next;
+        struct ComputeTask *task;
+
+        while (m_inflight < m_executor->threads())
+        {
+                next = nullptr;
+                for (auto &queue : m_queues)
+                {
+                        if (queue->head &&
+                            (!next || queue->vtime < next->vtime))
+                                next = queue.get();
+                }
+
+                if (!next)
+                        break;
+
+                task       = next->head;
+                next->head = task->next;
+                if (!next->head)
+                        next->tail = nullptr;
+
+                next->queued--;
+                m_vtime      = std::max(m_vtime, next->vtime);
+                task->charge = next->cost;
+                next->vtime += next->cost / next->weight;
+                m_inflight++;
+                m_executor->submit(&task->base);
+        }
+}
+
+/* Counted as the task starts, so a long one shows up while it runs. */
+void ComputeExecutor::started(const int queue, const int64_t wait)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_queues[queue]->wait[__compute_bucket(wait)]++;
+}
+
+void ComputeExecutor::finish(const int queue, const double charge,
+                             const int64_t runTime)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        struct Queue               *q = m_queues[queue].get();
+
+        q->vtime += (runTime - charge) / q->weight;
+        q->cost = q->completed == 0 ? runTime
+                                    : q->cost + (runTime - q->cost) / 8;
+        q->completed++;
+        q->runTime += runTime;
+        m_inflight--;
+        this->dispatch();
+}
+
+/* Charged by the worker's CPU time: a task that blocks pays for less. */
+void ComputeExecutor::run(struct ExecutorTask *task)
+{
+        struct ComputeTask *t =
+                reinterpret_cast<struct ComputeTask *>(task);
+        ComputeExecutor    *executor = t->executor;
+        const int           queue    = t->queue;
+        const double        charge   = t->charge;
+        int64_t             start;
+
+        executor->started(queue, __compute_now(CLOCK_MONOTONIC) - t->queuedAt);
+        start = __compute_now(CLOCK_THREAD_CPUTIME_ID);
+
+        /* t may be gone once this returns. */
+        t->routine(t);
+        executor->finish(queue, charge,
+                         __compute_now(CLOCK_THREAD_CPUTIME_ID) - start);
+}
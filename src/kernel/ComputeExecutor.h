@@ -0,0 +1,122 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef COMPUTEEXECUTOR_H
+#define COMPUTEEXECUTOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Executor.h"
+
+/* Wait-time buckets: < 1us, < 2us, < 4us, ..., and the rest. */
+#define COMPUTE_WAIT_BUCKETS 32
+/* Cost charged at dispatch before a queue has run anything, in ns. */
+#define COMPUTE_INITIAL_COST 10000
+
+class ComputeExecutor;
+
+/*
+ * A unit of work for one of the named queues. Set routine; base, like
+ * the other fields, belongs to the executor until routine is called,
+ * which may then free the task.
+ */
+struct ComputeTask
+{
+        struct ExecutorTask base;
+        void (*routine)(struct ComputeTask *);
+        ComputeExecutor    *executor;
+        struct ComputeTask *next;
+        int                 queue;
+        int64_t             queuedAt;
+        double              charge;
+};
+
+struct ComputeQueueStats
+{
+        int    weight;
+        size_t queued;    /* submitted, not started yet */
+        size_t completed;
+        size_t runTime;   /* ns of CPU time in routine, summed */
+
+        /* By wait to start: under 1us, 1-2us, 2-4us... and the rest. */
+        size_t wait[COMPUTE_WAIT_BUCKETS];
+};
+
+/*
+ * Named queues in front of an executor, shared by weighted fair queuing.
+ * No more tasks are handed to the executor than it has active threads;
+ * the next one comes from the backlogged queue with the least virtual
+ * time, which advances by the CPU time its tasks take over its weight.
+ * Over a busy period each queue thus gets CPU in proportion to its
+ * weight, whatever the others submit, and a queue that was idle starts
+ * level with the rest rather than ahead. Tasks of one queue start in
+ * submission order.
+ *
+ * Time is charged at dispatch from the queue's average and corrected when
+ * the task returns, so one queue cannot take every thread at once.
+ *
+ * The executor must be running, and must outlive this; stopping it runs
+ * whatever is still queued here too.
+ */
+class ComputeExecutor
+{
+    public:
+        explicit ComputeExecutor(Executor *executor);
+
+        ComputeExecutor(const ComputeExecutor &) = delete;
+
+        ComputeExecutor &operator=(const ComputeExecutor &) = delete;
+
+        /*
+         * Returns the new queue's index, or -1 with errno set: EINVAL for
+         * a weight under 1, EEXIST for a name already taken.
+         */
+        int addQueue(const std::string &name, int weight);
+
+        /* The queue's index, or -1 with errno ENOENT. */
+        int findQueue(const std::string &name) const;
+
+        int setWeight(int queue, int weight);
+
+        /* -1 with errno EINVAL for an unknown queue. */
+        int submit(int queue, struct ComputeTask *task);
+
+        int getStats(int queue, struct ComputeQueueStats *stats) const;
+
+    private:
+        struct Queue
+        {
+                std::string         name;
+                int                 weight;
+                double              vtime;   /* ns of CPU over weight */
+                double              cost;    /* average ns per task */
+                struct ComputeTask *head;
+                struct ComputeTask *tail;
+                size_t              queued;
+                size_t              completed;
+                size_t              runTime;
+                size_t              wait[COMPUTE_WAIT_BUCKETS];
+        };
+
+        static void run(struct ExecutorTask *task);
+
+        void dispatch();
+
+        void started(int queue, int64_t wait);
+
+        void finish(int queue, double charge, int64_t runTime);
+
+        Executor                           *m_executor;
+        mutable std::mutex                  m_mutex;
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        double                              m_vtime; /* of the last start */
+        int                                 m_inflight;
+};
+
+#endif // COMPUTEEXECUTOR_H
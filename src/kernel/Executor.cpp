@@ -0,0 +1,532 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <new>
+#include <stdlib.h>
+#include <time.h>
+
+#include "Executor.h"
+
+#define EXECUTOR_DEQUE_SIZE 256
+#define EXECUTOR_INJECT_BATCH 32
+#define EXECUTOR_SPINS 64
+#define EXECUTOR_DUE_BURST 8
+
+namespace
+{
+        thread_local void *__executor_worker;
+
+        bool __executor_later(
+                const std::pair<int64_t, struct ExecutorTask *> &a,
+                const std::pair<int64_t, struct ExecutorTask *> &b)
+        {
+                return a.first > b.first;
+        }
+
+        uint64_t __executor_random(uint64_t *seed)
+        {
+                uint64_t x = *seed;
+
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                *seed = x;
+                return x;
+        }
+
+        int64_t __executor_now()
+        {
+                struct timespec ts;
+
+                clock_gettime(CLOCK_MONOTONIC, &ts);
+                return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        }
+
+        void __executor_futex_wait(std::atomic<uint32_t> *word, uint32_t val)
+        {
+                syscall(SYS_futex, word, FUTEX_WAIT_PRIVATE, val, nullptr,
+                        nullptr, 0);
+        }
+
+        void __executor_futex_wake(std::atomic<uint32_t> *word, int n)
+        {
+                syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, n, nullptr,
+                        nullptr, 0);
+        }
+} // namespace
+
+WorkDeque::WorkDeque() : m_top(0), m_bottom(0), m_array(nullptr)
+{
+        struct Array *array = static_cast<struct Array *>(calloc(
+                1, sizeof(struct Array) +
+                           EXECUTOR_DEQUE_SIZE * sizeof(array->slots[0])));
+
+        if (!array)
+                throw std::bad_alloc();
+
+        array->size = EXECUTOR_DEQUE_SIZE;
+        m_array.store(array, std::memory_order_relaxed);
+}
+
+WorkDeque::~WorkDeque()
+{
+        for (struct Array *array : m_retired)
+                free(array);
+
+        free(m_array.load(std::memory_order_relaxed));
+}
+
+struct WorkDeque::Array *WorkDeque::grow(struct Array *array,
+                                          const int64_t top,
+                                          const int64_t bottom)
+{
+        const int64_t size  = array->size * 2;
+        struct Array *next  = static_cast<struct Array *>(calloc(
+                1, sizeof(struct Array) + size * sizeof(array->slots[0])));
+
+        if (!next)
+                throw std::bad_alloc();
+
+        next->size = size;
+        for (int64_t i = top; i < bottom; i++)
+                next->slots[i & (size - 1)].store(
+                        array->slots[i & (array->size - 1)].load(
+                                std::memory_order_relaxed),
+                        std::memory_order_relaxed);
+
+        m_retired.push_back(array);
+        m_array.store(next, std::memory_order_release);
+        return next;
+}
+
+void WorkDeque::push(struct ExecutorTask *task)
+{
+        const int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+        const int64_t top    = m_top.load(std::memory_order_acquire);
+        struct Array *array  = m_array.load(std::memory_order_relaxed);
+
+        if (bottom - top > array->size - 1)
+                array = this->grow(array, top, bottom);
+
+        array->slots[bottom & (array->size - 1)].store(
+                task, std::memory_order_relaxed);
+        m_bottom.store(bottom + 1, std::memory_order_release);
+}
+
+struct ExecutorTask *WorkDeque::take()
+{
+        struct Array        *array = m_array.load(std::memory_order_relaxed);
+        struct ExecutorTask *task  = nullptr;
+        int64_t              bottom, top;
+
+        bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+        m_bottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        top = m_top.load(std::memory_order_relaxed);
+        if (top <= bottom)
+        {
+                task = array->slots[bottom & (array->size - 1)].load(
+                        std::memory_order_relaxed);
+                if (top == bottom)
+                {
+                        /* The last one: race the thieves for it. */
+                        if (!m_top.compare_exchange_strong(
+                                    top, top + 1, std::memory_order_seq_cst,
+                                    std::memory_order_relaxed))
+                                task = nullptr;
+
+                        m_bottom.store(bottom + 1, std::memory_order_relaxed);
+                }
+        } else
+                m_bottom.store(bottom + 1, std::memory_order_relaxed);
+
+        return task;
+}
+
+struct ExecutorTask *WorkDeque::steal()
+{
+        int64_t              top = m_top.load(std::memory_order_acquire);
+        int64_t              bottom;
+        struct Array        *array;
+        struct ExecutorTask *task;
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bottom = m_bottom.load(std::memory_order_acquire);
+        if (top >= bottom)
+                return nullptr;
+
+        array = m_array.load(std::memory_order_acquire);
+        task  = array->slots[top & (array->size - 1)].load(
+                std::memory_order_relaxed);
+        if (!m_top.compare_exchange_strong(top, top + 1,
+                                           std::memory_order_seq_cst,
+                                           std::memory_order_relaxed))
+                return nullptr;
+
+        return task;
+}
+
+bool WorkDeque::empty() const
+{
+        return m_bottom.load(std::memory_order_acquire) <=
+               m_top.load(std::memory_order_acquire);
+}
+
+size_t WorkDeque::size() const
+{
+        const int64_t n = m_bottom.load(std::memory_order_acquire) -
+                          m_top.load(std::memory_order_acquire);
+
+        return n > 0 ? n : 0;
+}
+
+Executor::Executor(const int nthreads) :
+        m_head(nullptr), m_tail(nullptr), m_injected(0), m_dueCount(0),
+        m_epoch(0),
+        m_sleepers(0), m_active(nthreads), m_gate(0), m_stopping(false)
+{
+        for (int i = 0; i < nthreads; i++)
+        {
+                m_workers.emplace_back(new Worker());
+                m_workers.back()->executor  = this;
+                m_workers.back()->seed      = 0x9e3779b97f4a7c15ULL * (i + 1);
+                m_workers.back()->index     = i;
+                m_workers.back()->completed = 0;
+                m_workers.back()->idleTime  = 0;
+                m_workers.back()->parkedAt  = 0;
+                m_workers.back()->burst     = 0;
+        }
+}
+
+Executor::~Executor()
+{
+        this->stop();
+}
+
+int Executor::start()
+{
+        m_stopping.store(false);
+        m_active.store(m_workers.size());
+        for (auto &worker : m_workers)
+        {
+                struct Worker *w = worker.get();
+
+                w->thread.reset(new std::thread(&Executor::workerRoutine, this,
+                                                w));
+        }
+
+        return 0;
+}
+
+void Executor::stop()
+{
+        m_stopping.store(true);
+        this->wake(INT_MAX);
+        m_gate.fetch_add(1, std::memory_order_release);
+        __executor_futex_wake(&m_gate, INT_MAX);
+        for (auto &worker : m_workers)
+        {
+                if (worker->thread)
+                {
+                        worker->thread->join();
+                        worker->thread.reset();
+                }
+        }
+}
+
+void Executor::submit(struct ExecutorTask *task)
+{
+        struct Worker *worker = static_cast<struct Worker *>(__executor_worker);
+
+        if (worker && worker->executor == this)
+                worker->deque.push(task);
+        else
+        {
+                task->next = nullptr;
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (m_tail)
+                        m_tail->next = task;
+                else
+                        m_head = task;
+
+                m_tail = task;
+                m_injected.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        /* Pairs with the fence in park(): either we see it, or it sees us. */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) > 0)
+                this->wake(1);
+}
+
+int Executor::setThreads(const int n)
+{
+        if (n < 1 || (size_t) n > m_workers.size())
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        m_active.store(n);
+
+        /* Sleepers recheck whether they are still in; retired ones too. */
+        this->wake(INT_MAX);
+        m_gate.fetch_add(1, std::memory_order_release);
+        __executor_futex_wake(&m_gate, INT_MAX);
+        return 0;
+}
+
+int Executor::threads() const
+{
+        return m_active.load(std::memory_order_relaxed);
+}
+
+void Executor::getStats(struct ExecutorStats *stats) const
+{
+        const auto    relaxed = std::memory_order_relaxed;
+        const int64_t now     = __executor_now();
+        int64_t       since;
+
+        stats->threads   = m_active.load(relaxed);
+        stats->queued    = m_injected.load(relaxed) + m_dueCount.load(relaxed);
+        stats->completed = 0;
+        stats->idleTime  = 0;
+        for (auto &worker : m_workers)
+        {
+                stats->queued += worker->deque.size();
+                stats->completed += worker->completed.load(relaxed);
+                stats->idleTime += worker->idleTime.load(relaxed);
+
+                /* A worker asleep all along counts too. */
+                since = worker->parkedAt.load(relaxed);
+                if (since != 0 && now > since)
+                        stats->idleTime += now - since;
+        }
+}
+
+void Executor::submit(struct ExecutorTask *task, const int64_t deadline)
+{
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                m_due.emplace_back(deadline, task);
+                std::push_heap(m_due.begin(), m_due.end(), __executor_later);
+                m_dueCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_sleepers.load(std::memory_order_relaxed) > 0)
+                this->wake(1);
+}
+
+void Executor::wake(const int n)
+{
+        m_epoch.fetch_add(1, std::memory_order_release);
+        __executor_futex_wake(&m_epoch, n);
+}
+
+bool Executor::hasWork() const
+{
+        if (m_injected.load(std::memory_order_relaxed) != 0 ||
+            m_dueCount.load(std::memory_order_relaxed) != 0)
+                return true;
+
+        for (auto &worker : m_workers)
+        {
+                if (!worker->deque.empty())
+                        return true;
+        }
+
+        return false;
+}
+
+void Executor::park(struct Worker *worker)
+{
+        const uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+        int64_t        start;
+
+        m_sleepers.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        /* Not once retired: a wake meant for an active worker is lost. */
+        if (!this->hasWork() && !m_stopping.load() &&
+            worker->index < m_active.load())
+        {
+                start = __executor_now();
+                worker->parkedAt.store(start, std::memory_order_relaxed);
+                __executor_futex_wait(&m_epoch, epoch);
+                worker->parkedAt.store(0, std::memory_order_relaxed);
+                worker->idleTime.store(worker->idleTime.load(
+                                               std::memory_order_relaxed) +
+                                               __executor_now() - start,
+                                       std::memory_order_relaxed);
+        }
+
+        m_sleepers.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void Executor::retire(struct Worker *worker)
+{
+        const uint32_t gate = m_gate.load(std::memory_order_acquire);
+
+        if (worker->index >= m_active.load() && !m_stopping.load())
+                __executor_futex_wait(&m_gate, gate);
+}
+
+struct ExecutorTask *Executor::takeInjected(struct Worker *worker)
+{
+        struct ExecutorTask *first, *task;
+        size_t               n;
+
+        if (m_injected.load(std::memory_order_relaxed) == 0)
+                return nullptr;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        first = m_head;
+        if (!first)
+                return nullptr;
+
+        /* Take a batch: run the first, keep the rest on our deque. */
+        task = first;
+        for (n = 1; n < EXECUTOR_INJECT_BATCH && task->next; n++)
+        {
+                task = task->next;
+                worker->deque.push(task);
+        }
+
+        m_head = task->next;
+        if (!m_head)
+                m_tail = nullptr;
+
+        m_injected.fetch_sub(n, std::memory_order_relaxed);
+        return first;
+}
+
+struct ExecutorTask *Executor::takeDue()
+{
+        struct ExecutorTask *task;
+
+        if (m_dueCount.load(std::memory_order_relaxed) == 0)
+                return nullptr;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_due.empty())
+                return nullptr;
+
+        std::pop_heap(m_due.begin(), m_due.end(), __executor_later);
+        task = m_due.back().second;
+        m_due.pop_back();
+        m_dueCount.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+}
+
+struct ExecutorTask *Executor::findTask(struct Worker *worker)
+{
+        const size_t         n = m_workers.size();
+        struct ExecutorTask *task;
+        size_t               start;
+
+        /* Due tasks first, but a plain one gets through now and then. */
+        if (worker->burst < EXECUTOR_DUE_BURST)
+        {
+                task = this->takeDue();
+                if (task)
+                {
+                        worker->burst++;
+                        return task;
+                }
+        }
+
+        worker->burst = 0;
+        task = worker->deque.take();
+        if (task)
+                return task;
+
+        task = this->takeInjected(worker);
+        if (task)
+                return task;
+
+        start = __executor_random(&worker->seed) % n;
+        for (size_t i = 0; i < n; i++)
+        {
+                struct Worker *victim = m_workers[(start + i) % n].get();
+
+                if (victim != worker)
+                {
+                        task = victim->deque.steal();
+                        if (task)
+                                return task;
+                }
+        }
+
+        return this->takeDue();
+}
+
+void Executor::runTask(struct Worker *worker, struct ExecutorTask *task)
+{
+        const size_t completed =
+                worker->completed.load(std::memory_order_relaxed);
+
+        task->routine(task);
+        worker->completed.store(completed + 1, std::memory_order_relaxed);
+}
+
+void Executor::workerRoutine(struct Worker *worker)
+{
+        struct ExecutorTask *task;
+        int                  spins = 0;
+
+        __executor_worker = worker;
+        while (1)
+        {
+                if (worker->index >= m_active.load(std::memory_order_relaxed))
+                {
+                        /* Parked by setThreads(): only our own deque. */
+                        task = worker->deque.take();
+                        if (task)
+                        {
+                                this->runTask(worker, task);
+                                continue;
+                        }
+
+                        if (m_stopping.load())
+                                break;
+
+                        this->retire(worker);
+                        continue;
+                }
+
+                task = this->findTask(worker);
+                if (task)
+                {
+                        spins = 0;
+                        this->runTask(worker, task);
+                        continue;
+                }
+
+                if (m_stopping.load() && !this->hasWork())
+                        break;
+
+                if (++spins < EXECUTOR_SPINS)
+                {
+                        std::this_thread::yield();
+                        continue;
+                }
+
+                spins = 0;
+                this->park(worker);
+        }
+
+        __executor_worker = nullptr;
+}
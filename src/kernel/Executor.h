@@ -0,0 +1,176 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/*
+ * A unit of work, embedded in whatever it runs for. next is used while the
+ * task waits in the injection list.
+ */
+struct ExecutorTask
+{
+        void (*routine)(struct ExecutorTask *);
+        struct ExecutorTask *next;
+};
+
+/*
+ * Chase-Lev deque. The owner pushes and takes at the bottom, thieves steal
+ * from the top; the array grows by doubling, and old arrays are kept until
+ * the deque goes away since a thief may still be reading one.
+ */
+class WorkDeque
+{
+    public:
+        WorkDeque();
+
+        ~WorkDeque();
+
+        WorkDeque(const WorkDeque &) = delete;
+
+        WorkDeque &operator=(const WorkDeque &) = delete;
+
+        void push(struct ExecutorTask *task);
+
+        struct ExecutorTask *take();
+
+        struct ExecutorTask *steal();
+
+        bool empty() const;
+
+        size_t size() const;
+
+    private:
+        struct Array
+        {
+                int64_t                            size;
+                std::atomic<struct ExecutorTask *> slots[0];
+        };
+
+        struct Array *grow(struct Array *array, int64_t top, int64_t bottom);
+
+        alignas(64) std::atomic<int64_t> m_top;
+        alignas(64) std::atomic<int64_t> m_bottom;
+        std::atomic<struct Array *>      m_array;
+        std::vector<struct Array *>      m_retired;
+};
+
+struct ExecutorStats
+{
+        int    threads;   /* active, see Executor::setThreads() */
+        size_t queued;    /* submitted, not started yet */
+        size_t completed;
+        size_t idleTime;  /* ns active workers spent parked, summed */
+};
+
+/*
+ * A pool of workers, each with its own deque. A task submitted by a worker
+ * goes onto that worker's deque; one from any other thread goes onto a
+ * shared injection list, which workers drain in batches. An idle worker
+ * steals from randomly chosen others and then parks on a futex until
+ * something is submitted.
+ *
+ * Tasks may run on any worker and, unless submitted with a deadline, in
+ * any order. stop() runs everything still queued, including tasks
+ * submitted meanwhile, before it returns.
+ */
+class Executor
+{
+    public:
+        explicit Executor(int nthreads);
+
+        ~Executor();
+
+        Executor(const Executor &) = delete;
+
+        Executor &operator=(const Executor &) = delete;
+
+        int start();
+
+        void stop();
+
+        void submit(struct ExecutorTask *task);
+
+        /*
+         * Queues task by deadline (CLOCK_MONOTONIC, in nanoseconds).
+         * Workers run such tasks before any plain one, earliest deadline
+         * first, but take a plain one after EXECUTOR_DUE_BURST of them in
+         * a row if there is any, so plain tasks are never starved. The
+         * queue is shared, so this costs a lock where submit() from a
+         * worker does not.
+         */
+        void submit(struct ExecutorTask *task, int64_t deadline);
+
+        /*
+         * Lets only the first n workers look for tasks. The others finish
+         * what is on their own deque, which may be stolen meanwhile, and
+         * park until n covers them again. n is between 1 and the pool
+         * size, or EINVAL. start() runs them all.
+         */
+        int setThreads(int n);
+
+        int threads() const;
+
+        void getStats(struct ExecutorStats *stats) const;
+
+    private:
+        struct Worker
+        {
+                WorkDeque                    deque;
+                Executor                    *executor;
+                std::unique_ptr<std::thread> thread;
+                uint64_t                     seed;
+                int                          index;
+                std::atomic<size_t>          completed; /* written by owner */
+                std::atomic<size_t>          idleTime;
+                std::atomic<int64_t>         parkedAt;  /* 0 when awake */
+                int                          burst;     /* due in a row */
+        };
+
+        void workerRoutine(struct Worker *worker);
+
+        void runTask(struct Worker *worker, struct ExecutorTask *task);
+
+        struct ExecutorTask *findTask(struct Worker *worker);
+
+        struct ExecutorTask *takeInjected(struct Worker *worker);
+
+        struct ExecutorTask *takeDue();
+
+        bool hasWork() const;
+
+        void park(struct Worker *worker);
+
+        void retire(struct Worker *worker);
+
+        void wake(int n);
+
+        std::vector<std::unique_ptr<struct Worker>> m_workers;
+
+        std::mutex           m_mutex;
+        struct ExecutorTask *m_head;
+        struct ExecutorTask *m_tail;
+        std::atomic<size_t>  m_injected;
+
+        /* Min-heap of tasks submitted with a deadline. */
+        std::vector<std::pair<int64_t, struct ExecutorTask *>> m_due;
+        std::atomic<size_t>                                   m_dueCount;
+
+        std::atomic<uint32_t> m_epoch; /* futex word */
+        std::atomic<int>      m_sleepers;
+        std::atomic<int>      m_active;
+        std::atomic<uint32_t> m_gate;  /* futex word of retired workers */
+        std::atomic<bool>     m_stopping;
+};
+
+#endif // EXECUTOR_H
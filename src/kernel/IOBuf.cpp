@@ -0,0 +1,261 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <new>
+
+#include "IOBuf.h"
+
+IOBuf::IOBuf(IOBuf &&other) noexcept :
+        m_slices(std::move(other.m_slices)), m_head(other.m_head),
+        m_length(other.m_length)
+{
+        other.m_slices.clear();
+        other.m_head   = 0;
+        other.m_length = 0;
+}
+
+IOBuf &IOBuf::operator=(IOBuf &&other) noexcept
+{
+        if (this != &other)
+        {
+                this->clear();
+                m_slices = std::move(other.m_slices);
+                m_head   = other.m_head;
+                m_length = other.m_length;
+                other.m_slices.clear();
+                other.m_head   = 0;
+                other.m_length = 0;
+        }
+
+        return *this;
+}
+
+IOBufBlock *IOBuf::newBlock(const size_t size)
+{
+        IOBufBlock *block = static_cast<IOBufBlock *>(
+                malloc(sizeof(IOBufBlock) + size));
+
+        if (block)
+        {
+                new (&block->ref) std::atomic<int>(1);
+                block->size = size;
+                block->used = 0;
+        }
+
+        return block;
+}
+
+void IOBuf::unref(IOBufBlock *block)
+{
+        if (block->ref.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                free(block);
+}
+
+void IOBuf::pushSlice(IOBufBlock *block, const size_t offset, const size_t n)
+{
+        /* Reclaim consumed slots before growing. */
+        if (m_head > 0 && m_head * 2 >= m_slices.size())
+        {
+                m_slices.erase(m_slices.begin(), m_slices.begin() + m_head);
+                m_head = 0;
+        }
+
+        m_slices.push_back({block, offset, n});
+        m_length += n;
+}
+
+int IOBuf::append(const void *buf, size_t n)
+{
+        const char *p = static_cast<const char *>(buf);
+        IOBufBlock *block;
+        size_t      room;
+
+        if (m_slices.size() > m_head)
+        {
+                /* Grow the tail in place when nobody else can see it. */
+                struct IOBufSlice *last  = &m_slices.back();
+                block                    = last->block;
+                if (block->ref.load(std::memory_order_acquire) == 1 &&
+                    last->offset + last->length == block->used)
+                {
+                        room = block->size - block->used;
+                        if (room > n)
+                                room = n;
+
+                        memcpy(block->data + block->used, p, room);
+                        block->used += room;
+                        last->length += room;
+                        m_length += room;
+                        p += room;
+                        n -= room;
+                }
+        }
+
+        if (n == 0)
+                return 0;
+
+        block = IOBuf::newBlock(n > IOBUF_BLOCK_SIZE ? n : IOBUF_BLOCK_SIZE);
+        if (!block)
+                return -1;
+
+        memcpy(block->data, p, n);
+        block->used = n;
+        this->pushSlice(block, 0, n);
+        return 0;
+}
+
+int IOBuf::append(IOBufBlock *block, const size_t offset, const size_t n)
+{
+        if (offset + n > block->size)
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        if (n > 0)
+        {
+                IOBuf::ref(block);
+                this->pushSlice(block, offset, n);
+        }
+
+        return 0;
+}
+
+void IOBuf::append(IOBuf &&buf)
+{
+        for (size_t i = buf.m_head; i < buf.m_slices.size(); i++)
+        {
+                const struct IOBufSlice &slice = buf.m_slices[i];
+                this->pushSlice(slice.block, slice.offset, slice.length);
+        }
+
+        buf.m_slices.clear();
+        buf.m_head   = 0;
+        buf.m_length = 0;
+}
+
+IOBuf IOBuf::clone() const
+{
+        IOBuf buf;
+
+        for (size_t i = m_head; i < m_slices.size(); i++)
+        {
+                const struct IOBufSlice &slice = m_slices[i];
+                buf.append(slice.block, slice.offset, slice.length);
+        }
+
+        return buf;
+}
+
+size_t IOBuf::cutFront(size_t n, IOBuf *out)
+{
+        size_t cut = 0;
+
+        while (n > 0 && m_head < m_slices.size())
+        {
+                struct IOBufSlice *slice = &m_slices[m_head];
+
+                if (slice->length <= n)
+                {
+                        /* The whole slice moves: hand over its reference. */
+                        out->pushSlice(slice->block, slice->offset,
+                                       slice->length);
+                        n -= slice->length;
+                        cut += slice->length;
+                        m_length -= slice->length;
+                        m_head++;
+                } else
+                {
+                        out->append(slice->block, slice->offset, n);
+                        slice->offset += n;
+                        slice->length -= n;
+                        m_length -= n;
+                        cut += n;
+                        n = 0;
+                }
+        }
+
+        if (m_head == m_slices.size())
+        {
+                m_slices.clear();
+                m_head = 0;
+        }
+
+        return cut;
+}
+
+void IOBuf::popFront(size_t n)
+{
+        while (n > 0 && m_head < m_slices.size())
+        {
+                struct IOBufSlice *slice = &m_slices[m_head];
+
+                if (slice->length <= n)
+                {
+                        n -= slice->length;
+                        m_length -= slice->length;
+                        IOBuf::unref(slice->block);
+                        m_head++;
+                } else
+                {
+                        slice->offset += n;
+                        slice->length -= n;
+                        m_length -= n;
+                        n = 0;
+                }
+        }
+
+        if (m_head == m_slices.size())
+        {
+                m_slices.clear();
+                m_head = 0;
+        }
+}
+
+size_t IOBuf::copyOut(void *buf, size_t n) const
+{
+        char  *p      = static_cast<char *>(buf);
+        size_t copied = 0;
+
+        for (size_t i = m_head; i < m_slices.size() && copied < n; i++)
+        {
+                const struct IOBufSlice &slice = m_slices[i];
+                size_t len = slice.length < n - copied ? slice.length
+                                                       : n - copied;
+
+                memcpy(p + copied, slice.block->data + slice.offset, len);
+                copied += len;
+        }
+
+        return copied;
+}
+
+int IOBuf::peekIovec(struct iovec *iov, const int max) const
+{
+        int cnt = 0;
+
+        for (size_t i = m_head; i < m_slices.size() && cnt < max; i++)
+        {
+                iov[cnt].iov_base = m_slices[i].block->data +
+                                    m_slices[i].offset;
+                iov[cnt].iov_len = m_slices[i].length;
+                cnt++;
+        }
+
+        return cnt;
+}
+
+void IOBuf::clear()
+{
+        for (size_t i = m_head; i < m_slices.size(); i++)
+                IOBuf::unref(m_slices[i].block);
+
+        m_slices.clear();
+        m_head   = 0;
+        m_length = 0;
+}
@@ -0,0 +1,95 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef IOBUF_H
+#define IOBUF_H
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#define IOBUF_BLOCK_SIZE (16 * 1024)
+
+/*
+ * A refcounted block of bytes. Slices of it may be held by any number of
+ * IOBufs on any thread; it is freed with its last reference.
+ */
+struct IOBufBlock
+{
+        std::atomic<int> ref;
+        size_t           size;
+        size_t           used;
+        char             data[0];
+};
+
+/*
+ * A chain of block slices. Moving bytes between chains, cloning a chain or
+ * cutting a prefix off copies no data, so a body read from one connection
+ * can be queued for writing on another one as is. The chain maps directly
+ * to the iovecs of a writev().
+ */
+class IOBuf
+{
+    public:
+        IOBuf() : m_head(0), m_length(0) {}
+
+        IOBuf(IOBuf &&other) noexcept;
+
+        IOBuf &operator=(IOBuf &&other) noexcept;
+
+        IOBuf(const IOBuf &) = delete;
+
+        IOBuf &operator=(const IOBuf &) = delete;
+
+        ~IOBuf() { this->clear(); }
+
+        size_t length() const { return m_length; }
+
+        bool empty() const { return m_length == 0; }
+
+        int append(const void *buf, size_t n);
+
+        int append(IOBufBlock *block, size_t offset, size_t n);
+
+        void append(IOBuf &&buf);
+
+        IOBuf clone() const;
+
+        size_t cutFront(size_t n, IOBuf *out);
+
+        void popFront(size_t n);
+
+        size_t copyOut(void *buf, size_t n) const;
+
+        int peekIovec(struct iovec *iov, int max) const;
+
+        void clear();
+
+        static IOBufBlock *newBlock(size_t size);
+
+        static void ref(IOBufBlock *block)
+        {
+                block->ref.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        static void unref(IOBufBlock *block);
+
+    private:
+        struct IOBufSlice
+        {
+                IOBufBlock *block;
+                size_t      offset;
+                size_t      length;
+        };
+
+        void pushSlice(IOBufBlock *block, size_t offset, size_t n);
+
+        std::vector<struct IOBufSlice> m_slices;
+        size_t                         m_head;
+        size_t                         m_length;
+};
+
+#endif // IOBUF_H
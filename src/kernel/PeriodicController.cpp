@@ -0,0 +1,54 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <chrono>
+
+#include "PeriodicController.h"
+
+PeriodicController::PeriodicController(const int interval) :
+        m_interval(interval), m_stopping(false)
+{
+}
+
+int PeriodicController::start()
+{
+        m_stopping = false;
+        m_thread.reset(
+                new std::thread(&PeriodicController::threadRoutine, this));
+        return 0;
+}
+
+void PeriodicController::stop()
+{
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                m_stopping = true;
+        }
+
+        m_cond.notify_all();
+        if (m_thread)
+        {
+                m_thread->join();
+                m_thread.reset();
+        }
+}
+
+void PeriodicController::threadRoutine()
+{
+        std::chrono::steady_clock::time_point then, now;
+        std::unique_lock<std::mutex>          lock(m_mutex);
+
+        this->begin();
+        then = std::chrono::steady_clock::now();
+        while (!m_cond.wait_for(lock, std::chrono::milliseconds(m_interval),
+                                [this] { return m_stopping; }))
+        {
+                now = std::chrono::steady_clock::now();
+                this->pass(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   now - then)
+                                   .count());
+                then = now;
+        }
+}
@@ -0,0 +1,58 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef PERIODICCONTROLLER_H
+#define PERIODICCONTROLLER_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/*
+ * A background thread that samples something every interval milliseconds
+ * and acts on it, as Rebalancer and Autoscaler do. begin() takes the first
+ * samples; pass() follows each interval, given the nanoseconds since the
+ * one before. Both run on that thread, with the controller locked.
+ *
+ * A subclass must stop() in its destructor, before its own members go.
+ */
+class PeriodicController
+{
+    public:
+        PeriodicController(const PeriodicController &) = delete;
+
+        PeriodicController &operator=(const PeriodicController &) = delete;
+
+        int start();
+
+        void stop();
+
+    protected:
+        explicit PeriodicController(int interval);
+
+        ~PeriodicController() = default;
+
+        /* A parameter of zero or less picks its default. */
+        template <typename T>
+        static T pick(const T value, const T def)
+        {
+                return value > 0 ? value : def;
+        }
+
+        virtual void begin() = 0;
+
+        virtual void pass(double wall) = 0;
+
+    private:
+        void threadRoutine();
+
+        int                          m_interval;
+        std::unique_ptr<std::thread> m_thread;
+        std::mutex                   m_mutex;
+        std::condition_variable      m_cond;
+        bool                         m_stopping;
+};
+
+#endif // PERIODICCONTROLLER_H
@@ -3,13 +3,21 @@
 //
 
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
 #include <sys/types.h>
 #include <sys/uio.h>
 
+#include <algorithm>
+#include <future>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <linux/mempolicy.h>
+#include <sched.h>
 #include <openssl/ssl.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -17,12 +25,19 @@
 #include <time.h>
 #include <unistd.h>
 
+#include "Arena.h"
+#include "IOBuf.h"
 #include "List.h"
 #include "Poller.h"
 #include "RBTree.h"
 
 namespace
 {
+        /* Operation serials, shared so a migrated node keeps a unique one. */
+        std::atomic<unsigned int> __poller_serial(0);
+
+        thread_local void *__poller_local;
+
         int __poller_create_pfd()
         {
                 // 内部逻辑
@@ -44,20 +59,18 @@ namespace
                                        nullptr);
         }
 
-        long __timeout_cmp(const struct PollerNode *node1,
-                           const struct PollerNode *node2)
+        int64_t __poller_now()
         {
-                long ret = node1->timeout.tv_sec - node2->timeout.tv_sec;
+                struct timespec now;
 
-                if (ret == 0)
-                        ret = node1->timeout.tv_nsec - node2->timeout.tv_nsec;
-
-                return ret;
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                return now.tv_sec * 1000000000LL + now.tv_nsec;
         }
 
-        int __poller_del_fd(const int fd, const int pfd)
+        int64_t __timeout_cmp(const struct PollerNode *node1,
+                              const struct PollerNode *node2)
         {
-                return epoll_ctl(pfd, EPOLL_CTL_DEL, fd, nullptr);
+                return node1->deadline - node2->deadline;
         }
 
         int __poller_close_timerfd(const int fd) { return close(fd); }
@@ -69,7 +82,6 @@ namespace
                 struct epoll_event ev;
                 ev.events   = EPOLLIN | EPOLLET;
                 ev.data.ptr = nullptr;
-                ev.data.fd  = timerfd;
                 return epoll_ctl(pfd, EPOLL_CTL_ADD, timerfd, &ev);
         }
 
@@ -97,11 +109,191 @@ namespace
                 return epoll_ctl(pfd, EPOLL_CTL_ADD, fd, &ev);
         }
 
+        int __poller_op_event(const struct PollerNode *node)
+        {
+                switch (node->data.operation)
+                {
+                        case PD_OP_READ:
+                        case PD_OP_LISTEN:
+                        case PD_OP_RECVFROM:
+                        case PD_OP_EVENT:
+                        case PD_OP_NOTIFY:
+                                return EPOLLIN;
+                        case PD_OP_WRITE:
+                        case PD_OP_CONNECT:
+                                return EPOLLOUT;
+                        default:
+                                return 0;
+                }
+        }
+
+        int __poller_node_event(const struct PollerNode *node)
+        {
+                if (node->data.flags & PD_FL_EDGE)
+                        return EPOLLIN | EPOLLOUT | EPOLLET;
+
+                int event = __poller_op_event(node);
+
+                if (node->queue && node->queue->waiting)
+                        event |= EPOLLOUT;
+
+                if (node->paused)
+                        event &= ~EPOLLIN;
+
+                return event;
+        }
+
+        /* 0 for PD_FL_HIGH, 2 for PD_FL_BULK, 1 otherwise. */
+        int __poller_class(const struct PollerData *data)
+        {
+                if (data->flags & PD_FL_HIGH)
+                        return 0;
+
+                return data->flags & PD_FL_BULK ? 2 : 1;
+        }
+
+        /* The timer fd and the pipe, null, go with the normal class. */
+        int __poller_event_class(const struct PollerNode *node)
+        {
+                return node ? __poller_class(&node->data) : 1;
+        }
+
+        /* Bytes of delivered messages still charged to the node. */
+        size_t __poller_retained(const struct PollerNode *node)
+        {
+                const PollerMessage *msg = node->data.message;
+
+                if (node->data.operation == PD_OP_READ && msg)
+                        return node->inbound - msg->bytes;
+
+                return node->inbound;
+        }
+
+        void __poller_set_deadline(const int timeout, int64_t *deadline)
+        {
+                *deadline = __poller_now() + timeout * 1000000LL;
+        }
+
+        void __poller_insert_timeout(struct PollerNode *node,
+                                     struct list_head  *timeoutList)
+        {
+                struct list_head *pos;
+
+                list_for_each_prev(pos, timeoutList)
+                {
+                        if (__timeout_cmp(list_entry(pos, struct PollerNode,
+                                                     list),
+                                          node) <= 0)
+                                break;
+                }
+
+                list_add(&node->list, pos);
+        }
+
+        struct PollerNode *__poller_new_node(const struct PollerData *data)
+        {
+                struct PollerNode *res = nullptr;
+                struct PollerNode *node;
+
+                switch (data->operation)
+                {
+                        case PD_OP_READ:
+                                if (!data->createMessage)
+                                {
+                                        errno = EINVAL;
+                                        return nullptr;
+                                }
+                                break;
+                        case PD_OP_LISTEN:
+                        case PD_OP_RECVFROM:
+                        case PD_OP_EVENT:
+                        case PD_OP_NOTIFY:
+                                res = new PollerNode{};
+                                break;
+                        case PD_OP_WRITE:
+                        case PD_OP_CONNECT:
+                        case PD_OP_TIMER:
+                        case PD_OP_IDLE:
+                                break;
+                        default:
+                                errno = EINVAL;
+                                return nullptr;
+                }
+
+                node       = new PollerNode{};
+                node->data = *data;
+                node->res  = res;
+                if (data->operation == PD_OP_READ)
+                        node->data.message = nullptr;
+
+                return node;
+        }
+
+        /*
+         * Maps at least *size bytes. For huge pages, explicit ones are tried
+         * first, then a 2M-aligned mapping advised for transparent ones.
+         */
+        char *__poller_map_buffer(size_t *size, const int huge)
+        {
+                const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+                char     *p, *aligned;
+
+                if (!huge)
+                {
+                        p = static_cast<char *>(mmap(nullptr, *size,
+                                                     PROT_READ | PROT_WRITE,
+                                                     flags, -1, 0));
+                        return p == MAP_FAILED ? nullptr : p;
+                }
+
+                *size = (*size + POLLER_HUGE_PAGE - 1) &
+                        ~(size_t) (POLLER_HUGE_PAGE - 1);
+                p = static_cast<char *>(mmap(nullptr, *size,
+                                             PROT_READ | PROT_WRITE,
+                                             flags | MAP_HUGETLB, -1, 0));
+                if (p != MAP_FAILED)
+                        return p;
+
+                p = static_cast<char *>(mmap(nullptr, *size + POLLER_HUGE_PAGE,
+                                             PROT_READ | PROT_WRITE, flags, -1,
+                                             0));
+                if (p == MAP_FAILED)
+                        return nullptr;
+
+                aligned = p + (-reinterpret_cast<uintptr_t>(p) &
+                               (POLLER_HUGE_PAGE - 1));
+                if (aligned != p)
+                        munmap(p, aligned - p);
+
+                munmap(aligned + *size, p + POLLER_HUGE_PAGE - aligned);
+                madvise(aligned, *size, MADV_HUGEPAGE);
+                return aligned;
+        }
+
+        /*
+         * Prefers the node this thread runs on, for the buffer (not touched
+         * yet) and for anything the thread allocates from now on.
+         */
+        void __poller_bind_local(char *buf, const size_t size)
+        {
+                unsigned long mask;
+                unsigned int  cpu, node;
+
+                if (getcpu(&cpu, &node) < 0 || node >= sizeof mask * CHAR_BIT)
+                        return;
+
+                mask = 1UL << node;
+                syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask,
+                        sizeof mask * CHAR_BIT + 1);
+                syscall(SYS_mbind, buf, size, MPOL_PREFERRED, &mask,
+                        sizeof mask * CHAR_BIT + 1, 0);
+        }
+
         int __poller_open_pipe(Poller &poller)
         {
                 int pipefd[2];
 
-                if (pipe(pipefd) >= 0)
+                if (pipe2(pipefd, O_NONBLOCK) >= 0)
                 {
                         if (__poller_add_fd(pipefd[0], EPOLLIN,
                                             reinterpret_cast<void *>(1),
@@ -122,443 +314,2666 @@ namespace
 } // namespace
 
 
-Poller::Poller(const struct PollerParams *params)
+Poller::Poller(const struct PollerParams *params) :
+        m_pendingBytes(0), m_inboundBytes(0), m_pausedReads(0),
+        m_readCalls(0), m_readBytes(0), m_waitCalls(0), m_ctlCalls(0),
+        m_readSize(0), m_waitEvents(0), m_busyTime(0), m_stateTime(0),
+        m_inflight(0),
+        m_writeBlocked(false), m_commands(nullptr), m_threadId()
 {
-        m_pfd = __poller_create_pfd();
+        m_stopped = 1;
+        m_timerfd = -1;
+        m_pfd     = __poller_create_pfd();
         if (m_pfd >= 0)
         {
                 const int timerfd = __poller_create_timer(m_pfd);
                 if (timerfd >= 0)
                 {
-                        m_timerfd = timerfd;
-                        std::unique_lock lock(m_mutex);
-                        m_maxOpenFiles = params->maxOpenFiles;
-                        m_callback     = params->callback;
-                        m_context      = params->content;
+                        m_timerfd       = timerfd;
+                        m_maxOpenFiles  = params->maxOpenFiles;
+                        m_callback      = params->callback;
+                        m_batchCallback = params->batchCallback;
+                        m_context       = params->content;
+                        m_executor      = params->executor;
+                        m_corkBytes     = params->writeCorkBytes;
+                        m_corkMessages  = params->writeCorkMessages;
+                        m_highWatermark = params->writeHighWatermark;
+                        if (m_highWatermark)
+                                m_fdPending.reset(new std::atomic<size_t>
+                                                          [m_maxOpenFiles]());
+                        m_lowWatermark  = params->writeLowWatermark;
+                        m_pollerHighWatermark =
+                                params->pollerWriteHighWatermark;
+                        m_pollerLowWatermark = params->pollerWriteLowWatermark;
+                        m_readBudget         = params->readBudget;
+                        m_pollerReadBudget   = params->pollerReadBudget;
+                        m_retainedBytes      = 0;
+                        m_idleTrim           = params->idleTrimTimeout;
+                        m_readMin = params->readSizeMin ? params->readSizeMin
+                                                        : POLLER_READ_MIN;
+                        m_readMax = params->readSizeMax ? params->readSizeMax
+                                                        : POLLER_BUFSIZE;
+                        m_readMin = std::min(m_readMin, m_readMax);
+                        m_eventsMax = params->eventsMax > 0
+                                              ? params->eventsMax
+                                              : POLLER_EVENTS_MAX;
+                        m_eventsMin = params->eventsMin > 0
+                                              ? params->eventsMin
+                                              : POLLER_EVENTS_MIN;
+                        m_eventsMin = std::min(m_eventsMin, m_eventsMax);
+                        m_ringSize  = params->ringSize ? params->ringSize
+                                                       : RING_BUFFER_SIZE;
+                        m_memoryFlags   = params->memoryFlags;
+                        m_cpus          = params->cpus;
+                        m_schedPolicy   = params->schedPolicy;
+                        m_schedPriority = params->schedPriority;
+                        m_nthreads      = std::max(params->threads, 1);
+                        m_oneshot       = m_nthreads > 1 ? (int) EPOLLONESHOT
+                                                         : 0;
+                        m_leaving       = 0;
+                        m_spareRearms   = nullptr;
+                        m_active        = m_nthreads;
+                        m_lockedAt      = 0;
+                        m_bufSize = std::max<size_t>(m_readMax,
+                                                     POLLER_DGRAM_MAX);
+                        m_nextTrim           = 0;
+                        m_loopTime           = 0;
+                        m_classed            = 0;
+                        m_locals.reset(new PollerLocal[m_nthreads]());
+                        for (int i = 0; i < m_nthreads; i++)
+                        {
+                                m_locals[i].poller = this;
+                                m_locals[i].buf    = nullptr;
+                                m_locals[i].hotFd  = -1;
+                        }
 
-                        m_stopped = 1;
+                        m_ranked.reserve(m_eventsMax);
+                        m_due[0] = 1000LL * (params->dueHigh > 0
+                                                     ? params->dueHigh
+                                                     : POLLER_DUE_HIGH);
+                        m_due[1] = 1000LL * (params->dueNormal > 0
+                                                     ? params->dueNormal
+                                                     : POLLER_DUE_NORMAL);
+                        m_due[2] = 1000LL * (params->dueBulk > 0
+                                                     ? params->dueBulk
+                                                     : POLLER_DUE_BULK);
+                        m_dueSet = params->dueHigh > 0 ||
+                                   params->dueNormal > 0 ||
+                                   params->dueBulk > 0;
+                        m_nodes.resize(m_maxOpenFiles, nullptr);
+                        m_epochs.resize(m_maxOpenFiles, 0);
+                        if (m_oneshot)
+                                m_generations.resize(m_maxOpenFiles, 0);
+
+                        INIT_LIST_HEAD(&m_timeoutList);
+                        INIT_LIST_HEAD(&m_nonTimeoutList);
+                        INIT_LIST_HEAD(&m_retiredList);
+                        INIT_LIST_HEAD(&m_flushList);
+                        return;
                 }
                 __poller_close_pfd(m_pfd);
+                m_pfd = -1;
         }
 }
 
-int Poller::start()
+Poller::~Poller()
 {
-        std::unique_lock lock(m_mutex);
-        if (__poller_open_pipe(*this) >= 0)
+        struct PollerCommand *cmd;
+
+        this->stop();
+
+        /* Issued to a poller that never started. */
+        cmd = this->m_commands.exchange(nullptr, std::memory_order_acquire);
+        while (cmd)
         {
-                m_thread.reset(new std::thread(&Poller::threadRoutine, this));
-                this->m_stopped = 0;
+                struct PollerCommand *next = cmd->next;
+
+                if (cmd->node)
+                {
+                        delete cmd->node->res;
+                        delete cmd->node;
+                }
+
+                delete cmd;
+                cmd = next;
         }
-        return -this->m_stopped;
+
+        if (this->m_timerfd >= 0)
+                close(this->m_timerfd);
+
+        if (this->m_pfd >= 0)
+                __poller_close_pfd(this->m_pfd);
 }
 
-void Poller::handleRead(struct PollerNode *node)
+int Poller::start()
 {
-        ssize_t nLeft = 0;
-        size_t  n;
-        char   *p;
+        int error = 0;
 
-        while (1)
+        if (m_nthreads > 1 && (m_executor || m_batchCallback))
         {
-                p = m_buf;
-                if (!node->data.ssl)
-                {
-                        nLeft = read(node->data.fd, p, POLLER_BUFSIZE);
-                        if (nLeft < 0)
-                        {
-                                if (errno == EAGAIN)
-                                        return;
-                        }
-                } else
+                errno = EINVAL;
+                return -1;
+        }
+
+        /* Mapped here, first touched (and placed) by their threads. */
+        for (int i = 0; i < m_nthreads; i++)
+        {
+                m_locals[i].buf = __poller_map_buffer(
+                        &m_bufSize, m_memoryFlags & PP_MEM_HUGE);
+                if (!m_locals[i].buf)
+                        goto unmap;
+        }
+
+        if (__poller_open_pipe(*this) >= 0)
+        {
+                /* Threads set up one at a time, then wait here to lead. */
+                std::unique_lock<std::mutex> lock(this->m_leader);
+
+                this->m_leaving = 0;
+                this->m_active  = this->m_nthreads;
+                for (int i = 0; i < this->m_nthreads && error == 0; i++)
                 {
-                        // TODO: SSL_READ
-                }
+                        std::promise<int> setup;
+                        std::future<int>  result = setup.get_future();
 
-                if (nLeft <= 0)
-                        break;
+                        this->m_threads.emplace_back(
+                                [this, &setup, i]
+                                {
+                                        const int ret = this->setupThread(i);
 
-                do
+                                        setup.set_value(ret < 0 ? errno : 0);
+                                        if (ret >= 0)
+                                                this->threadRoutine(i);
+                                });
+
+                        error = result.get();
+                }
+
+                if (error == 0)
                 {
-                        n = nLeft;
-                        if (this->appendMessage(p, &n, node) >= 0)
-                        {
-                                nLeft -= n;
-                                p += n;
-                        } else
-                                nLeft = -1;
-                } while (nLeft > 0);
+                        this->m_stopped = 0;
+                        return 0;
+                }
 
-                if (nLeft < 0)
-                        break;
+                this->m_leaving = 1;
+                lock.unlock();
+                for (std::thread &thread : this->m_threads)
+                        thread.join();
 
-                if (node->removed)
-                        return;
+                this->m_threads.clear();
+                close(this->m_pipeRead);
+                close(this->m_pipeWrite);
+                errno = error;
         }
 
-        if (this->removeNode(node))
-                return;
-
-        if (nLeft == 0)
-        {
-                node->error = 0;
-                node->state = PR_ST_FINISHED;
-        } else
+unmap:
+        error = errno;
+        for (int i = 0; i < m_nthreads; i++)
         {
-                node->error = errno;
-                node->state = PR_ST_ERROR;
+                if (m_locals[i].buf)
+                        munmap(m_locals[i].buf, m_bufSize);
+
+                m_locals[i].buf = nullptr;
         }
 
-        delete node->res;
-        this->m_callback(reinterpret_cast<PollerResult *>(node),
-                         this->m_context);
+        errno = error;
+        return -1;
 }
 
-void Poller::handleWrite(struct PollerNode *node)
+int Poller::setupThread(const int index)
 {
-        struct iovec *iov   = node->data.writeIov;
-        size_t        count = 0;
-        ssize_t       nLeft = 0;
-        int           iovcnt;
-        int           ret = 0;
+        struct sched_param param = {};
+        cpu_set_t          set;
+        int                ret;
 
-        while (node->data.iovcnt > 0)
+        if (!this->m_cpus.empty())
         {
-                if (!node->data.ssl)
+                CPU_ZERO(&set);
+                for (int cpu : this->m_cpus)
                 {
-                        iovcnt = node->data.iovcnt;
-                        if (iovcnt > IOV_MAX)
-                                iovcnt = IOV_MAX;
-
-                        nLeft = writev(node->data.fd, iov, iovcnt);
-                        if (nLeft < 0)
+                        if (cpu < 0 || cpu >= CPU_SETSIZE)
                         {
-                                ret = errno == EAGAIN ? 0 : -1;
-                                break;
+                                errno = EINVAL;
+                                return -1;
                         }
-                } else if (iov->iov_len > 0)
-                {
-                        // TODO SSL Write
-                } else
-                        nLeft = 0;
 
-                count += nLeft;
-                do
+                        CPU_SET(cpu, &set);
+                }
+
+                ret = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+                if (ret != 0)
                 {
-                        if (nLeft >= iov->iov_len)
-                        {
-                                nLeft -= iov->iov_len;
-                                iov->iov_base =
-                                        static_cast<char *>(iov->iov_base) +
-                                        iov->iov_len;
-                                iov->iov_len = 0;
-                                iov++;
-                                node->data.iovcnt--;
-                        } else
-                        {
-                                iov->iov_base =
-                                        static_cast<char *>(iov->iov_base) +
-                                        nLeft;
-                                iov->iov_len -= nLeft;
-                                break;
-                        }
-                } while (node->data.iovcnt > 0);
+                        errno = ret;
+                        return -1;
+                }
         }
 
-        node->data.writeIov = iov;
-        if (node->data.iovcnt > 0 && ret >= 0)
+        if (this->m_schedPolicy != SCHED_OTHER || this->m_schedPriority != 0)
         {
-                if (count == 0)
-                        return;
-
-                if (node->data.partialWritten(count, node->data.context) >= 0)
-                        return;
+                param.sched_priority = this->m_schedPriority;
+                ret = pthread_setschedparam(pthread_self(), this->m_schedPolicy,
+                                            &param);
+                if (ret != 0)
+                {
+                        errno = ret;
+                        return -1;
+                }
         }
 
-        if (this->removeNode(node))
-                return;
+        __poller_local = &this->m_locals[index];
 
-        if (node->data.iovcnt == 0)
-        {
-                node->error = 0;
-                node->state = PR_ST_FINISHED;
-        } else
+        /* After pinning, so this is the node of the chosen cpus. */
+        if (this->m_memoryFlags & PP_MEM_LOCAL)
+                __poller_bind_local(this->local()->buf, this->m_bufSize);
+
+        if (this->m_memoryFlags & PP_MEM_PREFAULT)
+                this->prefault();
+
+        if (this->m_memoryFlags & PP_MEM_LOCK)
         {
-                node->error = errno;
-                node->state = PR_ST_ERROR;
+                if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+                        return -1;
         }
 
-        this->m_callback(castPollerNodeToResult(node), this->m_context);
+        return 0;
 }
 
-void Poller::handleListen(struct PollerNode *node)
+void Poller::prefault()
 {
-        struct PollerNode      *res = node->res;
-        struct sockaddr_storage ss;
-        struct sockaddr        *addr = reinterpret_cast<struct sockaddr *>(&ss);
-        socklen_t               addrlen;
-        void                   *result;
-        int                     sockfd;
-
-        while (1)
-        {
-                addrlen = sizeof(sockaddr_storage);
-                sockfd  = accept(node->data.fd, addr, &addrlen);
-                if (sockfd < 0)
-                {
-                        if (errno == EAGAIN || errno == EMFILE ||
-                            errno == ENFILE)
-                                return;
-                        else if (errno == ECONNABORTED)
-                                continue;
-                        else
-                                break;
-                }
+        volatile char       stack[POLLER_STACK_PREFAULT];
+        struct PollerLocal *local = this->local();
+        IOBufBlock         *block;
 
-                result = node->data.accept(addr, addrlen, sockfd,
-                                           node->data.context);
-                if (!result)
-                        break;
-
-                res->data        = node->data;
-                res->data.result = result;
-                res->error       = 0;
-                res->state       = PR_ST_SUCCESS;
-
-                this->m_callback(castPollerNodeToResult(res), this->m_context);
+        for (size_t i = 0; i < sizeof stack; i += 4096)
+                stack[i] = 0;
 
-                res       = new PollerNode{};
-                node->res = res;
-                if (!res)
+        memset(local->buf, 0, this->m_bufSize);
+        while (local->blockPool.size() < POLLER_BLOCK_POOL)
+        {
+                block = IOBuf::newBlock(IOBUF_BLOCK_SIZE);
+                if (!block)
                         break;
-                ;
 
-                if (node->removed)
-                        return;
+                memset(block->data, 0, block->size);
+                local->blockPool.push_back(block);
         }
 
-        if (this->removeNode(node))
-                return;
-
-        node->error = errno;
-        node->state = PR_ST_ERROR;
-        delete node->res;
-        this->m_callback(castPollerNodeToResult(node), this->m_context);
+        local->results.reserve(this->m_eventsMax);
+        this->m_arenas.reserve(this->m_eventsMax);
+        this->m_rings.reserve(this->m_eventsMax);
 }
 
-void Poller::handleConnect(struct PollerNode *node)
+int Poller::stop()
 {
-        socklen_t len = sizeof(int);
-        int       error;
-
-        if (getsockopt(node->data.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
-                error = errno;
+        struct PollerCommand *cmd;
+        struct PollerNode    *node;
+        struct list_head     *pos, *tmp;
+        LIST_HEAD(stopList);
 
-        if (this->removeNode(node))
-                return;
+        if (this->m_stopped)
+                return 0;
 
-        if (error == 0)
+        /* A callback on a poller thread would wait here for itself. */
+        for (const std::thread &thread : this->m_threads)
         {
-                node->error = 0;
+                if (thread.get_id() == std::this_thread::get_id())
+                {
+                        errno = EDEADLK;
+                        return -1;
+                }
+        }
+
+        cmd = this->newCommand(PC_CMD_STOP, -1, -1, nullptr);
+        this->submit(cmd, cmd);
+        for (std::thread &thread : this->m_threads)
+                thread.join();
+
+        this->m_threads.clear();
+
+        list_splice_init(&this->m_nonTimeoutList, &stopList);
+        list_splice(&this->m_timeoutList, stopList.prev);
+        INIT_LIST_HEAD(&this->m_timeoutList);
+        list_for_each_safe(pos, tmp, &stopList)
+        {
+                node = list_entry(pos, struct PollerNode, list);
+                if (node->data.fd >= 0)
+                {
+                        this->m_nodes[node->data.fd] = nullptr;
+                        this->ctl(EPOLL_CTL_DEL, node->data.fd, 0, nullptr);
+                }
+
+                node->removed = 1;
+                node->error   = 0;
+                node->state   = PR_ST_STOPPED;
+                delete node->res;
+                node->res = nullptr;
+                this->deliver(node);
+        }
+
+        /*
+         * Workers may still be sending arenas back, and callbacks issuing
+         * commands: take those too, until none come. Nodes they add are
+         * stopped rather than added (see execute()).
+         */
+        this->runParked();
+        while (1)
+        {
+                this->flushResults();
+                if (this->m_nthreads > 1)
+                {
+                        for (struct PollerResult *res : this->local()->results)
+                                Poller::runResult(
+                                        &reinterpret_cast<struct PollerNode *>(
+                                                 res)
+                                                 ->task);
+
+                        this->local()->results.clear();
+                }
+
+                while (this->m_inflight.load(std::memory_order_acquire) != 0)
+                        std::this_thread::yield();
+
+                if (!this->m_commands.load(std::memory_order_acquire))
+                        break;
+
+                this->handlePipe();
+                this->reclaimNodes();
+        }
+
+        this->handOff();
+        for (int i = 0; i < this->m_nthreads; i++)
+        {
+                struct PollerLocal *local = &this->m_locals[i];
+
+                for (IOBufBlock *block : local->blockPool)
+                        IOBuf::unref(block);
+
+                for (RingBuffer *ring : local->dropRings)
+                        delete ring;
+
+                local->blockPool.clear();
+                local->dropRings.clear();
+                munmap(local->buf, this->m_bufSize);
+                local->buf = nullptr;
+        }
+
+        while (this->m_spareRearms)
+        {
+                cmd                 = this->m_spareRearms;
+                this->m_spareRearms = cmd->next;
+                delete cmd;
+        }
+
+        this->m_trimFds.clear();
+        close(this->m_pipeRead);
+        close(this->m_pipeWrite);
+        this->m_stopped = 1;
+        return 0;
+}
+
+struct PollerCommand *Poller::newCommand(const int command, const int fd,
+                                         const int                timeout,
+                                         const struct PollerData *data)
+{
+        struct PollerCommand *cmd;
+        struct PollerNode    *node = nullptr;
+
+        if (fd >= 0 && (size_t) fd >= this->m_maxOpenFiles)
+        {
+                errno = EBADF;
+                return nullptr;
+        }
+
+        if (data)
+        {
+                node = __poller_new_node(data);
+                if (!node)
+                        return nullptr;
+        }
+
+        if (node)
+                node->serial = __poller_serial.fetch_add(
+                        1, std::memory_order_relaxed);
+
+        cmd          = new PollerCommand{};
+        cmd->command = command;
+        cmd->fd      = fd;
+        cmd->timeout = timeout;
+        cmd->node    = node;
+        return cmd;
+}
+
+int Poller::add(const struct PollerData *data, const int timeout,
+                struct PollerHandle *handle)
+{
+        struct PollerCommand *cmd;
+
+        if (!handle)
+                return this->addBatch(data, 1, timeout);
+
+        cmd = this->newCommand(PC_CMD_ADD, data->fd, timeout, data);
+        if (!cmd)
+                return -1;
+
+        /* Before submit(): the node may be gone once it returns. */
+        handle->node   = cmd->node;
+        handle->fd     = data->fd;
+        handle->serial = cmd->node->serial;
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+int Poller::addBatch(const struct PollerData *data, const int n,
+                     const int timeout)
+{
+        struct PollerCommand *first = nullptr;
+        struct PollerCommand *last  = nullptr;
+        struct PollerCommand *cmd;
+
+        /* All nodes are published with one CAS and at most one wakeup. */
+        for (int i = 0; i < n; i++)
+        {
+                cmd = this->newCommand(PC_CMD_ADD, data[i].fd, timeout,
+                                       &data[i]);
+                if (!cmd)
+                {
+                        while (first)
+                        {
+                                cmd   = first;
+                                first = first->next;
+                                delete cmd->node->res;
+                                delete cmd->node;
+                                delete cmd;
+                        }
+
+                        return -1;
+                }
+
+                if (last)
+                        last->next = cmd;
+                else
+                        first = cmd;
+
+                last = cmd;
+        }
+
+        if (first)
+                this->submit(first, last);
+
+        return 0;
+}
+
+int Poller::del(const int fd)
+{
+        struct PollerCommand *cmd = this->newCommand(PC_CMD_DEL, fd, -1,
+                                                     nullptr);
+
+        if (!cmd)
+                return -1;
+
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+int Poller::mod(const struct PollerData *data, const int timeout)
+{
+        struct PollerCommand *cmd = this->newCommand(PC_CMD_MOD, data->fd,
+                                                     timeout, data);
+
+        if (!cmd)
+                return -1;
+
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+int Poller::setTimeout(const int fd, const int timeout)
+{
+        return this->setTimeoutBatch(&fd, 1, timeout);
+}
+
+int Poller::setTimeoutBatch(const int *fds, const int n, const int timeout)
+{
+        struct PollerCommand *first = nullptr;
+        struct PollerCommand *last  = nullptr;
+        struct PollerCommand *cmd;
+
+        for (int i = 0; i < n; i++)
+        {
+                cmd = this->newCommand(PC_CMD_TIMEOUT, fds[i], timeout,
+                                       nullptr);
+                if (!cmd)
+                {
+                        while (first)
+                        {
+                                cmd   = first;
+                                first = first->next;
+                                delete cmd;
+                        }
+
+                        return -1;
+                }
+
+                if (last)
+                        last->next = cmd;
+                else
+                        first = cmd;
+
+                last = cmd;
+        }
+
+        if (first)
+                this->submit(first, last);
+
+        return 0;
+}
+
+int Poller::send(const int fd, IOBuf *buf)
+{
+        struct PollerCommand *cmd;
+
+        cmd = this->newCommand(PC_CMD_SEND, fd, -1, nullptr);
+        if (!cmd)
+                return -1;
+
+        if (this->chargeSend(fd, buf->length()) < 0)
+        {
+                delete cmd;
+                return -1;
+        }
+
+        cmd->buf = std::move(*buf);
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+int Poller::release(const struct PollerResult *res)
+{
+        const PollerMessage  *msg = res->data.message;
+        struct PollerCommand *cmd;
+
+        /* Nothing stays charged without a read budget: see finishMessage. */
+        if (!msg || msg->arena || msg->bytes == 0 ||
+            !(this->m_readBudget || this->m_pollerReadBudget))
+                return 0;
+
+        cmd = this->newCommand(PC_CMD_RELEASE, res->data.fd, -1, nullptr);
+        if (!cmd)
+                return -1;
+
+        cmd->bytes      = msg->bytes;
+        cmd->owner      = msg->node;
+        cmd->generation = msg->epoch;
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+int Poller::migrate(const int fd, Poller *to)
+{
+        struct PollerCommand *cmd = this->newCommand(PC_CMD_MIGRATE, fd, -1,
+                                                     nullptr);
+
+        if (!cmd)
+                return -1;
+
+        cmd->target = to;
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+int Poller::shed(const double share, Poller *to)
+{
+        struct PollerCommand *cmd = this->newCommand(PC_CMD_SHED, -1, -1,
+                                                     nullptr);
+
+        if (!cmd)
+                return -1;
+
+        cmd->target = to;
+        cmd->share  = share;
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+/* On a node's fd, counted for getStats(). */
+int Poller::ctl(const int op, const int fd, const int event, void *data)
+{
+        struct epoll_event ev;
+
+        ev.events   = event;
+        ev.data.ptr = data;
+        this->m_ctlCalls.fetch_add(1, std::memory_order_relaxed);
+        return epoll_ctl(this->m_pfd, op, fd, &ev);
+}
+
+void Poller::getStats(struct PollerStats *stats) const
+{
+        const std::memory_order relaxed = std::memory_order_relaxed;
+
+        stats->inboundBytes  = this->m_inboundBytes.load(relaxed);
+        stats->outboundBytes = this->m_pendingBytes.load(relaxed);
+        stats->pausedReads   = this->m_pausedReads.load(relaxed);
+        stats->readCalls     = this->m_readCalls.load(relaxed);
+        stats->readBytes     = this->m_readBytes.load(relaxed);
+        stats->waitCalls     = this->m_waitCalls.load(relaxed);
+        stats->ctlCalls      = this->m_ctlCalls.load(relaxed);
+        stats->readSize      = this->m_readSize.load(relaxed);
+        stats->waitEvents    = this->m_waitEvents.load(relaxed);
+        stats->busyTime      = this->m_busyTime.load(relaxed);
+        stats->stateTime     = this->m_stateTime.load(relaxed);
+}
+
+int Poller::setThreads(const int n)
+{
+        if (n < 1 || n > this->m_nthreads)
+        {
+                errno = EINVAL;
+                return -1;
+        }
+
+        {
+                std::lock_guard<std::mutex> lock(this->m_parkMutex);
+
+                this->m_active.store(n, std::memory_order_relaxed);
+        }
+
+        this->m_parkCond.notify_all();
+        return 0;
+}
+
+int Poller::threads() const
+{
+        return this->m_active.load(std::memory_order_relaxed);
+}
+
+int Poller::addTimer(const int timeout, void *context,
+                     struct PollerHandle *handle)
+{
+        struct PollerData data = {};
+
+        data.operation = PD_OP_TIMER;
+        data.fd        = -1;
+        data.context   = context;
+        return this->add(&data, timeout, handle);
+}
+
+int Poller::cancel(const struct PollerHandle *handle)
+{
+        const int             command = handle->fd >= 0 ? PC_CMD_DEL
+                                                        : PC_CMD_CANCEL;
+        struct PollerCommand *cmd     = this->newCommand(command, handle->fd,
+                                                         -1, nullptr);
+
+        if (!cmd)
+                return -1;
+
+        cmd->owner      = handle->node;
+        cmd->generation = handle->serial;
+        this->submit(cmd, cmd);
+        return 0;
+}
+
+size_t Poller::readSize(struct PollerNode *node) const
+{
+        if (node->readSize == 0)
+                node->readSize = this->m_readMin;
+
+        return node->readSize;
+}
+
+void Poller::countRead(const ssize_t n)
+{
+        this->m_readCalls.fetch_add(1, std::memory_order_relaxed);
+        if (n > 0)
+                this->m_readBytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+void Poller::adaptRead(struct PollerNode *node, const size_t size,
+                       const ssize_t n)
+{
+        size_t next = node->readSize;
+        int    pending;
+
+        this->countRead(n);
+        if (n <= 0)
+                return;
+
+        if ((size_t) n >= size)
+        {
+                next *= 2;
+                if (ioctl(node->data.fd, FIONREAD, &pending) == 0 &&
+                    (size_t) pending > next)
+                        next = pending;
+        } else if ((size_t) n < size / 4)
+                next /= 2;
+
+        node->readSize = std::clamp(next, this->m_readMin, this->m_readMax);
+        this->m_readSize.store(node->readSize, std::memory_order_relaxed);
+}
+
+void Poller::handleRead(struct PollerNode *node)
+{
+        char   *buf   = this->local()->buf;
+        ssize_t nLeft = 0;
+        size_t  size  = 0;
+        size_t  n;
+        char   *p;
+
+        while (1)
+        {
+                p = buf;
+                if (!node->data.ssl)
+                {
+                        size  = this->readSize(node);
+                        nLeft = read(node->data.fd, p, size);
+                        this->adaptRead(node, size, nLeft);
+                        if (nLeft < 0)
+                        {
+                                if (errno == EAGAIN)
+                                        return;
+                        }
+                } else
+                {
+                        // TODO: SSL_READ
+                }
+
+                if (nLeft <= 0)
+                        break;
+
+                do
+                {
+                        n = nLeft;
+                        if (this->appendMessage(p, &n, node) >= 0)
+                        {
+                                nLeft -= n;
+                                p += n;
+                        } else
+                                nLeft = -1;
+                } while (nLeft > 0);
+
+                if (nLeft < 0)
+                        break;
+
+                if (node->removed)
+                        return;
+
+                if (this->checkBudget(node) != 0)
+                        return;
+
+                /*
+                 * A short read drained the socket. Level-triggered epoll
+                 * reports what comes next, so skip the read for EAGAIN.
+                 */
+                if ((size_t) (p - buf) < size &&
+                    !(node->event & EPOLLET))
+                        return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        if (nLeft == 0)
+        {
+                node->error = 0;
                 node->state = PR_ST_FINISHED;
         } else
         {
-                node->error = error;
-                node->state = PR_ST_ERROR;
+                node->error = errno;
+                node->state = PR_ST_ERROR;
+        }
+
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleReadBuf(struct PollerNode *node)
+{
+        IOBufBlock *block;
+        ssize_t     nLeft;
+        size_t      size;
+        bool        drained;
+        IOBuf       chunk;
+
+        while (1)
+        {
+                block = node->readBlock;
+                if (!block || block->used == block->size)
+                {
+                        if (block)
+                                this->putReadBlock(block);
+
+                        block = this->getReadBlock(this->readSize(node));
+                        node->readBlock = block;
+                        if (!block)
+                        {
+                                nLeft = -1;
+                                break;
+                        }
+                }
+
+                /* Read straight into the shared block; messages slice it. */
+                size  = block->size - block->used;
+                nLeft = read(node->data.fd, block->data + block->used, size);
+                this->adaptRead(node, size, nLeft);
+                if (nLeft < 0 && errno == EAGAIN)
+                        return;
+
+                if (nLeft <= 0)
+                        break;
+
+                drained = (size_t) nLeft < size && !(node->event & EPOLLET);
+                chunk.append(block, block->used, nLeft);
+                block->used += nLeft;
+                while (!chunk.empty())
+                {
+                        if (this->appendBufMessage(&chunk, node) < 0)
+                        {
+                                nLeft = -1;
+                                break;
+                        }
+                }
+
+                if (nLeft < 0)
+                        break;
+
+                if (node->removed)
+                        return;
+
+                if (this->checkBudget(node) != 0)
+                        return;
+
+                if (drained)
+                        return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        if (nLeft == 0)
+        {
+                node->error = 0;
+                node->state = PR_ST_FINISHED;
+        } else
+        {
+                node->error = errno;
+                node->state = PR_ST_ERROR;
+        }
+
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleReadRing(struct PollerNode *node)
+{
+        RingBuffer    *ring = node->ring;
+        PollerMessage *msg;
+        ssize_t        nLeft;
+        size_t         size;
+        size_t         n;
+        bool           drained;
+        int            ret;
+
+        if (!ring)
+        {
+                ring = RingBuffer::create(this->m_ringSize);
+                if (!ring)
+                {
+                        nLeft = -1;
+                        goto fail;
+                }
+
+                node->ring = ring;
+        }
+
+        while (1)
+        {
+                /* Full with one message in it: it can never complete. */
+                size = ring->writable();
+                if (size == 0)
+                {
+                        errno = EMSGSIZE;
+                        nLeft = -1;
+                        break;
+                }
+
+                /* The ring, not readSize, decides how much to read. */
+                nLeft = read(node->data.fd, ring->writePtr(), size);
+                this->countRead(nLeft);
+                if (nLeft < 0 && errno == EAGAIN)
+                        return;
+
+                if (nLeft <= 0)
+                        break;
+
+                drained = (size_t) nLeft < size && !(node->event & EPOLLET);
+                ring->produce(nLeft);
+                while (ring->readable() > 0)
+                {
+                        msg = this->nodeMessage(node);
+                        if (!msg)
+                        {
+                                nLeft = -1;
+                                break;
+                        }
+
+                        n   = ring->readable();
+                        ret = msg->append(ring->readPtr(), &n, msg);
+                        if (ret < 0)
+                        {
+                                nLeft = -1;
+                                break;
+                        }
+
+                        ring->consume(n);
+                        this->chargeMessage(node, msg, n);
+                        if (ret == 0)
+                                break;
+
+                        this->finishMessage(node);
+                }
+
+                if (nLeft < 0)
+                        break;
+
+                if (node->removed)
+                        return;
+
+                if (this->checkBudget(node) != 0)
+                        return;
+
+                if (drained)
+                        return;
+        }
+
+fail:
+        if (this->removeNode(node))
+                return;
+
+        if (nLeft == 0)
+        {
+                node->error = 0;
+                node->state = PR_ST_FINISHED;
+        } else
+        {
+                node->error = errno;
+                node->state = PR_ST_ERROR;
+        }
+
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleWrite(struct PollerNode *node)
+{
+        struct iovec *iov   = node->data.writeIov;
+        size_t        count = 0;
+        ssize_t       nLeft = 0;
+        int           iovcnt;
+        int           ret = 0;
+
+        while (node->data.iovcnt > 0)
+        {
+                if (!node->data.ssl)
+                {
+                        iovcnt = node->data.iovcnt;
+                        if (iovcnt > IOV_MAX)
+                                iovcnt = IOV_MAX;
+
+                        nLeft = writev(node->data.fd, iov, iovcnt);
+                        if (nLeft < 0)
+                        {
+                                ret = errno == EAGAIN ? 0 : -1;
+                                break;
+                        }
+                } else if (iov->iov_len > 0)
+                {
+                        // TODO SSL Write
+                } else
+                        nLeft = 0;
+
+                count += nLeft;
+                do
+                {
+                        if (nLeft >= iov->iov_len)
+                        {
+                                nLeft -= iov->iov_len;
+                                iov->iov_base =
+                                        static_cast<char *>(iov->iov_base) +
+                                        iov->iov_len;
+                                iov->iov_len = 0;
+                                iov++;
+                                node->data.iovcnt--;
+                        } else
+                        {
+                                iov->iov_base =
+                                        static_cast<char *>(iov->iov_base) +
+                                        nLeft;
+                                iov->iov_len -= nLeft;
+                                break;
+                        }
+                } while (node->data.iovcnt > 0);
+        }
+
+        node->data.writeIov = iov;
+        if (node->data.iovcnt > 0 && ret >= 0)
+        {
+                if (count == 0)
+                        return;
+
+                if (node->data.partialWritten(count, node->data.context) >= 0)
+                        return;
+        }
+
+        if (node->data.iovcnt == 0 && (node->data.flags & PD_FL_PERSISTENT))
+        {
+                this->idleNode(node, PR_ST_FINISHED, 0);
+                return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        if (node->data.iovcnt == 0)
+        {
+                node->error = 0;
+                node->state = PR_ST_FINISHED;
+        } else
+        {
+                node->error = errno;
+                node->state = PR_ST_ERROR;
+        }
+
+        this->deliver(node);
+}
+
+void Poller::handleWriteBuf(struct PollerNode *node)
+{
+        struct iovec iov[IOV_MAX];
+        IOBuf       *buf   = node->data.writeBuf;
+        size_t       count = 0;
+        ssize_t      n;
+        int          iovcnt;
+        int          ret = 0;
+
+        while (!buf->empty())
+        {
+                iovcnt = buf->peekIovec(iov, IOV_MAX);
+                n      = writev(node->data.fd, iov, iovcnt);
+                if (n < 0)
+                {
+                        ret = errno == EAGAIN ? 0 : -1;
+                        break;
+                }
+
+                buf->popFront(n);
+                count += n;
+        }
+
+        if (!buf->empty() && ret >= 0)
+        {
+                if (count == 0)
+                        return;
+
+                if (node->data.partialWritten(count, node->data.context) >= 0)
+                        return;
+        }
+
+        if (buf->empty() && (node->data.flags & PD_FL_PERSISTENT))
+        {
+                this->idleNode(node, PR_ST_FINISHED, 0);
+                return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        if (buf->empty())
+        {
+                node->error = 0;
+                node->state = PR_ST_FINISHED;
+        } else
+        {
+                node->error = errno;
+                node->state = PR_ST_ERROR;
+        }
+
+        this->deliver(node);
+}
+
+void Poller::handleListen(struct PollerNode *node)
+{
+        struct PollerNode      *res = node->res;
+        struct sockaddr_storage ss;
+        struct sockaddr        *addr = reinterpret_cast<struct sockaddr *>(&ss);
+        socklen_t               addrlen;
+        void                   *result;
+        int                     sockfd;
+
+        while (1)
+        {
+                addrlen = sizeof(sockaddr_storage);
+                sockfd  = accept(node->data.fd, addr, &addrlen);
+                if (sockfd < 0)
+                {
+                        if (errno == EAGAIN || errno == EMFILE ||
+                            errno == ENFILE)
+                                return;
+                        else if (errno == ECONNABORTED)
+                                continue;
+                        else
+                                break;
+                }
+
+                result = node->data.accept(addr, addrlen, sockfd,
+                                           node->data.context);
+                if (!result)
+                        break;
+
+                res->data        = node->data;
+                res->data.result = result;
+                res->error       = 0;
+                res->state       = PR_ST_SUCCESS;
+
+                this->deliver(res);
+
+                res       = new PollerNode{};
+                node->res = res;
+
+                if (node->removed)
+                        return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        node->error = errno;
+        node->state = PR_ST_ERROR;
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleConnect(struct PollerNode *node)
+{
+        socklen_t len = sizeof(int);
+        int       error;
+
+        if (getsockopt(node->data.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+                error = errno;
+
+        if (error == 0 && (node->data.flags & PD_FL_PERSISTENT))
+        {
+                this->idleNode(node, PR_ST_FINISHED, 0);
+                return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        if (error == 0)
+        {
+                node->error = 0;
+                node->state = PR_ST_FINISHED;
+        } else
+        {
+                node->error = error;
+                node->state = PR_ST_ERROR;
+        }
+
+        this->deliver(node);
+}
+
+void Poller::handleRecvFrom(struct PollerNode *node)
+{
+        char                   *buf = this->local()->buf;
+        struct PollerNode      *res = node->res;
+        struct sockaddr_storage ss;
+        struct sockaddr        *addr = reinterpret_cast<struct sockaddr *>(&ss);
+        socklen_t               addrlen;
+        void                   *result;
+        ssize_t                 n;
+
+        while (1)
+        {
+                addrlen = sizeof(struct sockaddr_storage);
+                n = recvfrom(node->data.fd, buf, this->m_bufSize, 0, addr,
+                             &addrlen);
+
+                if (n < 0)
+                {
+                        if (errno == EAGAIN)
+                                return;
+                        else
+                                break;
+                }
+                result = node->data.recvfrom(addr, addrlen, buf, n,
+                                             node->data.context);
+
+                if (!result)
+                        break;
+
+                res->data        = node->data;
+                res->data.result = result;
+                res->error       = 0;
+                res->state       = PR_ST_SUCCESS;
+                this->deliver(res);
+
+                res       = new PollerNode{};
+                node->res = res;
+
+                if (node->removed)
+                        return;
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        node->error = errno;
+        node->state = PR_ST_ERROR;
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleEvent(struct PollerNode *node)
+{
+        struct PollerNode *res = node->res;
+        unsigned long long cnt = 0;
+        unsigned long long value;
+        void              *result;
+        ssize_t            n;
+
+        while (1)
+        {
+                n = read(node->data.fd, &value, sizeof(unsigned long long));
+                if (n == sizeof(unsigned long long))
+                        cnt += value;
+                else
+                {
+                        if (n >= 0)
+                                errno = EINVAL;
+                        break;
+                }
+        }
+
+        if (errno == EAGAIN)
+        {
+                while (1)
+                {
+                        if (cnt == 0)
+                                return;
+
+                        cnt--;
+                        result = node->data.event(node->data.context);
+                        if (!result)
+                                break;
+
+                        if (!(node->data.flags & PD_FL_QUIET))
+                        {
+                                res->data        = node->data;
+                                res->data.result = result;
+                                res->error       = 0;
+                                res->state       = PR_ST_SUCCESS;
+                                this->deliver(res);
+
+                                res       = new PollerNode{};
+                                node->res = res;
+                        }
+
+                        if (node->removed)
+                                return;
+                }
+        }
+
+        if (cnt != 0)
+                write(node->data.fd, &cnt, sizeof(unsigned long long));
+
+        if (this->removeNode(node))
+                return;
+
+        node->error = errno;
+        node->state = PR_ST_ERROR;
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleNotify(struct PollerNode *node)
+{
+        struct PollerNode *res = node->res;
+        void              *result;
+        ssize_t            n;
+
+        while (1)
+        {
+                n = read(node->data.fd, &result, sizeof(void *));
+                if (n == sizeof(void *))
+                {
+                        result = node->data.notify(result, node->data.context);
+                        if (!result)
+                                break;
+
+                        res->data        = node->data;
+                        res->data.result = result;
+                        res->error       = 0;
+                        res->state       = PR_ST_SUCCESS;
+                        this->deliver(res);
+
+                        res       = new PollerNode{};
+                        node->res = res;
+
+                        if (node->removed)
+                                return;
+                } else if (n < 0 && errno == EAGAIN)
+                        return;
+                else
+                {
+                        if (n > 0)
+                                errno = EINVAL;
+                        break;
+                }
+        }
+
+        if (this->removeNode(node))
+                return;
+
+        if (n == 0)
+        {
+                node->error = 0;
+                node->state = PR_ST_FINISHED;
+        } else
+        {
+                node->error = errno;
+                node->state = PR_ST_ERROR;
+        }
+
+        delete node->res;
+        this->deliver(node);
+}
+
+void Poller::handleIdle(struct PollerNode *node)
+{
+        socklen_t len = sizeof(int);
+        int       error;
+
+        /* Only hangups and errors are reported for an idle node. */
+        if (getsockopt(node->data.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0)
+                error = errno;
+
+        if (this->removeNode(node))
+                return;
+
+        node->error = error ? error : ECONNRESET;
+        node->state = PR_ST_ERROR;
+        this->deliver(node);
+}
+
+int Poller::handlePipe()
+{
+        struct PollerCommand *cmd;
+        struct PollerCommand *next;
+        struct PollerCommand *prev = nullptr;
+        char                  buf[256];
+        int                   stop = 0;
+
+        /* Drain wakeups before taking the stack, so no command is missed. */
+        while (read(this->m_pipeRead, buf, sizeof buf) > 0)
+                ;
+
+        cmd = this->m_commands.exchange(nullptr, std::memory_order_acquire);
+        while (cmd)
+        {
+                next      = cmd->next;
+                cmd->next = prev;
+                prev      = cmd;
+                cmd       = next;
+        }
+
+        for (cmd = prev; cmd; cmd = next)
+        {
+                next = cmd->next;
+                if (this->parkCommand(cmd))
+                        continue;
+
+                stop |= this->execute(cmd);
+                if (cmd->command == PC_CMD_REARM)
+                {
+                        cmd->next           = this->m_spareRearms;
+                        this->m_spareRearms = cmd;
+                } else
+                        delete cmd;
+        }
+
+        return stop;
+}
+
+void Poller::submit(struct PollerCommand *first, struct PollerCommand *last)
+{
+        struct PollerCommand *head;
+        struct PollerCommand *next;
+
+        if (this->m_threadId.load(std::memory_order_relaxed) ==
+            std::this_thread::get_id())
+        {
+                struct PollerLocal *local = this->local();
+
+                /* Issued by a callback: apply at once, the node may be hot. */
+                last->next = nullptr;
+                for (; first; first = next)
+                {
+                        next = first->next;
+
+                        /* Not a switch under its own handler, though. */
+                        if (first->fd >= 0 && first->fd == local->hotFd &&
+                            (first->command == PC_CMD_MOD ||
+                             !local->deferred.empty()))
+                        {
+                                local->deferred.push_back(first);
+                                continue;
+                        }
+
+                        if (this->parkCommand(first))
+                                continue;
+
+                        this->execute(first);
+                        delete first;
+                }
+
+                return;
+        }
+
+        /* The stack is applied bottom up: push a batch reversed. */
+        if (first != last)
+        {
+                last->next = nullptr;
+                head       = nullptr;
+                for (struct PollerCommand *cmd = first; cmd; cmd = next)
+                {
+                        next      = cmd->next;
+                        cmd->next = head;
+                        head      = cmd;
+                }
+
+                std::swap(first, last);
+        }
+
+        head = this->m_commands.load(std::memory_order_relaxed);
+        do
+                last->next = head;
+        while (!this->m_commands.compare_exchange_weak(
+                head, first, std::memory_order_release,
+                std::memory_order_relaxed));
+
+        if (!head)
+                write(this->m_pipeWrite, &head, 1);
+}
+
+int Poller::execute(struct PollerCommand *cmd)
+{
+        struct PollerNode *node = nullptr;
+
+        if (cmd->fd >= 0 && (size_t) cmd->fd < this->m_maxOpenFiles)
+                node = this->m_nodes[cmd->fd];
+
+        /*
+         * Batches are ranked from the first classed node on. A re-arm's
+         * node may be gone: it is only compared.
+         */
+        if (cmd->node && cmd->command != PC_CMD_REARM &&
+            (cmd->node->data.flags & (PD_FL_HIGH | PD_FL_BULK)))
+                this->m_classed = 1;
+
+        /* The fd moved on: so does whatever still comes here for it. */
+        if (!node && cmd->fd >= 0 && !this->m_moved.empty() &&
+            cmd->command != PC_CMD_ADD && cmd->command != PC_CMD_ADOPT &&
+            cmd->command != PC_CMD_REARM)
+        {
+                auto it = this->m_moved.find(cmd->fd);
+
+                if (it != this->m_moved.end())
+                {
+                        this->forward(cmd, it->second);
+                        return 0;
+                }
+        }
+
+        /* The loop is over: a node that comes now is stopped, not added. */
+        if (this->m_leaving &&
+            (cmd->command == PC_CMD_ADD || cmd->command == PC_CMD_MOD))
+        {
+                this->retireNode(cmd->node, PR_ST_STOPPED, 0);
+                return 0;
+        }
+
+        switch (cmd->command)
+        {
+                case PC_CMD_ADD:
+                        if (!this->m_moved.empty())
+                                this->m_moved.erase(cmd->fd);
+
+                        if (node)
+                        {
+                                this->retireNode(cmd->node, PR_ST_ERROR,
+                                                 EEXIST);
+                                break;
+                        }
+
+                        this->insertNode(cmd->node, cmd->timeout,
+                                         EPOLL_CTL_ADD);
+                        break;
+
+                case PC_CMD_DEL:
+                        /* From cancel(): that operation may be over. */
+                        if (node && cmd->owner &&
+                            (node != cmd->owner ||
+                             node->serial != cmd->generation))
+                                node = nullptr;
+
+                        if (!node)
+                                break;
+
+                        list_del(&node->list);
+                        this->m_nodes[node->data.fd] = nullptr;
+                        this->ctl(EPOLL_CTL_DEL, node->data.fd, 0, nullptr);
+                        this->retireNode(node, PR_ST_DELETED, 0);
+                        break;
+
+                case PC_CMD_MOD:
+                        if (!node)
+                        {
+                                this->retireNode(cmd->node, PR_ST_ERROR,
+                                                 ENOENT);
+                                break;
+                        }
+
+                        if (node->data.flags & cmd->node->data.flags &
+                            PD_FL_PERSISTENT)
+                        {
+                                this->switchNode(node, cmd->node,
+                                                 cmd->timeout);
+                                break;
+                        }
+
+                        list_del(&node->list);
+                        this->m_nodes[node->data.fd] = nullptr;
+                        this->retireNode(node, PR_ST_MODIFIED, 0);
+                        this->insertNode(cmd->node, cmd->timeout,
+                                         EPOLL_CTL_MOD);
+                        break;
+
+                case PC_CMD_TIMEOUT:
+                        if (!node)
+                                break;
+
+                        list_del(&node->list);
+                        if (cmd->timeout >= 0)
+                        {
+                                __poller_set_deadline(cmd->timeout,
+                                                      &node->deadline);
+                                __poller_insert_timeout(node,
+                                                        &this->m_timeoutList);
+                        } else
+                        {
+                                node->deadline = 0;
+                                list_add_tail(&node->list,
+                                              &this->m_nonTimeoutList);
+                        }
+                        break;
+
+                case PC_CMD_SEND:
+                        /* Bytes for an fd that is gone are dropped. */
+                        if (node)
+                                this->queueNode(node, &cmd->buf);
+                        else
+                        {
+                                this->dropPending(cmd->fd,
+                                                  cmd->buf.length());
+                                this->checkWatermark();
+                        }
+                        break;
+
+                case PC_CMD_RELEASE:
+                        /* The fd may have another node since. */
+                        if (node != cmd->owner ||
+                            this->m_epochs[cmd->fd] != cmd->generation)
+                                node = nullptr;
+
+                        this->uncharge(node, cmd->bytes);
+                        break;
+
+                case PC_CMD_ARENA:
+                        cmd->arena->release();
+                        break;
+
+                case PC_CMD_REARM:
+                        /* Unless the node was replaced while it was held. */
+                        if (node != cmd->node ||
+                            this->m_generations[cmd->fd] != cmd->generation)
+                                break;
+
+                        node->held = 0;
+                        if (this->ctl(EPOLL_CTL_MOD, node->data.fd,
+                                      node->event | this->m_oneshot,
+                                      this->eventData(node)) < 0)
+                        {
+                                this->removeNode(node);
+                                this->retireNode(node, PR_ST_ERROR, errno);
+                        }
+                        break;
+
+                case PC_CMD_MIGRATE:
+                        if (node && cmd->target != this)
+                                this->detachNode(node, cmd->target);
+                        break;
+
+                case PC_CMD_ADOPT:
+                        this->m_moved.erase(cmd->fd);
+                        this->adoptNode(cmd->node, cmd->timeout,
+                                        cmd->generation);
+                        break;
+
+                case PC_CMD_SHED:
+                        if (cmd->target != this)
+                                this->shedNodes(cmd->share, cmd->target);
+                        break;
+
+                case PC_CMD_CANCEL:
+                        this->cancelTimer(cmd);
+                        break;
+
+                case PC_CMD_STOP:
+                        return 1;
+
+                default:
+                        break;
+        }
+
+        return 0;
+}
+
+void Poller::insertNode(struct PollerNode *node, const int timeout,
+                        const int op)
+{
+        const int fd = node->data.fd;
+        int       ret;
+
+        node->removed = 0;
+        node->event   = __poller_node_event(node);
+        if (fd >= 0)
+        {
+                if ((size_t) fd >= this->m_maxOpenFiles)
+                {
+                        this->retireNode(node, PR_ST_ERROR, EBADF);
+                        return;
+                }
+
+                /* Before the events are tagged with it. */
+                if (this->m_oneshot)
+                        this->m_generations[fd]++;
+
+                ret = this->ctl(op, fd, node->event | this->m_oneshot,
+                                this->eventData(node));
+
+                if (ret < 0)
+                {
+                        if (op == EPOLL_CTL_MOD)
+                                this->ctl(EPOLL_CTL_DEL, fd, 0, nullptr);
+
+                        this->retireNode(node, PR_ST_ERROR, errno);
+                        return;
+                }
+
+                this->m_nodes[fd] = node;
+                this->m_epochs[fd]++;
+        }
+
+        if (timeout >= 0)
+        {
+                __poller_set_deadline(timeout, &node->deadline);
+                __poller_insert_timeout(node, &this->m_timeoutList);
+        } else
+        {
+                node->deadline = 0; /* untimed, as migration tells */
+                list_add_tail(&node->list, &this->m_nonTimeoutList);
+        }
+}
+
+void Poller::switchNode(struct PollerNode *node, struct PollerNode *newNode,
+                        const int timeout)
+{
+        struct PollerNode *res = node->res;
+        size_t             bytes;
+
+        if (node->data.operation == PD_OP_READ && node->data.message)
+        {
+                /* Hand the unfinished message back, as a replaced node would. */
+                bytes = node->data.message->bytes;
+                node->inbound -= std::min(bytes, node->inbound);
+                this->m_inboundBytes -= bytes;
+                res->data = node->data;
+                this->retireNode(res, PR_ST_MODIFIED, 0);
+        } else
+                delete res;
+
+        /* The read buffer is a block or a ring, depending on the flags. */
+        if ((node->data.flags ^ newNode->data.flags) &
+            (PD_FL_IOBUF | PD_FL_RING))
+                this->dropReadBuffer(node);
+
+        node->data = newNode->data;
+        node->res  = newNode->res;
+        delete newNode;
+
+        list_del(&node->list);
+        if (timeout >= 0)
+        {
+                __poller_set_deadline(timeout, &node->deadline);
+                __poller_insert_timeout(node, &this->m_timeoutList);
+        } else
+        {
+                node->deadline = 0;
+                list_add_tail(&node->list, &this->m_nonTimeoutList);
+        }
+
+        if (__poller_node_event(node) != node->event)
+        {
+                if (this->updateEvent(node) < 0)
+                {
+                        this->removeNode(node);
+                        this->retireNode(node, PR_ST_ERROR, errno);
+                }
+        } else if ((node->event & EPOLLET) && !node->held)
+        {
+                /* The edge may already be gone, so try the operation now. */
+                this->wakeNode(node);
+        }
+}
+
+void Poller::idleNode(struct PollerNode *node, const int state,
+                      const int error)
+{
+        struct PollerNode *res = node->res;
+
+        if (!res)
+                res = new PollerNode{};
+
+        res->data  = node->data;
+        res->error = error;
+        res->state = state;
+
+        node->res            = nullptr;
+        node->data.operation = PD_OP_IDLE;
+        this->updateEvent(node);
+        this->deliver(res);
+
+        /* Sends queued behind the write operation go out now. */
+        if (node->queue && !node->queue->buf.empty() && !node->removed)
+                this->flushQueue(node);
+}
+
+int Poller::updateEvent(struct PollerNode *node)
+{
+        const int event = __poller_node_event(node);
+
+        /* A held node is disarmed: its re-arm picks the change up. */
+        if (event != node->event && !node->held)
+        {
+                if (this->ctl(EPOLL_CTL_MOD, node->data.fd,
+                              event | this->m_oneshot,
+                              this->eventData(node)) < 0)
+                        return -1;
+        }
+
+        node->event = event;
+
+        return 0;
+}
+
+void Poller::queueNode(struct PollerNode *node, IOBuf *buf)
+{
+        struct PollerQueue *queue = node->queue;
+
+        if (!queue)
+        {
+                queue       = new PollerQueue();
+                queue->node = node;
+                node->queue = queue;
+        }
+
+        queue->buf.append(std::move(*buf));
+        queue->messages++;
+        this->touchNode(node);
+
+        if (this->m_highWatermark && !queue->blocked &&
+            queue->buf.length() >= this->m_highWatermark)
+        {
+                queue->blocked = 1;
+                this->notifyQueue(node, PR_ST_BLOCKED);
+        }
+
+        this->checkWatermark();
+
+        /* Already waiting for EPOLLOUT: ride along with the next writev. */
+        if (queue->waiting || node->data.operation == PD_OP_WRITE)
+                return;
+
+        if ((this->m_corkBytes && queue->buf.length() >= this->m_corkBytes) ||
+            (this->m_corkMessages && queue->messages >= this->m_corkMessages))
+        {
+                this->flushQueue(node);
+                return;
+        }
+
+        if (!queue->corked)
+        {
+                list_add_tail(&queue->list, &this->m_flushList);
+                queue->corked = 1;
+        }
+}
+
+int Poller::flushQueue(struct PollerNode *node)
+{
+        struct PollerQueue *queue = node->queue;
+        struct iovec        iov[IOV_MAX];
+        ssize_t             n;
+        int                 error;
+
+        if (queue->corked)
+        {
+                StateLock lock(this);
+
+                list_del(&queue->list);
+                queue->corked = 0;
+        }
+
+        while (!queue->buf.empty())
+        {
+                n = writev(node->data.fd, iov,
+                           queue->buf.peekIovec(iov, IOV_MAX));
+                if (n < 0)
+                {
+                        if (errno == EAGAIN)
+                                break;
+
+                        error = errno;
+                        if (this->removeNode(node))
+                                return -1;
+
+                        node->error = error;
+                        node->state = PR_ST_ERROR;
+                        delete node->res;
+                        node->res = nullptr;
+                        this->deliver(node);
+                        return -1;
+                }
+
+                queue->buf.popFront(n);
+                this->dropPending(node->data.fd, n);
+        }
+
+        if (queue->buf.empty())
+                queue->messages = 0;
+
+        if (queue->blocked && queue->buf.length() <= this->m_lowWatermark)
+        {
+                queue->blocked = 0;
+                this->notifyQueue(node, PR_ST_RESUMED);
+        }
+
+        this->checkWatermark();
+
+        queue->waiting = !queue->buf.empty();
+        this->updateEvent(node);
+        return 0;
+}
+
+void Poller::notifyQueue(const struct PollerNode *node, const int state)
+{
+        struct PollerNode *res = new PollerNode();
+
+        res->data        = node->data;
+        res->data.result = nullptr;
+        res->state       = state;
+        this->deliver(res);
+}
+
+void Poller::checkWatermark()
+{
+        const bool blocked = this->m_writeBlocked.load(std::memory_order_relaxed);
+
+        if (!this->m_pollerHighWatermark)
+                return;
+
+        if (!blocked && this->m_pendingBytes >= this->m_pollerHighWatermark)
+                this->m_writeBlocked.store(true, std::memory_order_relaxed);
+        else if (blocked && this->m_pendingBytes <= this->m_pollerLowWatermark)
+                this->m_writeBlocked.store(false, std::memory_order_relaxed);
+}
+
+/*
+ * Called by send(), on any thread: takes n bytes while fd, then the poller,
+ * are under their high watermarks. -1 with errno EAGAIN otherwise.
+ */
+int Poller::chargeSend(const int fd, const size_t n)
+{
+        std::atomic<size_t> *fdPending = nullptr;
+        size_t               pending;
+
+        if (this->m_fdPending && fd >= 0)
+        {
+                fdPending = &this->m_fdPending[fd];
+                pending   = fdPending->load(std::memory_order_relaxed);
+                do
+                {
+                        if (pending >= this->m_highWatermark)
+                        {
+                                errno = EAGAIN;
+                                return -1;
+                        }
+                } while (!fdPending->compare_exchange_weak(
+                        pending, pending + n, std::memory_order_relaxed));
+        }
+
+        pending = this->m_pendingBytes.load(std::memory_order_relaxed);
+        do
+        {
+                if (this->m_pollerHighWatermark &&
+                    (this->m_writeBlocked.load(std::memory_order_relaxed) ||
+                     pending >= this->m_pollerHighWatermark))
+                {
+                        if (fdPending)
+                                fdPending->fetch_sub(n,
+                                                     std::memory_order_relaxed);
+
+                        errno = EAGAIN;
+                        return -1;
+                }
+        } while (!this->m_pendingBytes.compare_exchange_weak(
+                pending, pending + n, std::memory_order_relaxed));
+
+        return 0;
+}
+
+/* Bytes of fd queued here from elsewhere: charged whatever the limits. */
+void Poller::addPending(const int fd, const size_t n)
+{
+        this->m_pendingBytes.fetch_add(n, std::memory_order_relaxed);
+        if (this->m_fdPending && fd >= 0)
+                this->m_fdPending[fd].fetch_add(n, std::memory_order_relaxed);
+}
+
+void Poller::dropPending(const int fd, const size_t n)
+{
+        this->m_pendingBytes.fetch_sub(n, std::memory_order_relaxed);
+        if (this->m_fdPending && fd >= 0)
+                this->m_fdPending[fd].fetch_sub(n, std::memory_order_relaxed);
+}
+
+void Poller::chargeMessage(struct PollerNode *node, PollerMessage *msg,
+                           const size_t n)
+{
+        msg->bytes    += n;
+        node->inbound += n;
+        this->m_inboundBytes += n;
+}
+
+int Poller::checkBudget(struct PollerNode *node)
+{
+        const PollerMessage *msg = node->data.message;
+
+        if (this->m_readBudget && node->inbound >= this->m_readBudget)
+        {
+                /* Nothing to wait for: this message alone is too big. */
+                if (msg && msg->bytes >= this->m_readBudget)
+                {
+                        if (this->removeNode(node))
+                                return -1;
+
+                        node->error = EMSGSIZE;
+                        node->state = PR_ST_ERROR;
+                        delete node->res;
+                        this->deliver(node);
+                        return -1;
+                }
+        } else if (!this->m_pollerReadBudget ||
+                   this->m_inboundBytes < this->m_pollerReadBudget ||
+                   this->m_retainedBytes == 0)
+                return 0;
+
+        /* Over the poller budget only pauses if releases can follow. */
+        StateLock lock(this);
+
+        node->paused = 1;
+        this->updateEvent(node);
+        this->m_pausedNodes.push_back(node);
+        this->m_pausedReads++;
+        return 1;
+}
+
+void Poller::uncharge(struct PollerNode *node, size_t n)
+{
+        /* Null once the node that read the message is gone. */
+        if (node)
+                node->inbound -= std::min(n, node->inbound);
+
+        n = std::min(n, this->m_retainedBytes.load());
+        this->m_retainedBytes -= n;
+        this->m_inboundBytes -= n;
+        if (!this->m_pausedNodes.empty())
+                this->resumeNodes();
+}
+
+void Poller::resumeNodes()
+{
+        PollerNodePtrList paused;
+
+        paused.swap(this->m_pausedNodes);
+        for (struct PollerNode *node : paused)
+        {
+                if (node->busy || node->removed ||
+                    (this->m_readBudget &&
+                     node->inbound >= this->m_readBudget) ||
+                    (this->m_pollerReadBudget &&
+                     this->m_inboundBytes >= this->m_pollerReadBudget &&
+                     this->m_retainedBytes != 0))
+                {
+                        this->m_pausedNodes.push_back(node);
+                        continue;
+                }
+
+                node->paused = 0;
+                this->m_pausedReads--;
+                this->updateEvent(node);
+
+                /* An edge may have been consumed while paused. */
+                if (node->data.operation == PD_OP_READ && !node->held)
+                        this->wakeNode(node);
         }
+}
+
+void Poller::touchNode(struct PollerNode *node)
+{
+        if (!this->m_idleTrim || node->active)
+                return;
+
+        StateLock lock(this);
 
-        this->m_callback(castPollerNodeToResult(node), this->m_context);
+        node->active = 1;
+        if (!node->trimQueued)
+        {
+                if (this->m_trimFds.empty())
+                        this->m_nextTrim =
+                                __poller_now() + this->m_idleTrim * 1000000LL;
+
+                node->trimQueued = 1;
+                this->m_trimFds.push_back(node->data.fd);
+        }
 }
 
-void Poller::handleRecvFrom(struct PollerNode *node)
+/*
+ * Second chance: a node seen active since the last pass is kept for one
+ * more period, one that was not is trimmed and leaves the candidates.
+ */
+void Poller::trimNodes(const int64_t now)
 {
-        struct PollerNode      *res = node->res;
-        struct sockaddr_storage ss;
-        struct sockaddr        *addr = reinterpret_cast<struct sockaddr *>(&ss);
-        socklen_t               addrlen;
-        void                   *result;
-        ssize_t                 n;
+        struct PollerNode *node;
+        size_t             kept = 0;
 
-        while (1)
+        if (this->m_trimFds.empty() || now < this->m_nextTrim)
+                return;
+
+        for (int fd : this->m_trimFds)
         {
-                addrlen = sizeof(struct sockaddr_storage);
-                n = recvfrom(node->data.fd, this->m_buf, POLLER_BUFSIZE, 0,
-                             addr, &addrlen);
+                node = this->m_nodes[fd];
+                if (!node || !node->trimQueued)
+                        continue;
 
-                if (n < 0)
+                /* Its handler runs: in use, and its flags are not ours. */
+                if (node->busy)
                 {
-                        if (errno == EAGAIN)
-                                return;
-                        else
-                                break;
+                        this->m_trimFds[kept++] = fd;
+                        continue;
                 }
-                result = node->data.recvfrom(addr, addrlen, this->m_buf, n,
-                                             node->data.context);
 
-                if (!result)
-                        break;
+                if (node->active)
+                {
+                        node->active            = 0;
+                        this->m_trimFds[kept++] = fd;
+                        continue;
+                }
 
-                res->data        = node->data;
-                res->data.result = result;
-                res->error       = 0;
-                res->state       = PR_ST_SUCCESS;
-                this->m_callback(castPollerNodeToResult(res), this->m_context);
+                node->trimQueued = 0;
+                this->trimNode(node);
+        }
 
-                res       = new PollerNode{};
-                node->res = res;
-                if (!res)
-                        break;
+        this->m_trimFds.resize(kept);
+        this->m_nextTrim = now + this->m_idleTrim * 1000000LL;
+}
 
-                if (node->removed)
-                        return;
+void Poller::trimNode(struct PollerNode *node)
+{
+        struct PollerQueue *queue = node->queue;
+
+        if (!(node->data.flags & PD_FL_RING) ||
+            (node->ring && node->ring->empty()))
+                this->dropReadBuffer(node);
+
+        if (queue && queue->buf.empty() && !queue->corked && !queue->waiting)
+        {
+                delete queue;
+                node->queue = nullptr;
         }
 
-        if (this->removeNode(node))
-                return;
+        /* A partial message still needs its arena. */
+        if (node->arena && !node->data.message)
+        {
+                node->arena->trim();
+                node->arena = nullptr;
+        }
+}
 
-        node->error = errno;
-        node->state = PR_ST_ERROR;
-        delete node->res;
-        this->m_callback(castPollerNodeToResult(node), this->m_context);
+IOBufBlock *Poller::getReadBlock(const size_t size)
+{
+        std::vector<IOBufBlock *> &pool = this->local()->blockPool;
+        IOBufBlock                *block;
+
+        /* The pool only holds blocks of the standard size. */
+        if (size > IOBUF_BLOCK_SIZE)
+                return IOBuf::newBlock(size);
+
+        if (pool.empty())
+                return IOBuf::newBlock(IOBUF_BLOCK_SIZE);
+
+        block = pool.back();
+        pool.pop_back();
+        return block;
 }
 
-void Poller::handleEvent(struct PollerNode *node)
+void Poller::putReadBlock(IOBufBlock *block)
 {
-        struct PollerNode *res = node->res;
-        unsigned long long cnt = 0;
-        unsigned long long value;
-        void              *result;
-        ssize_t            n;
+        std::vector<IOBufBlock *> &pool = this->local()->blockPool;
 
-        while (1)
+        /* Only a block no message shares any more can be reused. */
+        if (block->ref.load(std::memory_order_acquire) == 1 &&
+            block->size == IOBUF_BLOCK_SIZE &&
+            pool.size() < POLLER_BLOCK_POOL)
         {
-                n = read(node->data.fd, &value, sizeof(unsigned long long));
-                if (n == sizeof(unsigned long long))
-                        cnt += value;
-                else
+                block->used = 0;
+                pool.push_back(block);
+        } else
+                IOBuf::unref(block);
+}
+
+void Poller::dropReadBuffer(struct PollerNode *node)
+{
+        if (node->data.flags & PD_FL_RING)
+        {
+                if (node->ring)
+                        this->local()->dropRings.push_back(node->ring);
+
+                node->ring = nullptr;
+        } else if (node->readBlock)
+        {
+                this->putReadBlock(node->readBlock);
+                node->readBlock = nullptr;
+        }
+}
+
+void Poller::flushCorked()
+{
+        struct PollerQueue *queue;
+        LIST_HEAD(busy);
+
+        while (!list_empty(&this->m_flushList))
+        {
+                queue = list_entry(this->m_flushList.next, struct PollerQueue,
+                                   list);
+
+                /* Its handler's to flush, or the next pass's. */
+                if (queue->node->busy)
                 {
-                        if (n >= 0)
-                                errno = EINVAL;
-                        break;
+                        list_move_tail(&queue->list, &busy);
+                        continue;
                 }
+
+                if (queue->node->removed)
+                {
+                        list_del(&queue->list);
+                        queue->corked = 0;
+                        continue;
+                }
+
+                this->flushQueue(queue->node);
         }
 
-        if (errno == EAGAIN)
+        list_splice(&busy, &this->m_flushList);
+}
+
+void Poller::retireNode(struct PollerNode *node, const int state,
+                        const int error)
+{
+        node->removed = 1;
+        node->state   = state;
+        node->error   = error;
+        list_add_tail(&node->list, &this->m_retiredList);
+}
+
+void Poller::deliver(struct PollerNode *node)
+{
+        Arena *arena = nullptr;
+
+        /* A partial message leaves with the node. */
+        if (node->inbound && node->data.operation == PD_OP_READ &&
+            node->data.message)
+                this->m_inboundBytes -= node->data.message->bytes;
+
+        if (node->paused)
         {
-                while (1)
-                {
-                        if (cnt == 0)
-                                return;
+                PollerNodePtrList &paused = this->m_pausedNodes;
+                StateLock          lock(this);
 
-                        cnt--;
-                        result = node->data.event(node->data.context);
-                        if (!result)
-                                break;
+                paused.erase(std::find(paused.begin(), paused.end(), node));
+                this->m_pausedReads--;
+                node->paused = 0;
+        }
 
-                        res->data        = node->data;
-                        res->data.result = result;
-                        res->error       = 0;
-                        res->state       = PR_ST_SUCCESS;
-                        this->m_callback(castPollerNodeToResult(res),
-                                         this->m_context);
+        /* The node is leaving the poller: drop its buffers. */
+        this->dropReadBuffer(node);
 
-                        res       = new PollerNode{};
-                        node->res = res;
-                        if (!res)
-                                break;
+        if (node->queue)
+        {
+                if (node->queue->corked)
+                {
+                        StateLock lock(this);
 
-                        if (node->removed)
-                                return;
+                        list_del(&node->queue->list);
                 }
+
+                this->dropPending(node->data.fd, node->queue->buf.length());
+                this->checkWatermark();
+                delete node->queue;
+                node->queue = nullptr;
         }
 
-        if (cnt != 0)
-                write(node->data.fd, &cnt, sizeof(unsigned long long));
+        /* Whatever state it ends in, a message gives its arena back. */
+        if (node->data.operation == PD_OP_READ && node->data.message)
+                arena = node->data.message->arena;
 
-        if (this->removeNode(node))
+        if (this->m_batchCallback)
+        {
+                this->local()->results.push_back(castPollerNodeToResult(node));
+                if (arena)
+                        this->m_arenas.push_back(arena);
+        } else if ((this->m_executor || this->m_oneshot) &&
+                 !(node->data.operation == PD_OP_READ &&
+                   (node->data.flags & PD_FL_RING)))
+        {
+                node->task.routine = Poller::runResult;
+                node->poller       = this;
+                this->m_inflight.fetch_add(1, std::memory_order_relaxed);
+
+                /*
+                 * One class at default dues: deadlines would only repeat
+                 * the submission order, at the cost of the shared queue.
+                 */
+                if (this->m_executor &&
+                    (this->m_classed || this->m_dueSet))
+                        this->m_executor->submit(
+                                &node->task,
+                                this->m_loopTime +
+                                        this->m_due[__poller_class(
+                                                &node->data)]);
+                else if (this->m_executor)
+                        this->m_executor->submit(&node->task);
+                else
+                        this->local()->results.push_back(
+                                castPollerNodeToResult(node));
+        } else
+        {
+                this->m_callback(castPollerNodeToResult(node), this->m_context);
+                if (arena)
+                        arena->release();
+        }
+}
+
+void Poller::runResult(struct ExecutorTask *task)
+{
+        char                 *p    = reinterpret_cast<char *>(task);
+        struct PollerNode    *node = reinterpret_cast<struct PollerNode *>(
+                p - offsetof(struct PollerNode, task));
+        Poller               *poller = node->poller;
+        const int             fd     = node->data.fd;
+        Arena                *arena  = nullptr;
+        struct PollerCommand *cmd;
+
+        /* Look before the callback, which may free the result. */
+        if (node->data.operation == PD_OP_READ && node->data.message)
+                arena = node->data.message->arena;
+
+        poller->m_callback(castPollerNodeToResult(node), poller->m_context);
+        if (arena)
+        {
+                /* Arenas belong to the poller thread. */
+                cmd = poller->newCommand(PC_CMD_ARENA, fd, -1, nullptr);
+                cmd->arena = arena;
+                poller->submit(cmd, cmd);
+        }
+
+        poller->m_inflight.fetch_sub(1, std::memory_order_release);
+}
+
+void Poller::flushResults()
+{
+        struct PollerLocal *local = this->local();
+
+        /* Rings of closed nodes outlive the results pointing into them. */
+        for (RingBuffer *ring : local->dropRings)
+                delete ring;
+
+        local->dropRings.clear();
+        if (local->results.empty() || !this->m_batchCallback)
                 return;
 
-        node->error = errno;
-        node->state = PR_ST_ERROR;
-        delete node->res;
-        this->m_callback(castPollerNodeToResult(node), this->m_context);
+        /* Stable, so results of one node keep their order. */
+        std::stable_sort(local->results.begin(), local->results.end(),
+                         [](const struct PollerResult *a,
+                            const struct PollerResult *b)
+                         { return a->data.operation < b->data.operation; });
+
+        this->m_batchCallback(local->results.data(), local->results.size(),
+                              this->m_context);
+        local->results.clear();
+
+        for (Arena *arena : this->m_arenas)
+                arena->release();
+
+        this->m_arenas.clear();
+        for (RingBuffer *ring : this->m_rings)
+                ring->release();
+
+        this->m_rings.clear();
 }
 
-void Poller::handleNotify(struct PollerNode *node)
+void Poller::reclaimNodes()
 {
-        struct PollerNode *res = node->res;
-        void              *result;
-        ssize_t            n;
+        struct PollerNode *node;
+        struct list_head  *pos, *tmp;
 
-        while (1)
+        /*
+         * A removed node may still be referenced by a later entry of the
+         * epoll batch. Results are handed out (and so may be freed) only
+         * after the loop iteration that retired them is over.
+         */
+        list_for_each_safe(pos, tmp, &this->m_retiredList)
         {
-                n = read(node->data.fd, &result, sizeof(void *));
-                if (n == sizeof(void *))
+                node = list_entry(pos, struct PollerNode, list);
+                list_del(pos);
+                delete node->res;
+                node->res = nullptr;
+                this->deliver(node);
+        }
+
+        INIT_LIST_HEAD(&this->m_retiredList);
+}
+
+/*
+ * Takes node out of this poller and queues its adoption by to for the end
+ * of the loop iteration: until then, the rest of the epoll batch may still
+ * name it, a read in progress may still parse into it, and batch results
+ * still point into its ring and arena.
+ */
+void Poller::detachNode(struct PollerNode *node, Poller *to)
+{
+        const int             fd    = node->data.fd;
+        struct PollerQueue   *queue = node->queue;
+        struct PollerCommand *cmd   = new PollerCommand{};
+
+        node->removed     = 1;
+        this->m_nodes[fd] = nullptr;
+        list_del(&node->list);
+        this->ctl(EPOLL_CTL_DEL, fd, 0, nullptr);
+
+        if (node->paused)
+        {
+                PollerNodePtrList &paused = this->m_pausedNodes;
+
+                paused.erase(std::find(paused.begin(), paused.end(), node));
+                this->m_pausedReads--;
+        }
+
+        if (queue)
+        {
+                if (queue->corked)
                 {
-                        result = node->data.notify(result, node->data.context);
-                        if (!result)
-                                break;
+                        list_del(&queue->list);
+                        queue->corked = 0;
+                }
 
-                        res->data        = node->data;
-                        res->data.result = result;
-                        res->error       = 0;
-                        res->state       = PR_ST_SUCCESS;
-                        this->m_callback(castPollerNodeToResult(res),
-                                         this->m_context);
+                this->dropPending(fd, queue->buf.length());
+                this->checkWatermark();
+        }
 
-                        res       = new PollerNode{};
-                        node->res = res;
-                        if (!res)
-                                break;
+        node->trimQueued = 0;
+        node->active     = 0;
+        node->held       = 0;
+
+        cmd->command      = PC_CMD_ADOPT;
+        cmd->fd           = fd;
+        cmd->timeout      = node->deadline != 0;
+        cmd->generation   = this->m_epochs[fd];
+        cmd->node         = node;
+        cmd->target       = to;
+        this->m_moved[fd] = to;
+        this->m_handOffs.push_back(cmd);
+}
 
-                        if (node->removed)
-                                return;
-                } else if (n < 0 && errno == EAGAIN)
-                        return;
-                else
+void Poller::adoptNode(struct PollerNode *node, const int timed,
+                       const unsigned int epoch)
+{
+        const int           fd    = node->data.fd;
+        struct PollerQueue *queue = node->queue;
+
+        this->m_inboundBytes += node->inbound;
+        this->m_retainedBytes += __poller_retained(node);
+        if (queue)
+        {
+                this->addPending(fd, queue->buf.length());
+                this->checkWatermark();
+        }
+
+        if (node->paused)
+        {
+                this->m_pausedNodes.push_back(node);
+                this->m_pausedReads++;
+        }
+
+        if (this->m_leaving)
+        {
+                this->retireNode(node, PR_ST_STOPPED, 0);
+                return;
+        }
+
+        /* fd was added here again meanwhile. */
+        if (this->m_nodes[fd])
+        {
+                this->retireNode(node, PR_ST_ERROR, EEXIST);
+                return;
+        }
+
+        /* Level- or edge-triggered, whatever is ready is reported now. */
+        node->event = __poller_node_event(node);
+        if (this->m_oneshot)
+                this->m_generations[fd]++;
+
+        if (this->ctl(EPOLL_CTL_ADD, fd, node->event | this->m_oneshot,
+                      this->eventData(node)) < 0)
+        {
+                this->retireNode(node, PR_ST_ERROR, errno);
+                return;
+        }
+
+        node->removed      = 0;
+        this->m_nodes[fd]  = node;
+        this->m_epochs[fd] = epoch;
+
+        if (timed)
+                __poller_insert_timeout(node, &this->m_timeoutList);
+        else
+                list_add_tail(&node->list, &this->m_nonTimeoutList);
+
+        if (queue && !queue->buf.empty() && !queue->waiting &&
+            node->data.operation != PD_OP_WRITE)
+        {
+                list_add_tail(&queue->list, &this->m_flushList);
+                queue->corked = 1;
+        }
+}
+
+void Poller::forward(struct PollerCommand *cmd, Poller *to)
+{
+        struct PollerCommand *fwd = new PollerCommand{};
+        struct PollerCommand *last;
+
+        fwd->command    = cmd->command;
+        fwd->fd         = cmd->fd;
+        fwd->timeout    = cmd->timeout;
+        fwd->node       = cmd->node;
+        fwd->buf        = std::move(cmd->buf);
+
+        fwd->bytes      = cmd->bytes;
+        fwd->owner      = cmd->owner;
+        fwd->generation = cmd->generation;
+        fwd->arena      = cmd->arena;
+        fwd->target     = cmd->target;
+        fwd->share      = cmd->share;
+        cmd->node       = nullptr;
+
+        /* send() charged its bytes here: they follow the fd. */
+        if (cmd->command == PC_CMD_SEND)
+        {
+                this->dropPending(cmd->fd, fwd->buf.length());
+                this->checkWatermark();
+                to->addPending(cmd->fd, fwd->buf.length());
+        }
+
+        /* Behind the adoption, if that has not left yet. */
+        for (struct PollerCommand *adopt : this->m_handOffs)
+        {
+                if (adopt->fd != fwd->fd)
+                        continue;
+
+                for (last = adopt; last->next; last = last->next)
+                        ;
+
+                last->next = fwd;
+                return;
+        }
+
+        to->submit(fwd, fwd);
+}
+
+void Poller::handOff()
+{
+        struct PollerCommand *last;
+        struct PollerNode    *node;
+
+        for (struct PollerCommand *cmd : this->m_handOffs)
+        {
+                /* Its budget charges go along. */
+                node = cmd->node;
+                this->m_inboundBytes -= node->inbound;
+                this->m_retainedBytes -= std::min(
+                        __poller_retained(node), this->m_retainedBytes.load());
+                for (last = cmd; last->next; last = last->next)
+                        ;
+
+                cmd->target->submit(cmd, last);
+        }
+
+        if (!this->m_handOffs.empty() && !this->m_pausedNodes.empty())
+                this->resumeNodes();
+
+        this->m_handOffs.clear();
+}
+
+void Poller::shedNodes(const double share, Poller *to)
+{
+        struct list_head *lists[] = {&this->m_timeoutList,
+                                     &this->m_nonTimeoutList};
+        std::vector<struct PollerNode *> nodes;
+        std::vector<struct PollerNode *> moving;
+        struct PollerNode               *node;
+        struct list_head                *pos;
+        double                           budget = 0;
+
+        for (struct list_head *list : lists)
+        {
+                list_for_each(pos, list)
                 {
-                        if (n > 0)
-                                errno = EINVAL;
-                        break;
+                        node = list_entry(pos, struct PollerNode, list);
+                        if (node->busy)
+                                continue;
+
+                        switch (node->data.operation)
+                        {
+                                case PD_OP_READ:
+                                case PD_OP_WRITE:
+                                case PD_OP_IDLE:
+                                        budget += node->heat;
+                                        nodes.push_back(node);
+                                        break;
+                                default:
+                                        break;
+                        }
                 }
         }
 
-        if (this->removeNode(node))
-                return;
+        std::sort(nodes.begin(), nodes.end(),
+                  [](const struct PollerNode *a, const struct PollerNode *b)
+                  { return a->heat > b->heat; });
 
-        if (n == 0)
-        {
-                node->error = 0;
-                node->state = PR_ST_FINISHED;
-        } else
+        budget *= share;
+        for (struct PollerNode *n : nodes)
         {
-                node->error = errno;
-                node->state = PR_ST_ERROR;
+                if (n->heat > 0 && n->heat <= budget)
+                {
+                        budget -= n->heat;
+                        moving.push_back(n);
+                }
+
+                n->heat /= 2;
         }
 
-        delete node->res;
-        this->m_callback(castPollerNodeToResult(node), this->m_context);
+        for (struct PollerNode *n : moving)
+                this->detachNode(n, to);
 }
 
-int Poller::handlePipe() const
+/*
+ * cmd->owner may be freed, or another timer now: it is only compared, so
+ * the node found is the one still on a list, with the same serial.
+ */
+void Poller::cancelTimer(const struct PollerCommand *cmd)
 {
-        struct PollerNode **node = (struct PollerNode **) (this->m_buf);
-        int                 stop = 0;
-        int                 n;
+        struct list_head *lists[] = {&this->m_timeoutList,
+                                     &this->m_nonTimeoutList};
+        struct PollerNode *node;
+        struct list_head  *pos;
 
-        n = read(this->m_pipeRead, node, POLLER_BUFSIZE) / sizeof(void *);
-        for (int i = 0; i < n; i++)
+        for (struct list_head *list : lists)
         {
-                if (node[i])
+                list_for_each(pos, list)
                 {
-                        free(node[i]->res);
-                        this->m_callback(castPollerNodeToResult(node[i]),
-                                         this->m_context);
-                } else
-                        stop = 1;
-        }
+                        node = list_entry(pos, struct PollerNode, list);
+                        if (node != cmd->owner)
+                                continue;
 
-        return stop;
+                        if (node->data.operation == PD_OP_TIMER &&
+                            node->serial == cmd->generation)
+                        {
+                                list_del(pos);
+                                this->retireNode(node, PR_ST_DELETED, 0);
+                        }
+
+                        return;
+                }
+        }
 }
 
 void Poller::handleTimeout(const struct PollerNode *timeNode)
@@ -567,25 +2982,25 @@ void Poller::handleTimeout(const struct PollerNode *timeNode)
         struct list_head  *pos, *tmp;
         LIST_HEAD(timeo_list);
 
+        list_for_each_safe(pos, tmp, &this->m_timeoutList)
         {
-                std::unique_lock<std::mutex> lock(this->m_mutex);
-                list_for_each_safe(pos, tmp, &this->m_timeoutList)
-                {
-                        node = list_entry(pos, struct PollerNode, list);
-                        if (__timeout_cmp(node, timeNode) > 0)
-                                break;
+                node = list_entry(pos, struct PollerNode, list);
+                if (__timeout_cmp(node, timeNode) > 0)
+                        break;
 
-                        if (node->data.fd >= 0)
-                        {
-                                this->m_nodes[node->data.fd] = nullptr;
-                                __poller_del_fd(node->data.fd, this->m_pfd);
-                        } else
-                                node->removed = 1;
+                /* Its own thread expires it, once its handler is done. */
+                if (node->busy)
+                        continue;
 
-                        list_move_tail(pos, &timeo_list);
+                if (node->data.fd >= 0)
+                {
+                        this->m_nodes[node->data.fd] = nullptr;
+                        this->ctl(EPOLL_CTL_DEL, node->data.fd, 0, nullptr);
                 }
-        }
 
+                node->removed = 1;
+                list_move_tail(pos, &timeo_list);
+        }
 
         list_for_each_safe(pos, tmp, &timeo_list)
         {
@@ -600,37 +3015,35 @@ void Poller::handleTimeout(const struct PollerNode *timeNode)
                         node->state = PR_ST_FINISHED;
                 }
 
-                free(node->res);
-                this->m_callback(castPollerNodeToResult(node), this->m_context);
+                delete node->res;
+                node->res = nullptr;
+                this->deliver(node);
         }
 }
 
 
 int Poller::removeNode(struct PollerNode *node)
 {
-        int removed;
+        const int removed = node->removed;
 
+        if (!removed)
         {
-                std::unique_lock lock(m_mutex);
-                removed = node->removed;
-                if (!removed)
-                {
-                        this->m_nodes[node->data.fd] = nullptr;
+                StateLock lock(this);
 
-                        list_del(&node->list);
-                        __poller_del_fd(node->data.fd, this->m_pfd);
-                }
+                node->removed                = 1;
+                this->m_nodes[node->data.fd] = nullptr;
+
+                list_del(&node->list);
+                this->ctl(EPOLL_CTL_DEL, node->data.fd, 0, nullptr);
         }
 
         return removed;
 }
 
-int Poller::appendMessage(const void *buf, size_t *n,
-                          struct PollerNode *node) const
+PollerMessage *Poller::nodeMessage(struct PollerNode *node)
 {
         PollerMessage     *msg = node->data.message;
         struct PollerNode *res;
-        int                ret;
 
         if (!msg)
         {
@@ -639,119 +3052,627 @@ int Poller::appendMessage(const void *buf, size_t *n,
                 if (!msg)
                 {
                         delete res;
-                        return -1;
+                        return nullptr;
                 }
 
+                msg->bytes         = 0;
+                msg->node          = node;
+                msg->epoch         = node->data.fd >= 0
+                                             ? this->m_epochs[node->data.fd]
+                                             : 0;
                 node->data.message = msg;
                 node->res          = res;
+                if (msg->arena)
+                        node->arena = msg->arena;
+        }
+
+        return msg;
+}
+
+void Poller::finishMessage(struct PollerNode *node)
+{
+        struct PollerNode *res   = node->res;
+        Arena             *arena = node->data.message->arena;
+        const size_t       bytes = node->data.message->bytes;
+
+        /* Only a message the user can release() stays charged. */
+        if (arena || (node->data.flags & PD_FL_RING) ||
+            !(this->m_readBudget || this->m_pollerReadBudget))
+        {
+                node->inbound -= bytes;
+                this->m_inboundBytes -= bytes;
         } else
-                res = node->res;
+                this->m_retainedBytes += bytes;
+
+        res->data  = node->data;
+        res->error = 0;
+        res->state = PR_ST_SUCCESS;
+        this->deliver(res);
+
+        node->data.message = nullptr;
+        node->res          = nullptr;
+        if (node->data.flags & PD_FL_RING)
+        {
+                if (this->m_batchCallback)
+                        this->m_rings.push_back(node->ring);
+                else
+                        node->ring->release();
+        }
+}
+
+int Poller::appendMessage(const void *buf, size_t *n,
+                          struct PollerNode *node)
+{
+        PollerMessage *msg = this->nodeMessage(node);
+        int            ret;
+
+        if (!msg)
+                return -1;
 
         ret = msg->append(buf, n, msg);
-        if (ret < 0)
+        if (ret >= 0)
+                this->chargeMessage(node, msg, *n);
+
+        if (ret > 0)
+                this->finishMessage(node);
+
+        return ret;
+}
+
+int Poller::appendBufMessage(IOBuf *buf, struct PollerNode *node)
+{
+        PollerMessage *msg = this->nodeMessage(node);
+        struct iovec   iov;
+        size_t         n;
+        int            ret;
+
+        if (!msg)
+                return -1;
+
+        n = buf->length();
+        if (!msg->appendBuf)
+        {
+                /* Not chain-aware: feed it the first slice as plain bytes. */
+                buf->peekIovec(&iov, 1);
+                n   = iov.iov_len;
+                ret = msg->append(iov.iov_base, &n, msg);
+                if (ret >= 0)
+                {
+                        buf->popFront(n);
+                        n = 0;
+                }
+        } else
         {
-                res->data  = node->data;
-                res->error = 0;
-                res->state = PR_ST_SUCCESS;
-                m_callback(castPollerNodeToResult(res), m_context);
+                ret = msg->appendBuf(buf, msg);
+                if (ret == 0 && !buf->empty())
+                {
+                        errno = EBADMSG;
+                        ret   = -1;
+                }
 
-                node->data.message = nullptr;
-                node->res          = nullptr;
+                n -= buf->length();
         }
 
+        if (ret >= 0)
+                this->chargeMessage(node, msg, n);
+
+        if (ret > 0)
+                this->finishMessage(node);
+
         return ret;
 }
 
-void *Poller::threadRoutine()
+/*
+ * Handlers share their thread's read buffer and keep the state of their
+ * node on the stack, so none may run inside another. While one runs,
+ * commands a callback issues for its fd wait for it to return, and other
+ * nodes woken meanwhile (by a switch or a release) run after it.
+ */
+void Poller::dispatchNode(struct PollerNode *node, const int events)
+{
+        struct PollerLocal                 *local = this->local();
+        std::vector<struct PollerCommand *> deferred;
+
+        local->hotFd = node->data.fd;
+        this->handleNode(node, events);
+        local->hotFd = -1;
+
+        deferred.swap(local->deferred);
+        for (struct PollerCommand *cmd : deferred)
+        {
+                this->execute(cmd);
+                delete cmd;
+        }
+
+        while (!local->ready.empty())
+        {
+                node = local->ready.back();
+                local->ready.pop_back();
+                if (!node->removed && !node->held)
+                        this->dispatchNode(node, __poller_op_event(node));
+        }
+}
+
+/* Runs node's operation now, or after the handler running, if any. */
+void Poller::wakeNode(struct PollerNode *node)
+{
+        struct PollerLocal *local = this->local();
+
+        if (local->hotFd >= 0)
+                local->ready.push_back(node);
+        else
+                this->dispatchNode(node, __poller_op_event(node));
+}
+
+void Poller::handleNode(struct PollerNode *node, const int events)
+{
+        node->heat += node->heat != UINT_MAX;
+        this->touchNode(node);
+        if ((events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && node->queue &&
+            node->queue->waiting && node->data.operation != PD_OP_WRITE)
+        {
+                if (this->flushQueue(node) < 0)
+                        return;
+        }
+
+        /* An edge-triggered node wakes up for either direction. */
+        if (!(events & (__poller_op_event(node) | EPOLLHUP | EPOLLERR)))
+                return;
+
+        switch (node->data.operation)
+        {
+                case PD_OP_READ:
+                        if (node->paused)
+                                break;
+
+                        if (node->data.flags & PD_FL_RING)
+                                handleReadRing(node);
+                        else if (node->data.flags & PD_FL_IOBUF)
+                                handleReadBuf(node);
+                        else
+                                handleRead(node);
+                        break;
+                case PD_OP_WRITE:
+                        if (node->data.flags & PD_FL_IOBUF)
+                                handleWriteBuf(node);
+                        else
+                                handleWrite(node);
+                        break;
+                case PD_OP_LISTEN:
+                        handleListen(node);
+                        break;
+                case PD_OP_CONNECT:
+                        handleConnect(node);
+                        break;
+                case PD_OP_RECVFROM:
+                        handleRecvFrom(node);
+                        break;
+                        // case PD_OP_SSL_ACCEPT:
+                        //         __poller_handle_ssl_accept(node,
+                        //         poller);
+                        // break;
+                        // case PD_OP_SSL_CONNECT:
+                        //         __poller_handle_ssl_connect(node,
+                        //         poller);
+                        // break;
+                        // case PD_OP_SSL_SHUTDOWN:
+                        //         __poller_handle_ssl_shutdown(node,
+                        //         poller);
+                        // break;
+                case PD_OP_EVENT:
+                        handleEvent(node);
+                        break;
+                case PD_OP_NOTIFY:
+                        handleNotify(node);
+                        break;
+                case PD_OP_IDLE:
+                        if (events & (EPOLLHUP | EPOLLERR))
+                                handleIdle(node);
+                        break;
+                default:
+                        break;
+        }
+}
+
+void *Poller::threadRoutine(const int index)
 {
-        epoll_event         events[POLLER_EVENTS_MAX];
-        struct PollerNode   timeNode = {};
-        struct PollerNode  *node;
-        struct PollerParams p;
-        int                 hasPipeEvent;
-        int                 nEvents;
+        struct PollerLocal                *local = this->local();
+        std::vector<epoll_event>           events(m_eventsMax);
+        std::vector<struct PollerResult *> results;
+        struct PollerNode                  timeNode = {};
+        struct PollerNode                 *node;
+        int                                batch = m_eventsMin;
+        int                                hasPipeEvent;
+        int                                nEvents;
+
+        if (m_nthreads == 1)
+                this->m_threadId.store(std::this_thread::get_id());
 
         while (1)
         {
-                this->setTimer();
-                nEvents = epoll_wait(m_pfd, events, POLLER_EVENTS_MAX, -1);
-                clock_gettime(CLOCK_MONOTONIC, &timeNode.timeout);
-                hasPipeEvent = 0;
+                if (m_nthreads > 1)
+                {
+                        if (index >= m_active.load(std::memory_order_relaxed))
+                                park(index);
+
+                        /* Wait to lead: the leader alone waits on epoll. */
+                        this->m_leader.lock();
+                        if (this->m_leaving)
+                        {
+                                this->m_leader.unlock();
+                                this->lockState();
+                                break;
+                        }
+                } else
+                        this->setTimer();
+
+                m_waitEvents.store(batch, std::memory_order_relaxed);
+                nEvents = epoll_wait(m_pfd, events.data(), batch, -1);
+                m_waitCalls.fetch_add(1, std::memory_order_relaxed);
+
+                /* Take more per call while the batch comes back full. */
+                if (nEvents == batch)
+                        batch = std::min(batch * 2, m_eventsMax);
+                else if (nEvents < batch / 4)
+                        batch = std::max(batch / 2, m_eventsMin);
+
+                if (m_nthreads > 1)
+                {
+                        /*
+                         * The next leader waits while this thread handles
+                         * its events. They name their nodes by fd and
+                         * generation (see eventNode()): another thread may
+                         * remove a node before the state lock is taken.
+                         */
+                        this->m_leader.unlock();
+                        this->lockState();
+                        if (this->m_leaving)
+                                break;
+                }
+
+                timeNode.deadline = __poller_now();
+                m_loopTime        = timeNode.deadline;
+                hasPipeEvent      = 0;
+                if (m_classed && nEvents > 1)
+                        rankEvents(events.data(), nEvents);
+
                 for (int i = 0; i < nEvents; i++)
                 {
-                        node = reinterpret_cast<struct PollerNode *>(
-                                &events[i].data.ptr);
-                        if (node <= reinterpret_cast<struct PollerNode *>(1))
+                        node = this->eventNode(&events[i]);
+                        if (!node)
                         {
-                                if (node ==
-                                    reinterpret_cast<struct PollerNode *>(1))
+                                if (events[i].data.u64 == 1)
                                         hasPipeEvent = 1;
                                 continue;
                         }
 
-                        switch (node->data.operation)
+                        /* Held: another thread took an event for it first. */
+                        if (node->removed || node->held)
+                                continue;
+
+                        if (!m_oneshot)
                         {
-                                case PD_OP_READ:
-                                        handleRead(node);
-                                        break;
-                                case PD_OP_WRITE:
-                                        handleWrite(node);
-                                        break;
-                                case PD_OP_LISTEN:
-                                        handleListen(node);
-                                        break;
-                                case PD_OP_CONNECT:
-                                        handleConnect(node);
-                                        break;
-                                case PD_OP_RECVFROM:
-                                        handleRecvFrom(node);
-                                        break;
-                                        // case PD_OP_SSL_ACCEPT:
-                                        //         __poller_handle_ssl_accept(node,
-                                        //         poller);
-                                        // break;
-                                        // case PD_OP_SSL_CONNECT:
-                                        //         __poller_handle_ssl_connect(node,
-                                        //         poller);
-                                        // break;
-                                        // case PD_OP_SSL_SHUTDOWN:
-                                        //         __poller_handle_ssl_shutdown(node,
-                                        //         poller);
-                                        // break;
-                                case PD_OP_EVENT:
-                                        handleEvent(node);
-                                        break;
-                                case PD_OP_NOTIFY:
-                                        handleNotify(node);
-                                        break;
-                                default:
-                                        break;
+                                dispatchNode(node, events[i].events);
+                                continue;
+                        }
+
+                        holdNode(node);
+                        node->busy         = 1;
+                        events[i].data.ptr = node;
+                        local->busy.push_back(events[i]);
+                }
+
+                if (!local->busy.empty())
+                {
+                        /*
+                         * The I/O and parsing go without the state: other
+                         * threads handle theirs meanwhile, and only what a
+                         * handler changes in the poller takes it again
+                         * (see StateLock).
+                         */
+                        this->unlockState();
+                        for (const struct epoll_event &ev : local->busy)
+                                dispatchNode(static_cast<struct PollerNode *>(
+                                                     ev.data.ptr),
+                                             ev.events);
+
+                        this->lockState();
+                        local->busy.clear();
+                        for (const struct PollerCommand *cmd : local->held)
+                        {
+                                /* Unless its result is out, maybe freed. */
+                                node = this->m_nodes[cmd->fd];
+                                if (node == cmd->node &&
+                                    this->m_generations[cmd->fd] ==
+                                            cmd->generation)
+                                        node->busy = 0;
                         }
+
+                        runParked();
+                        if (!this->m_pausedNodes.empty())
+                                resumeNodes();
                 }
 
                 if (hasPipeEvent)
                 {
                         if (handlePipe())
+                        {
+                                /*
+                                 * Parked threads come to see m_leaving, and
+                                 * the leader with them: the pipe is left
+                                 * readable from now on.
+                                 */
+                                this->m_leaving = 1;
+                                if (m_nthreads > 1)
+                                {
+                                        setThreads(m_nthreads);
+                                        write(this->m_pipeWrite, &node, 1);
+                                }
                                 break;
+                        }
                 }
 
+                flushCorked();
                 handleTimeout(&timeNode);
+                trimNodes(timeNode.deadline);
+                reclaimNodes();
+                flushResults();
+                handOff();
+                m_busyTime.fetch_add(__poller_now() - timeNode.deadline,
+                                     std::memory_order_relaxed);
+                if (m_nthreads > 1)
+                {
+                        /* For whoever waits now, and its earlier deadline. */
+                        this->setTimer();
+                        follow(&results);
+                }
         }
+
+        reclaimNodes();
+        flushResults();
+        handOff();
+        if (m_nthreads > 1)
+                follow(&results);
+        else
+                this->m_threadId.store(std::thread::id());
+
+        __poller_local = nullptr;
         return nullptr;
 }
 
+/* Stable by class: high first, bulk last, kernel order within each. */
+void Poller::rankEvents(struct epoll_event *events, const int n)
+{
+        this->m_ranked.clear();
+        for (int cls = 0; cls < 3; cls++)
+        {
+                for (int i = 0; i < n; i++)
+                {
+                        if (__poller_event_class(this->eventNode(&events[i])) ==
+                            cls)
+                                this->m_ranked.push_back(events[i]);
+                }
+        }
+
+        std::copy(this->m_ranked.begin(), this->m_ranked.end(), events);
+}
+
+/* Above the active count: wait, off the leader lock, to be let in again. */
+void Poller::park(const int index)
+{
+        std::unique_lock<std::mutex> lock(this->m_parkMutex);
+
+        this->m_parkCond.wait(
+                lock,
+                [this, index]
+                {
+                        return index < this->m_active.load(
+                                               std::memory_order_relaxed);
+                });
+}
+
+/* The leader took an event for node: it stays disarmed until follow(). */
+void Poller::holdNode(struct PollerNode *node)
+{
+        struct PollerCommand *cmd = this->m_spareRearms;
+
+        if (cmd)
+                this->m_spareRearms = cmd->next;
+        else
+                cmd = new PollerCommand{};
+
+        cmd->command    = PC_CMD_REARM;
+        cmd->fd         = node->data.fd;
+        cmd->node       = node;
+        cmd->generation = this->m_generations[node->data.fd];
+        node->held      = 1;
+        this->local()->held.push_back(cmd);
+}
+
+/*
+ * What epoll reports for node. In leader/follower mode that is its fd and
+ * generation, above the timer fd's 0 and the pipe's 1, rather than the
+ * node itself.
+ */
+void *Poller::eventData(const struct PollerNode *node) const
+{
+        const int fd = node->data.fd;
+
+        if (!this->m_oneshot)
+                return const_cast<struct PollerNode *>(node);
+
+        return reinterpret_cast<void *>((uint64_t) this->m_generations[fd]
+                                                << 32 |
+                                        ((uint64_t) fd + 2));
+}
+
+/* The node of event, or null for the timer fd, the pipe and stale tags. */
+struct PollerNode *Poller::eventNode(const struct epoll_event *event) const
+{
+        const uint64_t data = event->data.u64;
+        int            fd;
+
+        if (data <= 1)
+                return nullptr;
+
+        if (!this->m_oneshot)
+                return static_cast<struct PollerNode *>(event->data.ptr);
+
+        fd = (int) (data & 0xffffffff) - 2;
+        if (this->m_generations[fd] != (unsigned int) (data >> 32))
+                return nullptr;
+
+        return this->m_nodes[fd];
+}
+
+/*
+ * Lets the poller state go, then runs the callbacks of what this thread
+ * read. The nodes are re-armed after that, through the command stack: the
+ * poller state may belong to another thread by then.
+ */
+void Poller::follow(std::vector<struct PollerResult *> *results)
+{
+        struct PollerLocal   *local = this->local();
+        struct PollerCommand *first = nullptr;
+        struct PollerCommand *last  = nullptr;
+
+        results->swap(local->results);
+        for (struct PollerCommand *cmd : local->held)
+        {
+                if (last)
+                        last->next = cmd;
+                else
+                        first = cmd;
+
+                last = cmd;
+        }
+
+        local->held.clear();
+        this->unlockState();
+        if (!results->empty())
+        {
+                const int64_t start = __poller_now();
+
+                for (struct PollerResult *res : *results)
+                        Poller::runResult(
+                                &reinterpret_cast<struct PollerNode *>(res)
+                                         ->task);
+
+                results->clear();
+                this->m_busyTime.fetch_add(__poller_now() - start,
+                                           std::memory_order_relaxed);
+        }
+
+        if (first)
+                this->submit(first, last);
+}
+
+void Poller::lockState()
+{
+        this->m_state.lock();
+        this->m_threadId.store(std::this_thread::get_id(),
+                               std::memory_order_relaxed);
+        this->m_lockedAt = __poller_now();
+}
+
+void Poller::unlockState()
+{
+        this->m_stateTime.fetch_add(__poller_now() - this->m_lockedAt,
+                                    std::memory_order_relaxed);
+        this->m_threadId.store(std::thread::id(), std::memory_order_relaxed);
+        this->m_state.unlock();
+}
+
+Poller::StateLock::StateLock(Poller *poller) : m_poller(nullptr)
+{
+        const std::thread::id me = std::this_thread::get_id();
+
+        if (poller->m_oneshot &&
+            poller->m_threadId.load(std::memory_order_relaxed) != me)
+        {
+                poller->lockState();
+                m_poller = poller;
+        }
+}
+
+Poller::StateLock::~StateLock()
+{
+        if (m_poller)
+                m_poller->unlockState();
+}
+
+/* This thread's, or the first for any other (stop(), before start()). */
+struct PollerLocal *Poller::local()
+{
+        struct PollerLocal *local =
+                static_cast<struct PollerLocal *>(__poller_local);
+
+        if (local && local->poller == this)
+                return local;
+
+        return &this->m_locals[0];
+}
+
+/*
+ * A command for a busy node waits for its handler to return, and one for
+ * an fd with a command waiting waits behind it. Re-arms never meet a busy
+ * node: its own is sent after the handler.
+ */
+bool Poller::parkCommand(struct PollerCommand *cmd)
+{
+        const int          fd   = cmd->fd;
+        struct PollerNode *node;
+
+        if (!this->m_oneshot || fd < 0 ||
+            (size_t) fd >= this->m_maxOpenFiles ||
+            cmd->command == PC_CMD_REARM)
+                return false;
+
+        node = this->m_nodes[fd];
+        if (!(node && node->busy) &&
+            std::none_of(this->m_parked.begin(), this->m_parked.end(),
+                         [fd](const struct PollerCommand *parked)
+                         { return parked->fd == fd; }))
+                return false;
+
+        this->m_parked.push_back(cmd);
+        return true;
+}
+
+/* In order, those whose node is no longer busy. */
+void Poller::runParked()
+{
+        std::vector<struct PollerCommand *> parked;
+
+        parked.swap(this->m_parked);
+        for (struct PollerCommand *cmd : parked)
+        {
+                if (this->parkCommand(cmd))
+                        continue;
+
+                this->execute(cmd);
+                delete cmd;
+        }
+}
+
 void Poller::setTimer()
 {
         struct PollerNode *node = nullptr;
         struct timespec    abstime;
 
-        std::unique_lock lock(m_mutex);
         if (!list_empty(&m_timeoutList))
                 node = list_entry(m_timeoutList.next, struct PollerNode, list);
 
-        if (node)
-                abstime = node->timeout;
-        else
+        if (node || !m_trimFds.empty())
+        {
+                int64_t deadline = node ? node->deadline : m_nextTrim;
+
+                if (!m_trimFds.empty() && m_nextTrim < deadline)
+                        deadline = m_nextTrim;
+
+                abstime.tv_sec  = deadline / 1000000000;
+                abstime.tv_nsec = deadline % 1000000000;
+        } else
         {
                 abstime.tv_sec  = 0;
                 abstime.tv_nsec = 0;
@@ -5,22 +5,71 @@
 #ifndef POLLER_H
 #define POLLER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <openssl/ssl.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "Executor.h"
+#include "IOBuf.h"
+#include "List.h"
 #include "RBTree.h"
+#include "RingBuffer.h"
+
+class Arena;
+class Poller;
+struct PollerNode;
 
 #define POLLER_BUFSIZE (256 * 1024)
+#define POLLER_READ_MIN 2048
+#define POLLER_DGRAM_MAX 65536
+#define POLLER_EVENTS_MIN 16
 #define POLLER_EVENTS_MAX 256
-
+#define POLLER_BLOCK_POOL 64
+#define POLLER_HUGE_PAGE (2 * 1024 * 1024)
+#define POLLER_STACK_PREFAULT (256 * 1024)
+#define POLLER_DUE_HIGH 1000
+#define POLLER_DUE_NORMAL 10000
+#define POLLER_DUE_BULK 100000
+
+/*
+ * arena is set by Arena::createMessage() and must be null otherwise. An
+ * arena message is handed back to its arena once the result is delivered.
+ *
+ * For PD_FL_RING reads, append() is offered every unparsed byte in the
+ * ring, contiguous even across reads. It may take fewer than *n and
+ * return 0: the rest is offered again, with more after it, on the next
+ * read. Bytes it took stay in place until the message is delivered, so
+ * the message may point into them instead of copying.
+ */
 struct PollerMessage
 {
-        std::function<int(const void *, std::size_t *, PollerMessage *)> append;
+        int (*append)(const void *, std::size_t *, PollerMessage *);
+        /*
+         * Optional, for PD_FL_IOBUF reads: takes the bytes it wants from the
+         * chain by cutFront() (no copy). Returns > 0 when the message is
+         * complete, in which case the rest belongs to the next message, and
+         * must consume everything otherwise.
+         */
+        int (*appendBuf)(IOBuf *, PollerMessage *);
+        Arena *arena;
+        size_t bytes; /* received so far, kept by the poller */
+
+        /* Also kept by the poller: the node that read it, for release(). */
+        struct PollerNode *node;
+        unsigned int       epoch;
+
         char data[0];
 };
 
@@ -39,30 +88,58 @@ struct PollerData
 #define PD_OP_SSL_SHUTDOWN 8
 #define PD_OP_EVENT 9
 #define PD_OP_NOTIFY 10
-
-        short          operation;
+#define PD_OP_IDLE 11
+
+/*
+ * A persistent node stays registered after its operation completes: it is
+ * reported like a multi-result operation and parked as PD_OP_IDLE until a
+ * mod() switches it in place. With PD_FL_EDGE it is registered once for
+ * both directions, edge-triggered, and never touched by epoll_ctl again.
+ */
+#define PD_FL_PERSISTENT 0x1
+#define PD_FL_EDGE 0x2
+/* Read into refcounted blocks / write data.writeBuf instead of writeIov. */
+#define PD_FL_IOBUF 0x4
+/* Read into a per-connection magic ring buffer (see RingBuffer). */
+#define PD_FL_RING 0x8
+/*
+ * Priority classes. Within one epoll_wait() batch, events of PD_FL_HIGH
+ * nodes (health checks, control traffic) are handled first and those of
+ * PD_FL_BULK nodes last; see also PollerParams::dueHigh.
+ */
+#define PD_FL_HIGH 0x10
+#define PD_FL_BULK 0x20
+/*
+ * PD_OP_EVENT: event() does all the work, on the poller thread, and no
+ * result is allocated or delivered for each count; the node still comes
+ * back when it ends. For doorbells.
+ */
+#define PD_FL_QUIET 0x40
+
+        unsigned char  operation;
+        unsigned char  flags;
         unsigned short iovcnt;
         int            fd;
         SSL           *ssl;
 
+        /* Plain function pointers: context already carries the state. */
         union
         {
-                std::function<PollerMessage *(void *)> createMessage;
-                std::function<int(size_t, void *)>     partialWritten;
-                std::function<void *(const struct sockaddr *, socklen_t, int,
-                                     void *)>
-                        accept;
-                std::function<void *(const struct sockaddr *, socklen_t, void *,
-                                     std::size_t, void *)>
-                                                      recvfrom;
-                std::function<void *(void *)>         event;
-                std::function<void *(void *, void *)> notify;
+                PollerMessage *(*createMessage)(void *);
+                int (*partialWritten)(size_t, void *);
+                void *(*accept)(const struct sockaddr *, socklen_t, int,
+                                void *);
+                void *(*recvfrom)(const struct sockaddr *, socklen_t, void *,
+                                  std::size_t, void *);
+                void *(*event)(void *);
+                void *(*notify)(void *, void *);
         };
         void *context;
         union
         {
                 PollerMessage *message;
                 struct iovec  *writeIov;
+                IOBuf         *writeBuf;
                 void          *result;
         };
 };
@@ -75,11 +152,13 @@ struct PollerResult
 #define PR_ST_DELETED 3
 #define PR_ST_MODIFIED 4
 #define PR_ST_STOPPED 5
+#define PR_ST_BLOCKED 6
+#define PR_ST_RESUMED 7
 
         int               state;
         int               error;
         struct PollerData data;
-        /* In callback, spaces of six pointers are available from here. */
+        /* In callback, the rest of a PollerNode is available from here. */
 };
 
 struct PollerParams
@@ -87,19 +166,293 @@ struct PollerParams
         size_t                                             maxOpenFiles;
         std::function<void(struct PollerResult *, void *)> callback;
         void                                              *content;
+
+        /*
+         * Optional. When set, replaces callback: the results of one loop
+         * iteration are collected and passed in a single call, grouped by
+         * operation.
+         */
+        std::function<void(struct PollerResult **, size_t, void *)>
+                batchCallback;
+
+        /*
+         * Optional. When set, callback runs on the executor's workers
+         * instead of the poller thread, earliest due first (see dueHigh),
+         * so it must be thread-safe. Arena messages go back to their
+         * arena through the poller once the callback returns. PD_FL_RING
+         * reads still run inline, since their bytes stay valid only on the
+         * poller thread. Stop the poller before the executor.
+         */
+        Executor *executor;
+
+        /*
+         * With an executor, a result is due this many microseconds after
+         * the loop iteration that produced it, by the class of its node:
+         * PD_FL_HIGH, neither, or PD_FL_BULK. Bulk results still run
+         * first once they have waited long enough, so no class starves.
+         * Zero picks POLLER_DUE_HIGH, POLLER_DUE_NORMAL and
+         * POLLER_DUE_BULK. Until one is set or a classed node is added,
+         * results take the executor's plain FIFO submit() instead.
+         */
+        int dueHigh;
+        int dueNormal;
+        int dueBulk;
+
+        /*
+         * send() flushes as soon as a queue holds this many bytes or
+         * messages. Zero disables the limit. Whatever is left is flushed
+         * at the end of the loop iteration.
+         */
+        size_t writeCorkBytes;
+        size_t writeCorkMessages;
+
+        /*
+         * Back-pressure on pending send() bytes, counted from the send()
+         * call on. send() fails with EAGAIN while its connection holds
+         * writeHighWatermark bytes or more, and while the poller-wide
+         * total is above its high watermark, until that total drains to
+         * the low one. Either way, a send() past the limit is the last
+         * one taken. A connection whose queue reaches the high watermark
+         * also reports PR_ST_BLOCKED, and PR_ST_RESUMED once it drains to
+         * the low watermark. Zero disables a high watermark.
+         */
+        size_t writeHighWatermark;
+        size_t writeLowWatermark;
+        size_t pollerWriteHighWatermark;
+        size_t pollerWriteLowWatermark;
+
+        /*
+         * Budgets for bytes held in inbound messages, per connection and
+         * for the whole poller. A connection over budget stops reading
+         * (EPOLLIN is dropped) until memory is released. A message that
+         * alone exceeds readBudget fails with EMSGSIZE. Arena messages are
+         * released once delivered. With a budget set, any other message
+         * stays charged until release() is called for it. Zero disables a
+         * budget.
+         */
+        size_t readBudget;
+        size_t pollerReadBudget;
+
+        /*
+         * A connection idle for this long (in milliseconds, up to twice
+         * that) gives back its read block, its empty send queue and its
+         * arena's chunks. They are taken again on the next event. Zero
+         * disables trimming.
+         */
+        int idleTrimTimeout;
+
+        /*
+         * Each connection reads readSizeMin bytes at first. The size
+         * doubles after a read that fills the buffer (straight to the
+         * FIONREAD count when more is pending) and halves after a read
+         * under a quarter of it, within these limits. The batch taken by
+         * one epoll_wait() adapts the same way between eventsMin and
+         * eventsMax. Zero picks POLLER_READ_MIN, POLLER_BUFSIZE,
+         * POLLER_EVENTS_MIN and POLLER_EVENTS_MAX.
+         */
+        size_t readSizeMin;
+        size_t readSizeMax;
+        int    eventsMin;
+        int    eventsMax;
+
+        /* Per-connection ring for PD_FL_RING, which bounds message size. */
+        size_t ringSize;
+
+        /*
+         * PP_MEM_LOCAL places the read buffer, and what the poller thread
+         * allocates (read blocks, rings, arena chunks, results), on the
+         * NUMA node the thread runs on when it starts. PP_MEM_HUGE backs
+         * the read buffer with huge pages: explicit ones if reserved,
+         * transparent ones otherwise.
+         *
+         * PP_MEM_PREFAULT touches the buffer, the thread stack and a full
+         * read block pool before the loop starts. PP_MEM_LOCK then calls
+         * mlockall(), for the whole process, so none of it faults again.
+         */
+#define PP_MEM_LOCAL 0x1
+#define PP_MEM_HUGE 0x2
+#define PP_MEM_PREFAULT 0x4
+#define PP_MEM_LOCK 0x8
+        int memoryFlags;
+
+        /*
+         * Applied by the poller thread to itself before its loop runs;
+         * start() fails, with their errno, if they cannot be. An empty
+         * cpu list leaves the affinity alone, and SCHED_OTHER with
+         * priority 0 leaves the scheduling alone.
+         */
+        std::vector<int> cpus;
+        int              schedPolicy;
+        int              schedPriority;
+
+        /*
+         * Leader/follower mode when above one: this many threads share the
+         * epoll instance. One of them, the leader, waits; it hands
+         * leadership on as soon as events come back, then does their I/O
+         * and runs the callbacks of what it read. Threads take the poller
+         * state only to claim events and to change what they share (the
+         * fd table, the timeout, paused and flush lists), never around a
+         * read, a parse or a callback. Fds are registered with
+         * EPOLLONESHOT and re-armed once the thread that took an event is
+         * done with the node, so a node is never handled by two threads at
+         * once, but one busy connection no longer holds up the others.
+         * Callbacks must be thread-safe, as with an executor, which this
+         * mode does not take, nor batchCallback. PD_FL_RING reads still
+         * run inline. setThreads() parks some of them while load is low.
+         */
+        int threads;
+};
+
+struct PollerStats
+{
+        size_t inboundBytes;  /* in messages, in progress or unreleased */
+        size_t outboundBytes; /* queued by send() */
+        size_t pausedReads;   /* connections stopped by a read budget */
+        size_t readCalls;     /* read() on stream sockets */
+        size_t readBytes;
+        size_t waitCalls;     /* epoll_wait() */
+        size_t ctlCalls;      /* epoll_ctl() on node fds */
+        size_t readSize;      /* last set by a read, on any connection */
+        size_t waitEvents;    /* asked of the last epoll_wait() */
+        size_t busyTime;      /* ns out of epoll_wait(), all threads */
+        size_t stateTime;     /* ns of it with the state lock held */
+};
+
+/*
+ * The first cache line holds everything an event touches: the result
+ * header, the data (operation, fd, callbacks, context), the epoll mask, the
+ * flags and the deadline. Index links and the spare result are cold.
+ */
+struct alignas(64) PollerNode
+{
+        int               state;
+        int               error;
+        struct PollerData data;
+        int               event;
+        unsigned int      inRbtree : 1;
+        unsigned int      removed : 1;
+        unsigned int      paused : 1;
+        unsigned int      active : 1;
+        unsigned int      trimQueued : 1;
+        unsigned int      held : 1; /* taken by a leader, not re-armed */
+        unsigned int      busy : 1; /* its handler runs off the state lock */
+        unsigned int      serial : 25; /* of the operation, see PollerHandle */
+        int64_t           deadline; /* CLOCK_MONOTONIC, in nanoseconds */
+
+        /* Once delivered, the links and res carry the executor task. */
+        union
+        {
+                struct list_head    list;
+                struct ExecutorTask task;
+        };
+        union
+        {
+                struct PollerNode *res;
+                Poller            *poller;
+        };
+        Arena              *arena; /* last arena a message came from */
+        union
+        {
+                struct IOBufBlock *readBlock; /* PD_FL_IOBUF */
+                RingBuffer        *ring;      /* PD_FL_RING */
+        };
+        struct PollerQueue *queue;
+        size_t              inbound; /* bytes charged to the connection */
+        unsigned int        readSize; /* next read, 0 before the first */
+        unsigned int        heat;     /* events, halved by each shed() */
 };
 
-struct PollerNode
+static_assert(std::is_trivially_copyable<struct PollerData>::value,
+              "PollerData is copied into results");
+static_assert(sizeof(struct PollerData) == 40, "PollerData grew");
+static_assert(offsetof(struct PollerNode, data) ==
+                      offsetof(struct PollerResult, data),
+              "a PollerNode must start with a PollerResult");
+static_assert(offsetof(struct PollerNode, deadline) + sizeof(int64_t) <= 64,
+              "the hot part of PollerNode must fit in one cache line");
+static_assert(alignof(struct PollerNode) == 64 &&
+                      sizeof(struct PollerNode) == 128,
+              "PollerNode must be two whole cache lines");
+
+/*
+ * One operation, as add() or addTimer() issued it. It stays the same
+ * through a mod() that switches a persistent node in place.
+ */
+struct PollerHandle
 {
-        int                state;
-        int                error;
-        struct PollerData  data;
+        struct PollerNode *node;
+        int                fd;
+        unsigned int       serial;
+};
+
+/*
+ * Add/del/mod requests from other threads are pushed onto a lock-free stack
+ * and applied by the poller thread, which is the only owner of the nodes,
+ * the fd table and the timeout index.
+ */
+struct PollerCommand
+{
+#define PC_CMD_ADD 0
+#define PC_CMD_DEL 1
+#define PC_CMD_MOD 2
+#define PC_CMD_TIMEOUT 3
+#define PC_CMD_STOP 4
+#define PC_CMD_SEND 5
+#define PC_CMD_RELEASE 6
+#define PC_CMD_ARENA 7
+#define PC_CMD_REARM 8
+#define PC_CMD_MIGRATE 9
+#define PC_CMD_ADOPT 10
+#define PC_CMD_SHED 11
+#define PC_CMD_CANCEL 12
+
+        int                   command;
+        int                   fd;
+        int                   timeout;
+        struct PollerNode    *node;
+        struct PollerCommand *next;
+        IOBuf                 buf;
+        size_t                bytes;
+        Arena                *arena;
+        struct PollerNode    *owner;      /* PC_CMD_RELEASE */
+        unsigned int          generation; /* REARM; epoch for RELEASE, ADOPT;
+                                             serial for DEL, CANCEL */
+        Poller               *target;     /* PC_CMD_MIGRATE, PC_CMD_SHED */
+        double                share;      /* PC_CMD_SHED */
+};
+
+/*
+ * Outbound queue of a connection, created by its first send(). Sends are
+ * coalesced into one writev() of up to IOV_MAX slices; while corked the
+ * queue sits on the poller's flush list until the loop iteration ends.
+ */
+struct PollerQueue
+{
+        IOBuf              buf;
+        size_t             messages;
         struct list_head   list;
-        char               inRbtree;
-        char               removed;
-        int                event;
-        struct timespec    timeout;
-        struct PollerNode *res;
+        struct PollerNode *node;
+        char               corked;
+        char               waiting; /* for EPOLLOUT */
+        char               blocked; /* above the high watermark */
+};
+
+/*
+ * What a poller thread keeps to itself. In leader/follower mode handlers
+ * run off the state lock, several at once, so nothing here is shared.
+ */
+struct PollerLocal
+{
+        Poller                             *poller;
+        char                               *buf;   /* read buffer */
+        int                                 hotFd; /* whose handler runs */
+        std::vector<struct PollerCommand *> deferred; /* for hotFd */
+        std::vector<struct PollerNode *>    ready;    /* to run after it */
+        std::vector<struct epoll_event>     busy;     /* taken, to handle */
+        std::vector<struct PollerCommand *> held;     /* their re-arms */
+        std::vector<struct PollerResult *>  results;
+        std::vector<IOBufBlock *>           blockPool;
+        std::vector<RingBuffer *>           dropRings; /* to delete */
 };
 
 inline PollerResult *castPollerNodeToResult(struct PollerNode *node)
@@ -112,14 +465,92 @@ class Poller
     public:
         explicit Poller(const struct PollerParams *params);
 
+        /* Stops first; not from a poller thread, as stop(). */
+        ~Poller();
+
         int start();
 
+        /*
+         * Nodes still in, and any a callback adds meanwhile, come back
+         * with PR_ST_STOPPED. -1 with errno EDEADLK from a poller thread,
+         * that is from a callback not run by an executor.
+         */
+        int stop();
+
+        /* With handle, records the operation for cancel(). */
+        int add(const struct PollerData *data, int timeout,
+                struct PollerHandle *handle = nullptr);
+
+        int addBatch(const struct PollerData *data, int n, int timeout);
+
+        int del(int fd);
+
+        int mod(const struct PollerData *data, int timeout);
+
+        int setTimeout(int fd, int timeout);
+
+        int setTimeoutBatch(const int *fds, int n, int timeout);
+
+        int addTimer(int timeout, void *context,
+                     struct PollerHandle *handle = nullptr);
+
+        /*
+         * Removes the node of the operation handle names, which comes back
+         * with PR_ST_DELETED, as del() does. If that operation is over, a
+         * later one on the same fd, or at the same address, is left alone.
+         * For a timer, costs a walk over the nodes.
+         */
+        int cancel(const struct PollerHandle *handle);
+
+        int send(int fd, IOBuf *buf);
+
+        int release(const struct PollerResult *res);
+
+        void getStats(struct PollerStats *stats) const;
+
+        /*
+         * Moves the node of fd to another running poller, with its partial
+         * message, read buffer, send queue, budget charges and deadline.
+         * Nothing is read twice or dropped: the fd leaves this epoll
+         * instance before it joins the other. Commands for fd that still
+         * reach this poller afterwards (send(), del(), release()...) are
+         * forwarded, in order, until fd is added here again. Results come
+         * from the other poller from then on, so pollers sharing nodes
+         * should share a callback.
+         */
+        int migrate(int fd, Poller *to);
+
+        /*
+         * Migrates connections carrying about share of this poller's
+         * recent events (see PollerNode::heat) to another poller, hottest
+         * first, skipping any that alone would overshoot.
+         */
+        int shed(double share, Poller *to);
+
+        /*
+         * Leader/follower mode: only the first n threads take the lead,
+         * the others park, off the CPU, until n covers them again. n is
+         * between 1 and PollerParams.threads, or EINVAL. start() runs
+         * them all.
+         */
+        int setThreads(int n);
+
+        int threads() const;
+
         int pfd() const { return m_pfd; }
 
+        int ctl(int op, int fd, int event, void *data);
+
         void handleRead(struct PollerNode *node);
 
         void handleWrite(struct PollerNode *node);
 
+        void handleReadBuf(struct PollerNode *node);
+
+        void handleReadRing(struct PollerNode *node);
+
+        void handleWriteBuf(struct PollerNode *node);
+
         void handleListen(struct PollerNode *node);
 
         void handleConnect(struct PollerNode *node);
@@ -132,14 +563,44 @@ class Poller
 
         void handleNotify(struct PollerNode *node);
 
-        int handlePipe() const;
+        void handleIdle(struct PollerNode *node);
+
+        int handlePipe();
 
         int removeNode(struct PollerNode *node);
 
         int appendMessage(const void *buf, size_t *n,
-                          struct PollerNode *node) const;
+                          struct PollerNode *node);
+
+        int appendBufMessage(IOBuf *buf, struct PollerNode *node);
+
+        void *threadRoutine(int index);
+
+        void rankEvents(struct epoll_event *events, int n);
+
+        void park(int index);
+
+        void holdNode(struct PollerNode *node);
 
-        void *threadRoutine();
+        void *eventData(const struct PollerNode *node) const;
+
+        struct PollerNode *eventNode(const struct epoll_event *event) const;
+
+        void follow(std::vector<struct PollerResult *> *results);
+
+        void lockState();
+
+        void unlockState();
+
+        bool parkCommand(struct PollerCommand *cmd);
+
+        void runParked();
+
+        static void runResult(struct ExecutorTask *task);
+
+        int setupThread(int index);
+
+        void prefault();
 
         void setTimer();
 
@@ -149,13 +610,161 @@ class Poller
 
 
     private:
+        /*
+         * The state lock, around what a handler running off it changes in
+         * the poller; nothing when this thread has the state already.
+         */
+        class StateLock
+        {
+            public:
+                explicit StateLock(Poller *poller);
+
+                ~StateLock();
+
+            private:
+                Poller *m_poller;
+        };
+
+        struct PollerLocal *local();
+
+        void submit(struct PollerCommand *first, struct PollerCommand *last);
+
+        int execute(struct PollerCommand *cmd);
+
+        void insertNode(struct PollerNode *node, int timeout, int op);
+
+        void retireNode(struct PollerNode *node, int state, int error);
+
+        void reclaimNodes();
+
+        void detachNode(struct PollerNode *node, Poller *to);
+
+        void adoptNode(struct PollerNode *node, int timed, unsigned int epoch);
+
+        void forward(struct PollerCommand *cmd, Poller *to);
+
+        void handOff();
+
+        void shedNodes(double share, Poller *to);
+
+        void cancelTimer(const struct PollerCommand *cmd);
+
+        void deliver(struct PollerNode *node);
+
+        PollerMessage *nodeMessage(struct PollerNode *node);
+
+        void finishMessage(struct PollerNode *node);
+
+        void flushResults();
+
+        void dispatchNode(struct PollerNode *node, int events);
+
+        void wakeNode(struct PollerNode *node);
+
+        void handleNode(struct PollerNode *node, int events);
+
+        void switchNode(struct PollerNode *node, struct PollerNode *newNode,
+                        int timeout);
+
+        void idleNode(struct PollerNode *node, int state, int error);
+
+        int updateEvent(struct PollerNode *node);
+
+        void queueNode(struct PollerNode *node, IOBuf *buf);
+
+        int flushQueue(struct PollerNode *node);
+
+        void flushCorked();
+
+        void notifyQueue(const struct PollerNode *node, int state);
+
+        void checkWatermark();
+
+        int chargeSend(int fd, size_t n);
+
+        void addPending(int fd, size_t n);
+
+        void dropPending(int fd, size_t n);
+
+        void chargeMessage(struct PollerNode *node, PollerMessage *msg,
+                           size_t n);
+
+        int checkBudget(struct PollerNode *node);
+
+        void uncharge(struct PollerNode *node, size_t n);
+
+        void resumeNodes();
+
+        void touchNode(struct PollerNode *node);
+
+        void trimNodes(int64_t now);
+
+        void trimNode(struct PollerNode *node);
+
+        IOBufBlock *getReadBlock(size_t size);
+
+        size_t readSize(struct PollerNode *node) const;
+
+        void countRead(ssize_t n);
+
+        void adaptRead(struct PollerNode *node, size_t size, ssize_t n);
+
+        void putReadBlock(IOBufBlock *block);
+
+        void dropReadBuffer(struct PollerNode *node);
+
+        struct PollerCommand *newCommand(int command, int fd, int timeout,
+                                         const struct PollerData *data);
+
         typedef std::vector<struct PollerNode *> PollerNodePtrList;
 
         size_t                                             m_maxOpenFiles;
         std::function<void(struct PollerResult *, void *)> m_callback;
-        void                                              *m_context;
-
-        std::unique_ptr<std::thread> m_thread;
+        std::function<void(struct PollerResult **, size_t, void *)>
+                m_batchCallback;
+        void     *m_context;
+        Executor *m_executor;
+        size_t m_corkBytes;
+        size_t m_corkMessages;
+        size_t m_highWatermark;
+        size_t m_lowWatermark;
+        size_t m_pollerHighWatermark;
+        size_t m_pollerLowWatermark;
+        size_t m_readBudget;
+        size_t m_pollerReadBudget;
+        std::atomic<size_t> m_retainedBytes;
+        int    m_idleTrim;
+        size_t m_readMin;
+        size_t m_readMax;
+        int    m_eventsMin;
+        int    m_eventsMax;
+        size_t m_ringSize;
+        int    m_memoryFlags;
+        int    m_schedPolicy;
+        int    m_schedPriority;
+
+        std::vector<int> m_cpus;
+        int64_t m_nextTrim;
+        int64_t m_loopTime; /* when this loop iteration began */
+        int64_t m_due[3];   /* by class, in nanoseconds */
+        bool    m_dueSet;   /* dueHigh, dueNormal or dueBulk was given */
+        int     m_classed;  /* a PD_FL_HIGH or PD_FL_BULK node was added */
+
+        std::vector<struct epoll_event> m_ranked;
+
+        /* One per thread; the first is also stop()'s. */
+        std::unique_ptr<struct PollerLocal[]> m_locals;
+
+        std::vector<std::thread>     m_threads;
+        int                          m_nthreads;
+        int                          m_oneshot; /* EPOLLONESHOT or 0 */
+        std::atomic<int>             m_leaving;
+        std::mutex                   m_leader; /* held across epoll_wait() */
+        std::mutex                   m_state;  /* held for shared updates */
+        int64_t                      m_lockedAt;
+        std::atomic<int>             m_active; /* threads allowed to lead */
+        std::mutex                   m_parkMutex;
+        std::condition_variable      m_parkCond;
         int                          m_pfd;
         int                          m_timerfd;
         int                          m_pipeRead;
@@ -166,9 +775,50 @@ class Poller
         // struct rb_node              *m_treeLast;
         struct list_head  m_timeoutList;
         struct list_head  m_nonTimeoutList;
+        struct list_head  m_retiredList;
+        struct list_head  m_flushList;
         PollerNodePtrList m_nodes;
-        std::mutex        m_mutex;
-        char              m_buf[POLLER_BUFSIZE];
+        PollerNodePtrList m_pausedNodes;
+        std::vector<int>  m_trimFds;
+
+        /*
+         * Leader/follower: commands for busy nodes, spent re-arms to reuse,
+         * and m_nodes versions, which tag the events.
+         */
+        std::vector<struct PollerCommand *> m_parked;
+        struct PollerCommand               *m_spareRearms;
+        std::vector<unsigned int>           m_generations;
+
+        /* By fd, bumped by each new node; a migrated node keeps its own. */
+        std::vector<unsigned int> m_epochs;
+
+        /* Migrated fds, and their adoptions sent at the iteration end. */
+        std::unordered_map<int, Poller *>   m_moved;
+        std::vector<struct PollerCommand *> m_handOffs;
+
+        std::vector<Arena *>      m_arenas;
+        std::vector<RingBuffer *> m_rings; /* to release */
+
+        /* send() bytes not written yet, by fd with writeHighWatermark. */
+        std::unique_ptr<std::atomic<size_t>[]> m_fdPending;
+
+        std::atomic<size_t>                 m_pendingBytes;
+        std::atomic<size_t>                 m_inboundBytes;
+        std::atomic<size_t>                 m_pausedReads;
+        std::atomic<size_t>                 m_readCalls;
+        std::atomic<size_t>                 m_readBytes;
+        std::atomic<size_t>                 m_waitCalls;
+        std::atomic<size_t>                 m_ctlCalls;
+        std::atomic<size_t>                 m_readSize;
+        std::atomic<size_t>                 m_waitEvents;
+        std::atomic<size_t>                 m_busyTime;
+        std::atomic<size_t>                 m_stateTime;
+        std::atomic<size_t>                 m_inflight; /* on the executor */
+        std::atomic<bool>                   m_writeBlocked;
+        std::atomic<struct PollerCommand *> m_commands;
+        std::atomic<std::thread::id>        m_threadId;
+
+        size_t m_bufSize;
 };
 
 #endif // POLLER_H
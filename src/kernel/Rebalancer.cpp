@@ -0,0 +1,70 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include "Rebalancer.h"
+
+Rebalancer::Rebalancer(const std::vector<Poller *>     &pollers,
+                       const struct RebalancerParams *params) :
+        PeriodicController(pick(params->interval, REBALANCER_INTERVAL)),
+        m_pollers(pollers), m_last(pollers.size()), m_busy(pollers.size())
+{
+        m_highBusy = pick(params->highBusy, REBALANCER_HIGH_BUSY);
+        m_minGap   = pick(params->minGap, REBALANCER_MIN_GAP);
+}
+
+Rebalancer::~Rebalancer()
+{
+        this->stop();
+}
+
+int Rebalancer::balance(const std::vector<double> &busy)
+{
+        size_t hi = 0;
+        size_t lo = 0;
+
+        for (size_t i = 1; i < busy.size(); i++)
+        {
+                if (busy[i] > busy[hi])
+                        hi = i;
+
+                if (busy[i] < busy[lo])
+                        lo = i;
+        }
+
+        if (busy.empty() || busy[hi] < m_highBusy ||
+            busy[hi] - busy[lo] < m_minGap)
+                return 0;
+
+        /* Shares are of the busy poller's events: even the two out. */
+        if (m_pollers[hi]->shed((busy[hi] - busy[lo]) / (2 * busy[hi]),
+                                m_pollers[lo]) < 0)
+                return 0;
+
+        return 1;
+}
+
+void Rebalancer::begin()
+{
+        struct PollerStats stats;
+
+        for (size_t i = 0; i < m_pollers.size(); i++)
+        {
+                m_pollers[i]->getStats(&stats);
+                m_last[i] = stats.busyTime;
+        }
+}
+
+void Rebalancer::pass(const double wall)
+{
+        struct PollerStats stats;
+
+        for (size_t i = 0; i < m_pollers.size(); i++)
+        {
+                m_pollers[i]->getStats(&stats);
+                m_busy[i] = (stats.busyTime - m_last[i]) / wall;
+                m_last[i] = stats.busyTime;
+        }
+
+        this->balance(m_busy);
+}
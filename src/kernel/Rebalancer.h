@@ -0,0 +1,63 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef REBALANCER_H
+#define REBALANCER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PeriodicController.h"
+#include "Poller.h"
+
+#define REBALANCER_INTERVAL 1000
+#define REBALANCER_HIGH_BUSY 0.75
+#define REBALANCER_MIN_GAP 0.2
+
+struct RebalancerParams
+{
+        int    interval; /* milliseconds between passes */
+        double highBusy; /* a poller this busy (0 to 1) sheds... */
+        double minGap;   /* ...to the idlest, if that is this much less */
+};
+
+/*
+ * Background load balancing for fds sharded over single-threaded pollers.
+ * Every interval it samples each poller's busy time (PollerStats) and,
+ * when the busiest is over highBusy and ahead of the idlest by minGap,
+ * asks it to shed half the difference, by recent events, to the idlest.
+ * One move per pass, so a skew is corrected over a few intervals rather
+ * than overshot. Zero fields pick the REBALANCER_* defaults.
+ *
+ * The pollers must be running, and must outlive the rebalancer.
+ */
+class Rebalancer final : public PeriodicController
+{
+    public:
+        Rebalancer(const std::vector<Poller *> &pollers,
+                   const struct RebalancerParams *params);
+
+        ~Rebalancer();
+
+        Rebalancer(const Rebalancer &) = delete;
+
+        Rebalancer &operator=(const Rebalancer &) = delete;
+
+        /* One pass, given each poller's busy fraction. Returns the sheds. */
+        int balance(const std::vector<double> &busy);
+
+    private:
+        void begin() override;
+
+        void pass(double wall) override;
+
+        std::vector<Poller *> m_pollers;
+        double                m_highBusy;
+        double                m_minGap;
+        std::vector<size_t>   m_last; /* busy time at the last pass */
+        std::vector<double>   m_busy;
+};
+
+#endif // REBALANCER_H
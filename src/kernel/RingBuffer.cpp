@@ -0,0 +1,67 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <errno.h>
+
+#include "RingBuffer.h"
+
+RingBuffer::RingBuffer(char *base, const size_t size) :
+        m_base(base), m_mask(size - 1), m_head(0), m_parse(0), m_tail(0)
+{
+}
+
+RingBuffer::~RingBuffer()
+{
+        munmap(m_base, 2 * this->capacity());
+}
+
+RingBuffer *RingBuffer::create(const size_t size)
+{
+        size_t      cap = sysconf(_SC_PAGESIZE);
+        char       *base;
+        int         fd;
+        int         error;
+
+        while (cap < size)
+                cap *= 2;
+
+        fd = memfd_create("ring", MFD_CLOEXEC);
+        if (fd < 0)
+                return nullptr;
+
+        base = static_cast<char *>(MAP_FAILED);
+        if (ftruncate(fd, cap) >= 0)
+        {
+                /* Reserve both halves, then map the same pages into each. */
+                base = static_cast<char *>(mmap(nullptr, 2 * cap, PROT_NONE,
+                                                MAP_PRIVATE | MAP_ANONYMOUS,
+                                                -1, 0));
+                if (base != MAP_FAILED)
+                {
+                        if (mmap(base, cap, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED ||
+                            mmap(base + cap, cap, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED)
+                        {
+                                error = errno;
+                                munmap(base, 2 * cap);
+                                errno = error;
+                                base  = static_cast<char *>(MAP_FAILED);
+                        }
+                }
+        }
+
+        error = errno;
+        close(fd);
+        if (base == MAP_FAILED)
+        {
+                errno = error;
+                return nullptr;
+        }
+
+        return new RingBuffer(base, cap);
+}
@@ -0,0 +1,63 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <cstddef>
+
+#define RING_BUFFER_SIZE (64 * 1024)
+
+/*
+ * A ring whose pages are mapped twice, back to back, so any run of up to
+ * capacity() bytes is contiguous in memory, across the wrap as well. Data
+ * is read in at the tail, parsed from the middle, and dropped from the
+ * head only when the message it belongs to is done; parsers can keep
+ * pointers into it until then, and nothing is ever compacted.
+ *
+ *     head         parse            tail
+ *      | retained   | readable       | writable ...
+ */
+class RingBuffer
+{
+    public:
+        /* size is rounded up to a power of two of at least one page. */
+        static RingBuffer *create(size_t size);
+
+        ~RingBuffer();
+
+        RingBuffer(const RingBuffer &) = delete;
+
+        RingBuffer &operator=(const RingBuffer &) = delete;
+
+        char *writePtr() const { return m_base + (m_tail & m_mask); }
+
+        size_t writable() const { return m_mask + 1 - (m_tail - m_head); }
+
+        void produce(size_t n) { m_tail += n; }
+
+        char *readPtr() const { return m_base + (m_parse & m_mask); }
+
+        size_t readable() const { return m_tail - m_parse; }
+
+        void consume(size_t n) { m_parse += n; }
+
+        /* Drops everything parsed so far. */
+        void release() { m_head = m_parse; }
+
+        bool empty() const { return m_head == m_tail; }
+
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        RingBuffer(char *base, size_t size);
+
+        char  *m_base;
+        size_t m_mask;
+        size_t m_head;
+        size_t m_parse;
+        size_t m_tail;
+};
+
+#endif // RINGBUFFER_H
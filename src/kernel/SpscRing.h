@@ -0,0 +1,90 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+/*
+ * Bounded single-producer single-consumer queue. Each side keeps its own
+ * index on its own cache line together with a cached copy of the other
+ * side's, so in steady state push() and pop() touch no line the other
+ * thread writes.
+ */
+template <class T> class SpscRing
+{
+    public:
+        /* Rounded up to a power of two. */
+        explicit SpscRing(size_t size)
+            : m_head(0), m_tailCache(0), m_tail(0), m_headCache(0)
+        {
+                size_t n = 1;
+
+                while (n < size)
+                        n <<= 1;
+
+                m_mask = n - 1;
+                m_slots.reset(new T[n]);
+        }
+
+        SpscRing(const SpscRing &) = delete;
+
+        SpscRing &operator=(const SpscRing &) = delete;
+
+        /* Producer only. False when full. */
+        bool push(const T &item)
+        {
+                const size_t tail = m_tail.load(std::memory_order_relaxed);
+
+                if (tail - m_headCache > m_mask)
+                {
+                        m_headCache = m_head.load(std::memory_order_acquire);
+                        if (tail - m_headCache > m_mask)
+                                return false;
+                }
+
+                m_slots[tail & m_mask] = item;
+                m_tail.store(tail + 1, std::memory_order_release);
+                return true;
+        }
+
+        /* Consumer only. False when empty. */
+        bool pop(T *item)
+        {
+                const size_t head = m_head.load(std::memory_order_relaxed);
+
+                if (head == m_tailCache)
+                {
+                        m_tailCache = m_tail.load(std::memory_order_acquire);
+                        if (head == m_tailCache)
+                                return false;
+                }
+
+                *item = m_slots[head & m_mask];
+                m_head.store(head + 1, std::memory_order_release);
+                return true;
+        }
+
+        /* Either side; a hint unless called by the consumer. */
+        bool empty() const
+        {
+                return m_head.load(std::memory_order_acquire) ==
+                       m_tail.load(std::memory_order_acquire);
+        }
+
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        alignas(64) std::atomic<size_t> m_head; /* consumer */
+        size_t m_tailCache;
+        alignas(64) std::atomic<size_t> m_tail; /* producer */
+        size_t m_headCache;
+        alignas(64) size_t m_mask;
+        std::unique_ptr<T[]> m_slots;
+};
+
+#endif // SPSCRING_H
@@ -0,0 +1,81 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <algorithm>
+#include <cerrno>
+
+#include "CancelToken.h"
+
+CancelToken::CancelToken(CancelToken *parent) :
+        m_parent(parent), m_cancelled(false)
+{
+        INIT_LIST_HEAD(&m_hooks);
+        if (parent)
+        {
+                std::lock_guard<std::mutex> lock(parent->m_mutex);
+
+                parent->m_children.push_back(this);
+                m_cancelled.store(parent->isCancelled(),
+                                  std::memory_order_release);
+        }
+}
+
+CancelToken::~CancelToken()
+{
+        if (m_parent)
+        {
+                std::lock_guard<std::mutex> lock(m_parent->m_mutex);
+                std::vector<CancelToken *> &siblings = m_parent->m_children;
+
+                siblings.erase(std::find(siblings.begin(), siblings.end(),
+                                         this));
+        }
+}
+
+/* Parents lock before children, never the other way round. */
+void CancelToken::cancel()
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+        struct CancelHook          *hook;
+        struct list_head           *pos;
+
+        if (this->isCancelled())
+                return;
+
+        m_cancelled.store(true, std::memory_order_release);
+        list_for_each(pos, &m_hooks)
+        {
+                hook = list_entry(pos, struct CancelHook, list);
+                hook->cancel(hook);
+        }
+
+        for (CancelToken *child : m_children)
+                child->cancel();
+}
+
+int CancelToken::addHook(struct CancelHook *hook,
+                         const std::function<int()> &start)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (this->isCancelled())
+        {
+                errno = ECANCELED;
+                return -1;
+        }
+
+        if (start() < 0)
+                return -1;
+
+        list_add_tail(&hook->list, &m_hooks);
+        return 0;
+}
+
+void CancelToken::removeHook(struct CancelHook *hook)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        list_del(&hook->list);
+        INIT_LIST_HEAD(&hook->list);
+}
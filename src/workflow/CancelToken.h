@@ -0,0 +1,77 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef CANCELTOKEN_H
+#define CANCELTOKEN_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "List.h"
+
+/*
+ * Kept by a token while a task has work out. cancel is called with the
+ * token locked: it must only ask for the work to stop, as Poller::cancel()
+ * does, and not finish the task itself. list must be initialized.
+ */
+struct CancelHook
+{
+        struct list_head list;
+        void (*cancel)(struct CancelHook *hook);
+        void *context;
+};
+
+/*
+ * Set on a series (SeriesWork::setCancelToken()), a token covers its tasks
+ * and those of any series nested under it through a ParallelWork, unless
+ * those have a token of their own. cancel() stops the poller operations
+ * they have out at once, with their fds and buffers, and tasks dispatched
+ * afterwards finish without starting. Either way they end in PR_ST_ERROR
+ * with ECANCELED, and their series go on to their callbacks as usual.
+ *
+ * A token made with a parent is cancelled along with it, so a request's
+ * token can be cancelled whole while a hedge's child token is cancelled
+ * alone. Tokens must outlive the series they are set on, and a parent
+ * its children.
+ */
+class CancelToken
+{
+    public:
+        explicit CancelToken(CancelToken *parent = nullptr);
+
+        ~CancelToken();
+
+        CancelToken(const CancelToken &) = delete;
+
+        CancelToken &operator=(const CancelToken &) = delete;
+
+        void cancel();
+
+        bool isCancelled() const
+        {
+                return m_cancelled.load(std::memory_order_acquire);
+        }
+
+        /*
+         * Calls start, which issues the work, and keeps hook if it
+         * returns 0. Both happen with the token locked, so a cancel()
+         * meanwhile calls hook only once the work is out. Returns what
+         * start does, or -1 with errno ECANCELED if cancelled already.
+         */
+        int addHook(struct CancelHook *hook, const std::function<int()> &start);
+
+        /* Once this returns, hook will not be called. Kept or not. */
+        void removeHook(struct CancelHook *hook);
+
+    private:
+        CancelToken               *m_parent;
+        std::vector<CancelToken *> m_children;
+        struct list_head           m_hooks;
+        std::atomic<bool>          m_cancelled;
+        std::mutex                 m_mutex;
+};
+
+#endif // CANCELTOKEN_H
@@ -0,0 +1,331 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+
+#include "CoreRuntime.h"
+
+namespace
+{
+        thread_local void *__core_current;
+} // namespace
+
+CoreRuntime::CoreRuntime(const struct CoreParams *params) : m_pin(params->pin)
+{
+        const int    n    = params->cores > 0
+                                    ? params->cores
+                                    : (int) sysconf(_SC_NPROCESSORS_ONLN);
+        const size_t size = params->ringSize ? params->ringSize
+                                             : CORE_RING_SIZE;
+
+        for (int i = 0; i < n; i++)
+        {
+                struct PollerParams pp   = {};
+                struct Core        *core = new Core();
+
+                m_cores.emplace_back(core);
+                core->runtime      = this;
+                core->index        = i;
+                core->eventFd      = -1;
+                core->injected     = nullptr;
+                core->injectedTail = &core->injected;
+                for (int j = 0; j < n; j++)
+                        core->inbound.emplace_back(
+                                new SpscRing<struct ExecutorTask *>(size));
+
+                pp.maxOpenFiles = params->maxOpenFiles;
+                pp.callback     = CoreRuntime::handle;
+                if (m_pin)
+                        pp.cpus = {i};
+
+                core->poller.reset(new Poller(&pp));
+        }
+}
+
+CoreRuntime::~CoreRuntime() = default;
+
+void CoreRuntime::handle(struct PollerResult *res, void *)
+{
+        static_cast<PollerTask *>(res->data.context)->handle(res);
+        delete reinterpret_cast<struct PollerNode *>(res);
+}
+
+int CoreRuntime::start()
+{
+        struct PollerData data = {};
+        struct Core      *core;
+        int               i;
+
+        for (i = 0; i < this->cores(); i++)
+        {
+                core          = m_cores[i].get();
+                core->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if (core->eventFd < 0)
+                        break;
+
+                data.operation = PD_OP_EVENT;
+                data.flags     = PD_FL_QUIET;
+                data.fd        = core->eventFd;
+                data.event     = CoreRuntime::drain;
+                data.context   = static_cast<PollerTask *>(core);
+                core->armed.store(true, std::memory_order_relaxed);
+                if (core->poller->start() < 0)
+                {
+                        close(core->eventFd);
+                        break;
+                }
+
+                if (core->poller->add(&data, -1) < 0)
+                {
+                        core->poller->stop();
+                        close(core->eventFd);
+                        break;
+                }
+        }
+
+        if (i == this->cores())
+                return 0;
+
+        m_cores[i]->eventFd = -1;
+        while (--i >= 0)
+        {
+                m_cores[i]->poller->stop();
+                close(m_cores[i]->eventFd);
+                m_cores[i]->eventFd = -1;
+        }
+
+        return -1;
+}
+
+int CoreRuntime::stop()
+{
+        std::vector<bool> stopped(m_cores.size(), false);
+        int               ret = 0;
+
+        /* Its poller would go on, and its rings get a second consumer. */
+        if (this->currentCore() >= 0)
+        {
+                errno = EDEADLK;
+                return -1;
+        }
+
+        for (size_t i = 0; i < m_cores.size(); i++)
+        {
+                if (m_cores[i]->poller->stop() < 0)
+                        ret = -1;
+                else
+                        stopped[i] = true;
+        }
+
+        for (size_t i = 0; i < m_cores.size(); i++)
+        {
+                struct Core *core = m_cores[i].get();
+
+                /* Still running: its rings and fds are still its own. */
+                if (!stopped[i])
+                        continue;
+
+                while (CoreRuntime::runQueued(core, SIZE_MAX) > 0)
+                        ;
+
+                for (int fd : core->listenFds)
+                        close(fd);
+
+                core->listenFds.clear();
+                close(core->eventFd);
+                core->eventFd = -1;
+        }
+
+        return ret;
+}
+
+int CoreRuntime::currentCore() const
+{
+        const struct Core *core = static_cast<struct Core *>(__core_current);
+
+        return core && core->runtime == this ? core->index : -1;
+}
+
+int CoreRuntime::post(const int core, struct ExecutorTask *task)
+{
+        struct Core *to   = m_cores[core].get();
+        const int    from = this->currentCore();
+
+        if (from >= 0)
+        {
+                if (!to->inbound[from]->push(task))
+                {
+                        errno = EAGAIN;
+                        return -1;
+                }
+        } else
+        {
+                std::lock_guard<std::mutex> lock(to->mutex);
+
+                task->next        = nullptr;
+                *to->injectedTail = task;
+                to->injectedTail  = &task->next;
+        }
+
+        this->wake(to);
+        return 0;
+}
+
+void CoreRuntime::wake(struct Core *core)
+{
+        const uint64_t one = 1;
+
+        /* Pairs with the fence in drain(), after it arms. */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (core->armed.load(std::memory_order_relaxed) &&
+            core->armed.exchange(false, std::memory_order_relaxed))
+        {
+                if (write(core->eventFd, &one, sizeof one) < 0)
+                        core->armed.store(true, std::memory_order_relaxed);
+        }
+}
+
+size_t CoreRuntime::runQueued(struct Core *core, const size_t max)
+{
+        struct ExecutorTask *task;
+        struct ExecutorTask *next;
+        size_t               n = 0;
+
+        for (auto &ring : core->inbound)
+        {
+                while (n < max && ring->pop(&task))
+                {
+                        task->routine(task);
+                        n++;
+                }
+        }
+
+        {
+                std::lock_guard<std::mutex> lock(core->mutex);
+
+                task               = core->injected;
+                core->injected     = nullptr;
+                core->injectedTail = &core->injected;
+        }
+
+        for (; task; task = next)
+        {
+                next = task->next;
+                task->routine(task);
+                n++;
+        }
+
+        return n;
+}
+
+bool CoreRuntime::hasQueued(struct Core *core)
+{
+        for (auto &ring : core->inbound)
+        {
+                if (!ring->empty())
+                        return true;
+        }
+
+        std::lock_guard<std::mutex> lock(core->mutex);
+
+        return core->injected != nullptr;
+}
+
+/* The doorbell rang: runs on the core's own thread. */
+void *CoreRuntime::drain(void *context)
+{
+        PollerTask    *handler = static_cast<PollerTask *>(context);
+        struct Core   *core    = static_cast<struct Core *>(handler);
+        const uint64_t one     = 1;
+        size_t         total   = 0;
+        size_t         n;
+
+        __core_current = core;
+        while (1)
+        {
+                n = CoreRuntime::runQueued(core, CORE_DRAIN_MAX - total);
+                total += n;
+                if (total >= CORE_DRAIN_MAX)
+                        break;
+
+                if (n > 0)
+                        continue;
+
+                /* Arm, then look once more for a post that missed it. */
+                core->armed.store(true, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!CoreRuntime::hasQueued(core))
+                        return context;
+
+                if (!core->armed.exchange(false, std::memory_order_relaxed))
+                        return context; /* a producer rang already */
+        }
+
+        /* Still busy: ring ourselves and let a round of I/O in first. */
+        if (write(core->eventFd, &one, sizeof one) < 0)
+                core->armed.store(true, std::memory_order_relaxed);
+
+        return context;
+}
+
+int CoreRuntime::listen(struct sockaddr *addr, const socklen_t addrlen,
+                        CoreAccept accept)
+{
+        struct PollerData data = {};
+        socklen_t         len;
+        const int         on = 1;
+        int               fd;
+
+        for (auto &core : m_cores)
+        {
+                fd = socket(addr->sa_family,
+                            SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+                if (fd < 0)
+                        return -1;
+
+                len = addrlen;
+                if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on,
+                               sizeof on) < 0 ||
+                    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on,
+                               sizeof on) < 0 ||
+                    bind(fd, addr, addrlen) < 0 ||
+                    ::listen(fd, SOMAXCONN) < 0 ||
+                    getsockname(fd, addr, &len) < 0)
+                {
+                        close(fd);
+                        return -1;
+                }
+
+                /* Port 0 is resolved by the first bind; the rest share it. */
+                struct Listener *listener = new Listener();
+
+                m_listeners.emplace_back(listener);
+                listener->core   = core.get();
+                listener->accept = accept;
+                data.operation   = PD_OP_LISTEN;
+                data.fd          = fd;
+                data.accept      = CoreRuntime::acceptFd;
+                data.context     = static_cast<PollerTask *>(listener);
+                core->listenFds.push_back(fd);
+                if (core->poller->add(&data, -1) < 0)
+                        return -1;
+        }
+
+        return 0;
+}
+
+void *CoreRuntime::acceptFd(const struct sockaddr *, socklen_t, const int fd,
+                            void *context)
+{
+        PollerTask      *handler  = static_cast<PollerTask *>(context);
+        struct Listener *listener = static_cast<struct Listener *>(handler);
+
+        __core_current = listener->core;
+        listener->accept(listener->core->index, fd);
+        return context;
+}
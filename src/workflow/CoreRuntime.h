@@ -0,0 +1,133 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef CORERUNTIME_H
+#define CORERUNTIME_H
+
+#include <sys/socket.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Executor.h"
+#include "Poller.h"
+#include "SpscRing.h"
+#include "TaskScheduler.h"
+
+#define CORE_RING_SIZE 1024
+#define CORE_DRAIN_MAX 4096 /* tasks per wakeup before yielding to I/O */
+
+struct CoreParams
+{
+        int    cores;    /* zero: one per online CPU */
+        size_t ringSize; /* per pair of cores; zero: CORE_RING_SIZE */
+        size_t maxOpenFiles;
+        bool   pin; /* core i runs on CPU i */
+};
+
+/* Runs on the core that accepted fd. */
+using CoreAccept = std::function<void(int core, int fd)>;
+
+/*
+ * Thread-per-core, shared-nothing runtime. Each core is one Poller
+ * thread that owns its fds, its timers, its task free lists (they are
+ * per thread) and its run queue. Nothing is locked between cores: core
+ * i reaches core j only through the bounded SPSC ring from i to j, which
+ * j drains from its own loop. A core that is idle in epoll_wait arms an
+ * eventfd doorbell; producers ring it only while armed, so a busy core
+ * takes no wakeup syscalls.
+ *
+ * Threads that are not cores post through a small locked list instead.
+ * Poller results are handled like TaskScheduler's: context is a
+ * PollerTask.
+ */
+class CoreRuntime
+{
+    public:
+        explicit CoreRuntime(const struct CoreParams *params);
+
+        ~CoreRuntime();
+
+        CoreRuntime(const CoreRuntime &) = delete;
+
+        CoreRuntime &operator=(const CoreRuntime &) = delete;
+
+        int start();
+
+        /*
+         * Tasks still queued are run on the calling thread. -1 with errno
+         * EDEADLK from a core thread, as Poller::stop(), and nothing is
+         * stopped. A core whose poller fails to stop is left as it is.
+         */
+        int stop();
+
+        int cores() const { return (int) m_cores.size(); }
+
+        Poller *getPoller(int core) const { return m_cores[core]->poller.get(); }
+
+        /*
+         * Runs task on core's thread. Fails with EAGAIN when the ring from
+         * the calling core is full: the caller owns the backpressure.
+         */
+        int post(int core, struct ExecutorTask *task);
+
+        /* The calling thread's core in this runtime, or -1. */
+        int currentCore() const;
+
+        /*
+         * SO_REUSEPORT sharding: one listening socket per core, bound to
+         * the same address, so the kernel spreads connections across
+         * cores. On return addr holds the bound address.
+         */
+        int listen(struct sockaddr *addr, socklen_t addrlen,
+                   CoreAccept accept);
+
+    private:
+        struct Core : public PollerTask
+        {
+                CoreRuntime                *runtime;
+                int                         index;
+                int                         eventFd;
+                std::unique_ptr<Poller>     poller;
+                std::atomic<bool>           armed;
+                std::vector<std::unique_ptr<SpscRing<struct ExecutorTask *>>>
+                                            inbound; /* by sending core */
+                std::mutex                  mutex;
+                struct ExecutorTask        *injected;
+                struct ExecutorTask       **injectedTail;
+                std::vector<int>            listenFds;
+
+                void handle(struct PollerResult *) override {}
+        };
+
+        struct Listener : public PollerTask
+        {
+                struct Core *core;
+                CoreAccept   accept;
+
+                void handle(struct PollerResult *) override {}
+        };
+
+        static void handle(struct PollerResult *res, void *context);
+
+        static void *drain(void *context);
+
+        static void *acceptFd(const struct sockaddr *addr, socklen_t addrlen,
+                              int fd, void *context);
+
+        static size_t runQueued(struct Core *core, size_t max);
+
+        static bool hasQueued(struct Core *core);
+
+        void wake(struct Core *core);
+
+        std::vector<std::unique_ptr<struct Core>>     m_cores;
+        std::vector<std::unique_ptr<struct Listener>> m_listeners;
+        bool                                          m_pin;
+};
+
+#endif // CORERUNTIME_H
@@ -0,0 +1,522 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+
+#include "Coroutine.h"
+
+bool CoSleep::await_suspend(std::coroutine_handle<> handle)
+{
+        PollerTask *context = this;
+
+        m_wait.handle = handle;
+        if (m_scheduler->getPoller()->addTimer(m_timeout, context) < 0)
+        {
+                m_wait.set(-1, errno);
+                return false;
+        }
+
+        return true;
+}
+
+void CoSleep::handle(struct PollerResult *res)
+{
+        if (res->state == PR_ST_FINISHED)
+                m_wait.set(0, 0);
+        else
+                m_wait.set(-1, res->state == PR_ST_ERROR ? res->error
+                                                         : ECANCELED);
+
+        m_wait.handle.resume();
+}
+
+bool CoConnect::await_suspend(std::coroutine_handle<> handle)
+{
+        struct PollerData data = {};
+
+        if (connect(m_fd, m_addr, m_addrlen) == 0)
+        {
+                m_wait.set(0, 0);
+                return false;
+        }
+
+        if (errno != EINPROGRESS)
+        {
+                m_wait.set(-1, errno);
+                return false;
+        }
+
+        data.operation = PD_OP_CONNECT;
+        data.fd        = m_fd;
+        data.context   = static_cast<PollerTask *>(this);
+        m_wait.handle  = handle;
+        if (m_scheduler->getPoller()->add(&data, m_timeout) < 0)
+        {
+                m_wait.set(-1, errno);
+                return false;
+        }
+
+        return true;
+}
+
+void CoConnect::handle(struct PollerResult *res)
+{
+        if (res->state == PR_ST_FINISHED)
+                m_wait.set(0, 0);
+        else
+                m_wait.set(-1, res->state == PR_ST_ERROR ? res->error
+                                                         : ECANCELED);
+
+        m_wait.handle.resume();
+}
+
+void CoSwitch::await_suspend(std::coroutine_handle<> handle)
+{
+        m_entry.base.routine = CoSwitch::run;
+        m_entry.handle       = handle;
+        m_executor->submit(&m_entry.base);
+}
+
+void CoSwitch::run(struct ExecutorTask *task)
+{
+        reinterpret_cast<struct SwitchEntry *>(task)->handle.resume();
+}
+
+CoChannel::CoChannel(TaskScheduler *scheduler, const int fd)
+    : m_scheduler(scheduler), m_fd(fd), m_wait(nullptr), m_ready(nullptr),
+      m_writer(nullptr), m_closed(false), m_blocked(false), m_error(0)
+{
+}
+
+void CoChannel::open(struct PollerData *data)
+{
+        data->fd      = m_fd;
+        data->context = static_cast<PollerTask *>(this);
+        if (m_scheduler->getPoller()->add(data, -1) < 0)
+        {
+                m_closed = true;
+                m_error  = errno;
+        }
+}
+
+bool CoChannel::park(struct CoWait *wait, std::coroutine_handle<> handle)
+{
+        if (m_closed)
+        {
+                if (m_error)
+                        wait->set(-1, m_error);
+                else
+                        wait->set(0, 0);
+
+                return false;
+        }
+
+        wait->handle = handle;
+        m_wait       = wait;
+        return true;
+}
+
+void CoChannel::ready(const ssize_t result, const int error)
+{
+        m_wait->set(result, error);
+        m_ready = m_wait;
+        m_wait  = nullptr;
+}
+
+bool CoChannel::suspendClose(std::coroutine_handle<> handle)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_closed)
+                return false;
+
+        /*
+         * Under the lock, so the del is queued before the caller can be
+         * resumed, close the fd and see its number reused. Its result is
+         * delivered later even on the poller thread.
+         */
+        m_closer = handle;
+        m_scheduler->getPoller()->del(m_fd);
+        return true;
+}
+
+void CoChannel::handle(struct PollerResult *res)
+{
+        std::coroutine_handle<> wake[2];
+        std::coroutine_handle<> closer;
+        int                     n = 0;
+
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                switch (res->state)
+                {
+                        case PR_ST_SUCCESS:
+                                break;
+
+                        case PR_ST_BLOCKED:
+                                m_blocked = true;
+                                break;
+
+                        case PR_ST_RESUMED:
+                                m_blocked = false;
+                                if (m_writer)
+                                {
+                                        wake[n++] = m_writer->handle;
+                                        m_writer  = nullptr;
+                                }
+
+                                break;
+
+                        default:
+                                /* A CoSocket's mod() that came too late. */
+                                if (m_closed)
+                                        break;
+
+                                /* The node is gone. */
+                                m_closed = true;
+                                if (res->state == PR_ST_ERROR)
+                                        m_error = res->error;
+                                else if (res->state != PR_ST_FINISHED)
+                                        m_error = ECANCELED;
+
+                                if (m_wait)
+                                        this->ready(m_error ? -1 : 0, m_error);
+
+                                if (m_writer)
+                                {
+                                        m_writer->set(-1, m_error ? m_error
+                                                                  : EPIPE);
+                                        wake[n++] = m_writer->handle;
+                                        m_writer  = nullptr;
+                                }
+
+                                closer = m_closer;
+                                break;
+                }
+
+                if (m_ready)
+                {
+                        wake[n++] = m_ready->handle;
+                        m_ready   = nullptr;
+                }
+        }
+
+        for (int i = 0; i < n; i++)
+                wake[i].resume();
+
+        /* Last: once resumed, it may free the channel. */
+        if (closer)
+                closer.resume();
+}
+
+CoSocket::CoSocket(TaskScheduler *scheduler, const int fd)
+    : CoChannel(scheduler, fd), m_inPos(0), m_charged(0), m_consumed(0),
+      m_owner(nullptr), m_epoch(0), m_paused(false), m_message()
+{
+        struct PollerData data = {};
+
+        data.operation     = PD_OP_READ;
+        data.flags         = PD_FL_PERSISTENT;
+        data.createMessage = CoSocket::createMessage;
+        this->open(&data);
+}
+
+void CoSocket::handle(struct PollerResult *res)
+{
+        const PollerMessage *msg = res->data.message;
+        size_t               n   = 0;
+
+        /* Charged only now that the message is finished. */
+        if (res->state == PR_ST_SUCCESS && msg)
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                m_owner = msg->node;
+                m_epoch = msg->epoch;
+                m_charged += msg->bytes;
+                n = this->settle();
+        }
+
+        this->release(n);
+        CoChannel::handle(res);
+}
+
+PollerMessage *CoSocket::createMessage(void *context)
+{
+        PollerTask *handler = static_cast<PollerTask *>(context);
+        CoSocket   *socket  = static_cast<CoSocket *>(handler);
+
+        socket->m_message.socket      = socket;
+        socket->m_message.base.append = CoSocket::append;
+        return &socket->m_message.base;
+}
+
+/* Every read is a message of its own: it goes straight to a waiter. */
+int CoSocket::append(const void *buf, size_t *n, PollerMessage *msg)
+{
+        char               *p      = reinterpret_cast<char *>(msg);
+        CoSocket           *socket = reinterpret_cast<struct SocketMessage *>(
+                                     p - offsetof(struct SocketMessage, base))
+                                     ->socket;
+        struct ReadAwaiter *wait;
+        size_t              size = 0;
+
+        {
+                std::lock_guard<std::mutex> lock(socket->m_mutex);
+
+                wait = static_cast<struct ReadAwaiter *>(socket->m_wait);
+                if (wait && socket->m_in.size() == socket->m_inPos)
+                {
+                        size = std::min(*n, wait->size);
+                        memcpy(wait->buf, buf, size);
+                        socket->m_consumed += size;
+                        socket->ready(size, 0);
+                }
+
+                socket->m_in.append(static_cast<const char *>(buf) + size,
+                                    *n - size);
+                /* Applied once the handler returns, after this message. */
+                if (!socket->m_paused && socket->m_in.size() -
+                                         socket->m_inPos >= COSOCKET_BUFFER_MAX)
+                {
+                        socket->m_paused = true;
+                        socket->setReading(false);
+                }
+        }
+
+        return 1;
+}
+
+bool CoSocket::suspendRead(struct ReadAwaiter *wait,
+                           std::coroutine_handle<> handle)
+{
+        size_t size;
+        size_t n;
+
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                size = m_in.size() - m_inPos;
+                if (size == 0)
+                        return this->park(wait, handle);
+
+                size = std::min(size, wait->size);
+                memcpy(wait->buf, m_in.data() + m_inPos, size);
+                m_inPos += size;
+                if (m_inPos == m_in.size())
+                {
+                        m_in.clear();
+                        m_inPos = 0;
+                } else if (m_inPos >= COSOCKET_BUFFER_MAX)
+                {
+                        m_in.erase(0, m_inPos);
+                        m_inPos = 0;
+                }
+
+                m_consumed += size;
+                n = this->settle();
+                if (m_paused && !m_closed && !m_closer &&
+                    m_in.size() - m_inPos <= COSOCKET_BUFFER_MAX / 2)
+                {
+                        m_paused = false;
+                        this->setReading(true);
+                }
+        }
+
+        this->release(n);
+
+        wait->set(size, 0);
+        return false;
+}
+
+size_t CoSocket::settle()
+{
+        const size_t n = std::min(m_consumed, m_charged);
+
+        m_consumed -= n;
+        m_charged -= n;
+        return n;
+}
+
+void CoSocket::release(const size_t n)
+{
+        struct PollerMessage msg = {};
+        struct PollerResult  res = {};
+
+        if (n == 0)
+                return;
+
+        msg.bytes        = n;
+        msg.node         = m_owner;
+        msg.epoch        = m_epoch;
+        res.data.fd      = m_fd;
+        res.data.message = &msg;
+        m_scheduler->getPoller()->release(&res);
+}
+
+void CoSocket::setReading(const bool on)
+{
+        struct PollerData data = {};
+
+        data.operation     = on ? PD_OP_READ : PD_OP_IDLE;
+        data.flags         = PD_FL_PERSISTENT;
+        data.fd            = m_fd;
+        data.createMessage = on ? CoSocket::createMessage : nullptr;
+        data.context       = static_cast<PollerTask *>(this);
+        m_scheduler->getPoller()->mod(&data, -1);
+}
+
+bool CoSocket::suspendWrite(struct WriteAwaiter *wait,
+                            std::coroutine_handle<> handle)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_closed)
+        {
+                wait->set(-1, m_error ? m_error : EPIPE);
+                wait->done = true;
+                return false;
+        }
+
+        if (!m_blocked)
+                return false;
+
+        wait->handle = handle;
+        m_writer     = wait;
+        return true;
+}
+
+ssize_t CoSocket::WriteAwaiter::await_resume()
+{
+        if (!this->done)
+                socket->send(this);
+
+        return this->value();
+}
+
+/* Outside the lock: on the poller thread the send is applied at once. */
+void CoSocket::send(struct WriteAwaiter *wait)
+{
+        IOBuf buf;
+
+        wait->done = true;
+        if (buf.append(wait->buf, wait->n) < 0 ||
+            m_scheduler->getPoller()->send(m_fd, &buf) < 0)
+                wait->set(-1, errno);
+        else
+                wait->set(wait->n, 0);
+}
+
+CoListener::CoListener(TaskScheduler *scheduler, const int fd)
+    : CoChannel(scheduler, fd)
+{
+        struct PollerData data = {};
+
+        data.operation = PD_OP_LISTEN;
+        data.accept    = CoListener::acceptFd;
+        this->open(&data);
+}
+
+void *CoListener::acceptFd(const struct sockaddr *, socklen_t, const int fd,
+                           void *context)
+{
+        PollerTask *handler  = static_cast<PollerTask *>(context);
+        CoListener *listener = static_cast<CoListener *>(handler);
+
+        std::lock_guard<std::mutex> lock(listener->m_mutex);
+
+        if (listener->m_wait)
+                listener->ready(fd, 0);
+        else
+                listener->m_fds.push_back(fd);
+
+        return context;
+}
+
+bool CoListener::AcceptAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+        std::lock_guard<std::mutex> lock(listener->m_mutex);
+
+        if (listener->m_fds.empty())
+                return listener->park(this, handle);
+
+        this->set(listener->m_fds.front(), 0);
+        listener->m_fds.pop_front();
+        return false;
+}
+
+CoDatagram::CoDatagram(TaskScheduler *scheduler, const int fd)
+    : CoChannel(scheduler, fd)
+{
+        struct PollerData data = {};
+
+        data.operation = PD_OP_RECVFROM;
+        data.recvfrom  = CoDatagram::recvData;
+        this->open(&data);
+}
+
+void CoDatagram::take(struct RecvAwaiter *wait, const void *buf,
+                      const size_t n, const struct sockaddr *addr,
+                      const socklen_t addrlen)
+{
+        const size_t size = std::min(n, wait->size);
+
+        memcpy(wait->buf, buf, size);
+        if (wait->addr)
+        {
+                memcpy(wait->addr, addr, std::min(*wait->addrlen, addrlen));
+                *wait->addrlen = addrlen;
+        }
+
+        wait->set(size, 0);
+}
+
+void *CoDatagram::recvData(const struct sockaddr *addr, const socklen_t addrlen,
+                           void *buf, const size_t n, void *context)
+{
+        PollerTask *handler  = static_cast<PollerTask *>(context);
+        CoDatagram *datagram = static_cast<CoDatagram *>(handler);
+
+        std::lock_guard<std::mutex> lock(datagram->m_mutex);
+
+        if (datagram->m_wait)
+        {
+                CoDatagram::take(
+                        static_cast<struct RecvAwaiter *>(datagram->m_wait),
+                        buf, n, addr, addrlen);
+                datagram->m_ready = datagram->m_wait;
+                datagram->m_wait  = nullptr;
+        } else
+        {
+                struct Datagram &d = datagram->m_queue.emplace_back();
+
+                d.data.assign(static_cast<const char *>(buf), n);
+                memcpy(&d.addr, addr, addrlen);
+                d.addrlen = addrlen;
+        }
+
+        return context;
+}
+
+bool CoDatagram::RecvAwaiter::await_suspend(std::coroutine_handle<> handle)
+{
+        std::lock_guard<std::mutex> lock(datagram->m_mutex);
+        struct Datagram            *d;
+
+        if (datagram->m_queue.empty())
+                return datagram->park(this, handle);
+
+        d = &datagram->m_queue.front();
+        CoDatagram::take(this, d->data.data(), d->data.size(),
+                         reinterpret_cast<struct sockaddr *>(&d->addr),
+                         d->addrlen);
+        datagram->m_queue.pop_front();
+        return false;
+}
@@ -0,0 +1,396 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include <sys/socket.h>
+
+#include <coroutine>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <string>
+
+#include "SubTask.h"
+#include "TaskScheduler.h"
+
+/* Bytes a CoSocket buffers while nobody reads before it stops reading. */
+#define COSOCKET_BUFFER_MAX (256 * 1024)
+
+/*
+ * Return type of a detached coroutine: it starts at once and frees its
+ * frame when it returns. Frames come from the same per-thread free lists
+ * as tasks.
+ */
+class CoTask
+{
+    public:
+        struct promise_type
+        {
+                CoTask get_return_object() { return {}; }
+
+                std::suspend_never initial_suspend() noexcept { return {}; }
+
+                std::suspend_never final_suspend() noexcept { return {}; }
+
+                void return_void() {}
+
+                void unhandled_exception() { std::terminate(); }
+
+                static void *operator new(size_t size)
+                {
+                        return __subtask_alloc(size);
+                }
+
+                static void operator delete(void *p, size_t size)
+                {
+                        __subtask_free(p, size);
+                }
+        };
+};
+
+/*
+ * What a suspended operation resumes with: result >= 0, or -1 with
+ * error, which await_resume() puts in errno. Awaiters live in the
+ * coroutine frame, so awaiting allocates nothing.
+ */
+struct CoWait
+{
+        std::coroutine_handle<> handle;
+        ssize_t                 result;
+        int                     error;
+
+        void set(ssize_t res, int err)
+        {
+                result = res;
+                error  = err;
+        }
+
+        ssize_t value() const
+        {
+                if (result < 0)
+                        errno = error;
+
+                return result;
+        }
+};
+
+/* co_await CoSleep(scheduler, ms): resumes on the poller thread. */
+class CoSleep : public PollerTask
+{
+    public:
+        CoSleep(TaskScheduler *scheduler, int timeout)
+            : m_scheduler(scheduler), m_timeout(timeout), m_wait()
+        {
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle);
+
+        int await_resume() const { return m_wait.value(); }
+
+        void handle(struct PollerResult *res) override;
+
+    private:
+        TaskScheduler *m_scheduler;
+        int            m_timeout;
+        struct CoWait  m_wait;
+};
+
+/*
+ * co_await CoConnect(scheduler, fd, addr, addrlen, timeout) on a
+ * non-blocking socket: 0, or -1 with errno.
+ */
+class CoConnect : public PollerTask
+{
+    public:
+        CoConnect(TaskScheduler *scheduler, int fd,
+                  const struct sockaddr *addr, socklen_t addrlen, int timeout)
+            : m_scheduler(scheduler), m_fd(fd), m_addr(addr),
+              m_addrlen(addrlen), m_timeout(timeout), m_wait()
+        {
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        bool await_suspend(std::coroutine_handle<> handle);
+
+        int await_resume() const { return m_wait.value(); }
+
+        void handle(struct PollerResult *res) override;
+
+    private:
+        TaskScheduler         *m_scheduler;
+        int                    m_fd;
+        const struct sockaddr *m_addr;
+        socklen_t              m_addrlen;
+        int                    m_timeout;
+        struct CoWait          m_wait;
+};
+
+/* co_await CoSwitch(executor): continues on one of its workers. */
+class CoSwitch
+{
+    public:
+        explicit CoSwitch(Executor *executor)
+            : m_executor(executor), m_entry()
+        {
+        }
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> handle);
+
+        void await_resume() const {}
+
+    private:
+        struct SwitchEntry
+        {
+                struct ExecutorTask     base;
+                std::coroutine_handle<> handle;
+        };
+
+        static void run(struct ExecutorTask *task);
+
+        Executor          *m_executor;
+        struct SwitchEntry m_entry;
+};
+
+/*
+ * An fd registered with the poller for as long as the object lives, so
+ * successive awaits cost no commands. Results arriving while nobody waits
+ * are buffered. Operations resume on the poller thread; CoSwitch moves
+ * the coroutine elsewhere. One coroutine may wait on each direction at a
+ * time.
+ *
+ * close() removes the fd from the poller (it stays open) and must be
+ * awaited before the object goes away, unless the peer already ended it:
+ * after EOF or an error every operation fails at once.
+ */
+class CoChannel : public PollerTask
+{
+    public:
+        struct CloseAwaiter
+        {
+                CoChannel *channel;
+
+                bool await_ready() const noexcept { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle)
+                {
+                        return channel->suspendClose(handle);
+                }
+
+                void await_resume() const {}
+        };
+
+        CloseAwaiter close() { return {this}; }
+
+        int getFd() const { return m_fd; }
+
+        void handle(struct PollerResult *res) override;
+
+    protected:
+        CoChannel(TaskScheduler *scheduler, int fd);
+
+        ~CoChannel() = default;
+
+        void open(struct PollerData *data);
+
+        /* With the lock held: park wait, unless the node is gone. */
+        bool park(struct CoWait *wait, std::coroutine_handle<> handle);
+
+        /* With the lock held, on the poller thread. */
+        void ready(ssize_t result, int error);
+
+        TaskScheduler          *m_scheduler;
+        int                     m_fd;
+        std::mutex              m_mutex;
+        struct CoWait          *m_wait;   /* waiting for a result */
+        struct CoWait          *m_ready;  /* filled, to resume */
+        struct CoWait          *m_writer; /* waiting for RESUMED */
+        std::coroutine_handle<> m_closer;
+        bool                    m_closed;
+        bool                    m_blocked;
+        int                     m_error; /* after close: 0 for EOF */
+
+    private:
+        bool suspendClose(std::coroutine_handle<> handle);
+};
+
+/*
+ * A connected stream socket. Reads pause while COSOCKET_BUFFER_MAX bytes
+ * wait unread and go on once half are gone; bytes are released to the
+ * poller's read budgets as the reader takes them.
+ */
+class CoSocket : public CoChannel
+{
+    public:
+        struct ReadAwaiter : CoWait
+        {
+                CoSocket *socket;
+                void     *buf;
+                size_t    size;
+
+                bool await_ready() const noexcept { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle)
+                {
+                        return socket->suspendRead(this, handle);
+                }
+
+                ssize_t await_resume() const { return this->value(); }
+        };
+
+        /*
+         * Completes once the bytes are queued behind earlier writes; it
+         * waits only while the connection is over its write watermark.
+         */
+        struct WriteAwaiter : CoWait
+        {
+                CoSocket   *socket;
+                const void *buf;
+                size_t      n;
+                bool        done;
+
+                bool await_ready() const noexcept { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle)
+                {
+                        return socket->suspendWrite(this, handle);
+                }
+
+                ssize_t await_resume();
+        };
+
+        CoSocket(TaskScheduler *scheduler, int fd);
+
+        /* Up to size bytes; 0 at EOF. */
+        ReadAwaiter read(void *buf, size_t size)
+        {
+                return {{}, this, buf, size};
+        }
+
+        WriteAwaiter write(const void *buf, size_t n)
+        {
+                return {{}, this, buf, n, false};
+        }
+
+        void handle(struct PollerResult *res) override;
+
+    private:
+        struct SocketMessage
+        {
+                CoSocket            *socket;
+                struct PollerMessage base;
+        };
+
+        static PollerMessage *createMessage(void *context);
+
+        static int append(const void *buf, size_t *n, PollerMessage *msg);
+
+        bool suspendRead(struct ReadAwaiter *wait,
+                         std::coroutine_handle<> handle);
+
+        bool suspendWrite(struct WriteAwaiter *wait,
+                          std::coroutine_handle<> handle);
+
+        void send(struct WriteAwaiter *wait);
+
+        /* With the lock held: consumed bytes the poller has charged. */
+        size_t settle();
+
+        void release(size_t n);
+
+        /*
+         * With the lock held, like the del() of close(), so they reach the
+         * poller in order. Level-triggered, a mod() runs no handler inline.
+         */
+        void setReading(bool on);
+
+        std::string          m_in; /* read while nobody waited */
+        size_t               m_inPos;
+        size_t               m_charged;  /* delivered, not released */
+        size_t               m_consumed; /* taken, not released */
+        struct PollerNode   *m_owner;    /* of the messages, for release */
+        unsigned int         m_epoch;
+        bool                 m_paused;
+        struct SocketMessage m_message;
+};
+
+/* A listening socket: co_await accept() yields a connected fd. */
+class CoListener : public CoChannel
+{
+    public:
+        struct AcceptAwaiter : CoWait
+        {
+                CoListener *listener;
+
+                bool await_ready() const noexcept { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle);
+
+                int await_resume() const { return this->value(); }
+        };
+
+        CoListener(TaskScheduler *scheduler, int fd);
+
+        AcceptAwaiter accept() { return {{}, this}; }
+
+    private:
+        static void *acceptFd(const struct sockaddr *addr, socklen_t addrlen,
+                              int fd, void *context);
+
+        std::deque<int> m_fds;
+};
+
+/* A datagram socket: co_await recvfrom() yields one datagram. */
+class CoDatagram : public CoChannel
+{
+    public:
+        struct RecvAwaiter : CoWait
+        {
+                CoDatagram      *datagram;
+                void            *buf;
+                size_t           size;
+                struct sockaddr *addr;
+                socklen_t       *addrlen;
+
+                bool await_ready() const noexcept { return false; }
+
+                bool await_suspend(std::coroutine_handle<> handle);
+
+                ssize_t await_resume() const { return this->value(); }
+        };
+
+        CoDatagram(TaskScheduler *scheduler, int fd);
+
+        /* A datagram longer than size is truncated. */
+        RecvAwaiter recvfrom(void *buf, size_t size,
+                             struct sockaddr *addr = nullptr,
+                             socklen_t       *addrlen = nullptr)
+        {
+                return {{}, this, buf, size, addr, addrlen};
+        }
+
+    private:
+        struct Datagram
+        {
+                std::string             data;
+                struct sockaddr_storage addr;
+                socklen_t               addrlen;
+        };
+
+        static void *recvData(const struct sockaddr *addr, socklen_t addrlen,
+                              void *buf, size_t n, void *context);
+
+        static void take(struct RecvAwaiter *wait, const void *buf, size_t n,
+                         const struct sockaddr *addr, socklen_t addrlen);
+
+        std::deque<struct Datagram> m_queue;
+};
+
+#endif // COROUTINE_H
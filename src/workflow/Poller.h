@@ -1,12 +0,0 @@
-//
-// Created by yruns on 2025/3/12.
-//
-
-#ifndef POLLER_H
-#define POLLER_H
-
-#include <openssl/ssl.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-
-#endif // POLLER_H
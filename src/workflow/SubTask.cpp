@@ -0,0 +1,130 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <new>
+
+#include "SubTask.h"
+
+namespace
+{
+        struct __subtask_block
+        {
+                struct __subtask_block *next;
+        };
+
+        struct __subtask_pool
+        {
+                struct __subtask_block *free[SUBTASK_POOL_CLASSES];
+                size_t                  count[SUBTASK_POOL_CLASSES];
+
+                ~__subtask_pool()
+                {
+                        struct __subtask_block *block;
+
+                        for (int i = 0; i < SUBTASK_POOL_CLASSES; i++)
+                        {
+                                while ((block = this->free[i]))
+                                {
+                                        this->free[i] = block->next;
+                                        ::operator delete(block);
+                                }
+                        }
+                }
+        };
+
+        thread_local struct __subtask_pool __subtask_pool;
+
+        int __subtask_class(size_t size)
+        {
+                return (size - 1) / SUBTASK_POOL_ALIGN;
+        }
+} // namespace
+
+void *__subtask_alloc(const size_t size)
+{
+        const int               cls  = __subtask_class(size);
+        struct __subtask_pool  *pool = &__subtask_pool;
+        struct __subtask_block *block;
+
+        if (cls >= SUBTASK_POOL_CLASSES)
+                return ::operator new(size);
+
+        block = pool->free[cls];
+        if (!block)
+                return ::operator new((cls + 1) * SUBTASK_POOL_ALIGN);
+
+        pool->free[cls] = block->next;
+        pool->count[cls]--;
+        return block;
+}
+
+void __subtask_free(void *p, const size_t size)
+{
+        const int               cls  = __subtask_class(size);
+        struct __subtask_pool  *pool = &__subtask_pool;
+        struct __subtask_block *block;
+
+        if (cls >= SUBTASK_POOL_CLASSES ||
+            pool->count[cls] >= SUBTASK_POOL_DEPTH)
+        {
+                ::operator delete(p);
+                return;
+        }
+
+        block           = static_cast<struct __subtask_block *>(p);
+        block->next     = pool->free[cls];
+        pool->free[cls] = block;
+        pool->count[cls]++;
+}
+
+void *SubTask::operator new(const size_t size)
+{
+        return __subtask_alloc(size);
+}
+
+void SubTask::operator delete(void *p, const size_t size)
+{
+        __subtask_free(p, size);
+}
+
+void SubTask::subtaskDone()
+{
+        SubTask      *cur = this;
+        ParallelTask *parent;
+
+        while (1)
+        {
+                parent = cur->m_parent;
+                cur    = cur->done();
+                if (cur)
+                {
+                        cur->m_parent = parent;
+                        cur->dispatch();
+                } else if (parent && parent->m_left.fetch_sub(1) == 1)
+                {
+                        /* The last branch in finishes the parallel. */
+                        cur = parent;
+                        continue;
+                }
+
+                break;
+        }
+}
+
+void ParallelTask::dispatch()
+{
+        SubTask **end = m_subtasks + m_n;
+        SubTask **p;
+
+        /* One extra count, so no branch can finish us while we loop. */
+        m_left.store(m_n + 1, std::memory_order_relaxed);
+        for (p = m_subtasks; p < end; p++)
+        {
+                (*p)->m_parent = this;
+                (*p)->dispatch();
+        }
+
+        if (m_left.fetch_sub(1) == 1)
+                this->subtaskDone();
+}
@@ -0,0 +1,91 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef SUBTASK_H
+#define SUBTASK_H
+
+#include <atomic>
+#include <cstddef>
+
+#define SUBTASK_POOL_ALIGN 64
+#define SUBTASK_POOL_CLASSES 16 /* up to 1K: tasks, coroutine frames */
+#define SUBTASK_POOL_DEPTH 256 /* blocks cached per class per thread */
+
+class ParallelTask;
+
+/*
+ * The unit the scheduler moves around. dispatch() starts the work; the
+ * implementation calls subtaskDone() once it has finished, on whatever
+ * thread that happens. subtaskDone() asks done() for the next task and
+ * dispatches it right there, so a series runs from one completion to the
+ * next without a thread hop.
+ *
+ * Subtasks (and series) come from small per-thread free lists instead of
+ * the heap. A block goes back to the list of the thread that frees it,
+ * or to the heap once that list is full. Flows that allocate and free on
+ * the same thread thus make no malloc calls in steady state; those that
+ * allocate on one thread and free on another still make one per block.
+ */
+class SubTask
+{
+    public:
+        SubTask() : m_parent(nullptr), m_pointer(nullptr) {}
+
+        virtual ~SubTask() = default;
+
+        SubTask(const SubTask &) = delete;
+
+        SubTask &operator=(const SubTask &) = delete;
+
+        virtual void dispatch() = 0;
+
+        ParallelTask *getParent() const { return m_parent; }
+
+        void *getPointer() const { return m_pointer; }
+
+        void setPointer(void *pointer) { m_pointer = pointer; }
+
+        static void *operator new(size_t size);
+
+        static void operator delete(void *p, size_t size);
+
+    protected:
+        void subtaskDone();
+
+    private:
+        /* Returns the task to run next, or nullptr. */
+        virtual SubTask *done() = 0;
+
+        ParallelTask *m_parent;
+        void         *m_pointer;
+
+        friend class ParallelTask;
+};
+
+/* Runs its subtasks concurrently and finishes after the last of them. */
+class ParallelTask : public SubTask
+{
+    public:
+        ParallelTask(SubTask **subtasks, size_t n)
+            : m_subtasks(subtasks), m_n(n), m_left(0)
+        {
+        }
+
+        void dispatch() override;
+
+    protected:
+        SubTask **m_subtasks;
+        size_t    m_n;
+
+    private:
+        std::atomic<size_t> m_left;
+
+        friend class SubTask;
+};
+
+void *__subtask_alloc(size_t size);
+
+void __subtask_free(void *p, size_t size);
+
+#endif // SUBTASK_H
@@ -0,0 +1,340 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <cerrno>
+#include <cstddef>
+
+#include "Task.h"
+
+void Task::start()
+{
+        SeriesWork::create(this, nullptr)->start();
+}
+
+SubTask *Task::done()
+{
+        SeriesWork *series = seriesOf(this);
+
+        if (m_token)
+                m_token->removeHook(&m_hook);
+
+        this->finish();
+        delete this;
+        return series->pop();
+}
+
+bool Task::cancelled()
+{
+        m_token = cancelTokenOf(this);
+        if (!m_token || !m_token->isCancelled())
+                return false;
+
+        m_state = PR_ST_ERROR;
+        m_error = ECANCELED;
+        this->subtaskDone();
+        return true;
+}
+
+int Task::watch(void (*cancel)(struct CancelHook *),
+                const std::function<int()> &start)
+{
+        if (!m_token)
+                return start();
+
+        m_hook.cancel  = cancel;
+        m_hook.context = this;
+        return m_token->addHook(&m_hook, start);
+}
+
+GoTask::GoTask(TaskScheduler *scheduler, std::function<void()> go,
+               GoCallback callback)
+    : m_scheduler(scheduler), m_entry(), m_go(std::move(go)),
+      m_callback(std::move(callback))
+{
+}
+
+void GoTask::dispatch()
+{
+        if (this->cancelled())
+                return;
+
+        m_entry.base.routine = GoTask::run;
+        m_entry.task         = this;
+        m_scheduler->getExecutor()->submit(&m_entry.base);
+}
+
+void GoTask::run(struct ExecutorTask *task)
+{
+        GoTask *self = reinterpret_cast<struct GoEntry *>(task)->task;
+
+        /* Cancelled while queued: no point starting now. */
+        if (self->m_token && self->m_token->isCancelled())
+        {
+                self->m_state = PR_ST_ERROR;
+                self->m_error = ECANCELED;
+        } else
+                self->m_go();
+
+        self->subtaskDone();
+}
+
+void GoTask::finish()
+{
+        if (m_callback)
+                m_callback(this);
+}
+
+TimerTask::TimerTask(TaskScheduler *scheduler, const int timeout,
+                     TimerCallback callback)
+    : m_scheduler(scheduler), m_timeout(timeout),
+      m_callback(std::move(callback))
+{
+}
+
+void TimerTask::dispatch()
+{
+        if (this->cancelled())
+                return;
+
+        if (this->watch(TimerTask::cancel,
+                        [this] { return this->addTimer(); }) < 0)
+        {
+                m_state = PR_ST_ERROR;
+                m_error = errno;
+                this->subtaskDone();
+        }
+}
+
+int TimerTask::addTimer()
+{
+        PollerTask *context = this;
+
+        return m_scheduler->getPoller()->addTimer(m_timeout, context,
+                                                  &m_handle);
+}
+
+void TimerTask::cancel(struct CancelHook *hook)
+{
+        TimerTask *task = static_cast<TimerTask *>(
+                static_cast<Task *>(hook->context));
+
+        task->m_scheduler->getPoller()->cancel(&task->m_handle);
+}
+
+void TimerTask::handle(struct PollerResult *res)
+{
+        switch (res->state)
+        {
+                case PR_ST_FINISHED:
+                        m_state = PR_ST_SUCCESS;
+                        break;
+
+                /* Only the hook cancels the timer. */
+                case PR_ST_DELETED:
+                        m_state = PR_ST_ERROR;
+                        m_error = ECANCELED;
+                        break;
+
+                case PR_ST_STOPPED:
+                        m_state = PR_ST_STOPPED;
+                        break;
+
+                default:
+                        m_state = PR_ST_ERROR;
+                        m_error = res->error;
+                        break;
+        }
+
+        this->subtaskDone();
+}
+
+void TimerTask::finish()
+{
+        if (m_callback)
+                m_callback(this);
+}
+
+NetTask::NetTask(TaskScheduler *scheduler, const int fd, NetCallback callback)
+    : m_scheduler(scheduler), m_fd(fd), m_timeout(-1), m_received(false),
+      m_iov(), m_callback(std::move(callback)), m_message(),
+      m_closing(false), m_cancelling(false)
+{
+}
+
+PollerMessage *NetTask::createMessage(void *context)
+{
+        PollerTask *handler = static_cast<PollerTask *>(context);
+        NetTask    *task    = static_cast<NetTask *>(handler);
+
+        /* Nothing is expected past the response. */
+        if (task->m_received)
+        {
+                errno = EBADMSG;
+                return nullptr;
+        }
+
+        task->m_message.task        = task;
+        task->m_message.base.append = NetTask::append;
+        return &task->m_message.base;
+}
+
+int NetTask::append(const void *buf, size_t *n, PollerMessage *msg)
+{
+        char              *p       = reinterpret_cast<char *>(msg);
+        struct NetMessage *message = reinterpret_cast<struct NetMessage *>(
+                p - offsetof(struct NetMessage, base));
+        NetTask           *task    = message->task;
+
+        return task->m_parser(buf, n, &task->m_response);
+}
+
+int NetTask::partialWritten(size_t, void *)
+{
+        return 0;
+}
+
+int NetTask::startRead(const bool modify)
+{
+        Poller           *poller = m_scheduler->getPoller();
+        struct PollerData data   = {};
+
+        data.operation     = PD_OP_READ;
+        data.flags         = PD_FL_PERSISTENT;
+        data.fd            = m_fd;
+        data.createMessage = NetTask::createMessage;
+        data.context       = static_cast<PollerTask *>(this);
+
+        /* Switched in place, the node keeps m_handle. */
+        if (modify)
+                return poller->mod(&data, m_timeout);
+
+        return poller->add(&data, m_timeout, &m_handle);
+}
+
+void NetTask::fail(const int state, const int error)
+{
+        /* Whatever happens after the response does not undo it. */
+        if (!m_received)
+        {
+                m_state = state;
+                m_error = error;
+        }
+}
+
+int NetTask::startWrite()
+{
+        struct PollerData data = {};
+
+        m_iov.iov_base      = m_request.data();
+        m_iov.iov_len       = m_request.size();
+        data.operation      = PD_OP_WRITE;
+        data.flags          = PD_FL_PERSISTENT;
+        data.iovcnt         = 1;
+        data.fd             = m_fd;
+        data.partialWritten = NetTask::partialWritten;
+        data.context        = static_cast<PollerTask *>(this);
+        data.writeIov       = &m_iov;
+        return m_scheduler->getPoller()->add(&data, m_timeout, &m_handle);
+}
+
+/* Done with the node, which ends with PR_ST_DELETED. */
+void NetTask::close()
+{
+        m_closing = true;
+        m_scheduler->getPoller()->cancel(&m_handle);
+}
+
+void NetTask::cancel(struct CancelHook *hook)
+{
+        NetTask *task = static_cast<NetTask *>(
+                static_cast<Task *>(hook->context));
+
+        task->m_cancelling = true;
+        task->m_scheduler->getPoller()->cancel(&task->m_handle);
+}
+
+void NetTask::dispatch()
+{
+        if (this->cancelled())
+                return;
+
+        if (m_request.empty() && !m_parser)
+        {
+                this->subtaskDone();
+                return;
+        }
+
+        if (this->watch(NetTask::cancel,
+                        [this]
+                        {
+                                return m_request.empty()
+                                               ? this->startRead(false)
+                                               : this->startWrite();
+                        }) < 0)
+        {
+                this->fail(PR_ST_ERROR, errno);
+                this->subtaskDone();
+        }
+}
+
+/*
+ * The node ends with exactly one of DELETED, FINISHED (a read at EOF),
+ * ERROR or STOPPED; the task finishes there and not before, since the
+ * node still points at it until then.
+ */
+void NetTask::handle(struct PollerResult *res)
+{
+        switch (res->state)
+        {
+                case PR_ST_SUCCESS:
+                        m_received = true;
+                        this->close();
+                        return;
+
+                case PR_ST_FINISHED:
+                        if (res->data.operation != PD_OP_WRITE)
+                        {
+                                this->fail(PR_ST_ERROR, ECONNRESET);
+                                break;
+                        }
+
+                        /* The hook's cancel() will take the parked node. */
+                        if (m_cancelling)
+                                return;
+
+                        /* Written, and the node is parked. */
+                        if (!m_parser || this->startRead(true) < 0)
+                        {
+                                if (m_parser)
+                                        this->fail(PR_ST_ERROR, errno);
+
+                                this->close();
+                        }
+
+                        return;
+
+                /* Unless this task asked for it, the node was taken away. */
+                case PR_ST_DELETED:
+                        if (m_cancelling || !m_closing)
+                                this->fail(PR_ST_ERROR, ECANCELED);
+                        break;
+
+                case PR_ST_MODIFIED:
+                case PR_ST_BLOCKED:
+                case PR_ST_RESUMED:
+                        return;
+
+                default:
+                        this->fail(res->state, res->error);
+                        break;
+        }
+
+        this->subtaskDone();
+}
+
+void NetTask::finish()
+{
+        if (m_callback)
+                m_callback(this);
+}
@@ -0,0 +1,221 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef TASK_H
+#define TASK_H
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+
+#include "TaskScheduler.h"
+#include "Workflow.h"
+
+/*
+ * Base of the user-facing tasks. state is a PR_ST_* value: SUCCESS,
+ * ERROR (with error set) or STOPPED. A task cancelled through its
+ * series' CancelToken ends in ERROR with ECANCELED. The callback runs on
+ * the thread that finished the task, after which the task is gone and
+ * its series moves on.
+ */
+class Task : public SubTask
+{
+    public:
+        /* Runs the task in a series of its own. */
+        void start();
+
+        int getState() const { return m_state; }
+
+        int getError() const { return m_error; }
+
+        void *getContext() const { return m_context; }
+
+        void setContext(void *context) { m_context = context; }
+
+    protected:
+        Task() :
+            m_state(PR_ST_SUCCESS), m_error(0), m_context(nullptr),
+            m_token(nullptr), m_hook()
+        {
+                INIT_LIST_HEAD(&m_hook.list);
+        }
+
+        /* Runs the user callback. */
+        virtual void finish() = 0;
+
+        /*
+         * First thing in dispatch(): looks the token up and, if it is
+         * cancelled, finishes the task with ECANCELED and returns true.
+         */
+        bool cancelled();
+
+        /*
+         * Issues the task's work through start, with cancel hooked to the
+         * token until the task is done (see CancelToken::addHook()).
+         */
+        int watch(void (*cancel)(struct CancelHook *),
+                  const std::function<int()> &start);
+
+        int                m_state;
+        int                m_error;
+        void              *m_context;
+        CancelToken       *m_token;
+        struct CancelHook  m_hook;
+
+    private:
+        SubTask *done() override;
+};
+
+/* Finishes as soon as it is dispatched. */
+class EmptyTask : public Task
+{
+    public:
+        EmptyTask() = default;
+
+        void dispatch() override { this->subtaskDone(); }
+
+    private:
+        void finish() override {}
+};
+
+class GoTask;
+
+using GoCallback = std::function<void(GoTask *)>;
+
+/* Runs go on one of the scheduler's executor threads. */
+class GoTask : public Task
+{
+    public:
+        GoTask(TaskScheduler *scheduler, std::function<void()> go,
+               GoCallback callback);
+
+        void dispatch() override;
+
+    private:
+        struct GoEntry
+        {
+                struct ExecutorTask base;
+                GoTask             *task;
+        };
+
+        static void run(struct ExecutorTask *task);
+
+        void finish() override;
+
+        TaskScheduler        *m_scheduler;
+        struct GoEntry        m_entry;
+        std::function<void()> m_go;
+        GoCallback            m_callback;
+};
+
+class TimerTask;
+
+using TimerCallback = std::function<void(TimerTask *)>;
+
+/* Finishes after timeout milliseconds, on the poller thread. */
+class TimerTask : public Task, public PollerTask
+{
+    public:
+        TimerTask(TaskScheduler *scheduler, int timeout,
+                  TimerCallback callback);
+
+        void dispatch() override;
+
+        void handle(struct PollerResult *res) override;
+
+    private:
+        static void cancel(struct CancelHook *hook);
+
+        int addTimer();
+
+        void finish() override;
+
+        TaskScheduler      *m_scheduler;
+        int                 m_timeout;
+        struct PollerHandle m_handle;
+        TimerCallback       m_callback;
+};
+
+class NetTask;
+
+using NetCallback = std::function<void(NetTask *)>;
+
+/*
+ * Takes bytes from buf and appends them to response, setting *n to what
+ * it took. Returns > 0 once response is a whole message, 0 for more, and
+ * -1 with errno set on a malformed one.
+ */
+using NetParser =
+        std::function<int(const void *buf, size_t *n, std::string *response)>;
+
+/*
+ * One exchange over a connected fd: writes the request, if any, then
+ * reads one response, if a parser is set. The fd stays the caller's and
+ * is left open. The peer is expected to send nothing past the response:
+ * what it does is dropped along with the node. timeout applies to each
+ * of the write and the read, in milliseconds; -1 waits forever.
+ */
+class NetTask : public Task, public PollerTask
+{
+    public:
+        NetTask(TaskScheduler *scheduler, int fd, NetCallback callback);
+
+        void setRequest(const void *buf, size_t n)
+        {
+                m_request.assign(static_cast<const char *>(buf), n);
+        }
+
+        void setParser(NetParser parser) { m_parser = std::move(parser); }
+
+        void setTimeout(int timeout) { m_timeout = timeout; }
+
+        const std::string &getResponse() const { return m_response; }
+
+        void dispatch() override;
+
+        void handle(struct PollerResult *res) override;
+
+    private:
+        struct NetMessage
+        {
+                NetTask             *task;
+                struct PollerMessage base;
+        };
+
+        static PollerMessage *createMessage(void *context);
+
+        static int append(const void *buf, size_t *n, PollerMessage *msg);
+
+        static int partialWritten(size_t n, void *context);
+
+        static void cancel(struct CancelHook *hook);
+
+        int startWrite();
+
+        int startRead(bool modify);
+
+        void fail(int state, int error);
+
+        void close();
+
+        void finish() override;
+
+        TaskScheduler      *m_scheduler;
+        int                 m_fd;
+        int                 m_timeout;
+        bool                m_received;
+        struct iovec        m_iov;
+        std::string         m_request;
+        std::string         m_response;
+        NetParser           m_parser;
+        NetCallback         m_callback;
+        struct NetMessage   m_message;
+        struct PollerHandle m_handle;
+        bool                m_closing;    /* close() is issued */
+        std::atomic<bool>   m_cancelling; /* the hook's cancel() is issued */
+};
+
+#endif // TASK_H
@@ -0,0 +1,44 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include "TaskScheduler.h"
+
+TaskScheduler::TaskScheduler(const int nthreads, const size_t maxOpenFiles)
+    : m_executor(new Executor(nthreads))
+{
+        struct PollerParams params = {};
+
+        params.maxOpenFiles = maxOpenFiles;
+        params.callback     = TaskScheduler::handle;
+        m_poller.reset(new Poller(&params));
+}
+
+TaskScheduler::~TaskScheduler() = default;
+
+int TaskScheduler::start()
+{
+        if (m_executor->start() < 0)
+                return -1;
+
+        if (m_poller->start() < 0)
+        {
+                m_executor->stop();
+                return -1;
+        }
+
+        return 0;
+}
+
+void TaskScheduler::stop()
+{
+        /* Stopped poller tasks may still queue compute work. */
+        m_poller->stop();
+        m_executor->stop();
+}
+
+void TaskScheduler::handle(struct PollerResult *res, void *)
+{
+        static_cast<PollerTask *>(res->data.context)->handle(res);
+        delete reinterpret_cast<struct PollerNode *>(res);
+}
@@ -0,0 +1,56 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <memory>
+
+#include "Executor.h"
+#include "Poller.h"
+
+/* A task waiting on the poller: its results come back through handle(). */
+class PollerTask
+{
+    public:
+        virtual void handle(struct PollerResult *res) = 0;
+
+    protected:
+        ~PollerTask() = default;
+};
+
+/*
+ * One poller for network and timer tasks and one executor for compute
+ * tasks. Poller results are handled on the poller thread, in order per
+ * fd, and whatever comes next in the series is dispatched right there;
+ * put a compute task in front of heavy work. Stop the scheduler only
+ * after its series have finished.
+ */
+class TaskScheduler
+{
+    public:
+        TaskScheduler(int nthreads, size_t maxOpenFiles);
+
+        ~TaskScheduler();
+
+        TaskScheduler(const TaskScheduler &) = delete;
+
+        TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+        int start();
+
+        void stop();
+
+        Poller *getPoller() const { return m_poller.get(); }
+
+        Executor *getExecutor() const { return m_executor.get(); }
+
+    private:
+        static void handle(struct PollerResult *res, void *context);
+
+        std::unique_ptr<Executor> m_executor;
+        std::unique_ptr<Poller>   m_poller;
+};
+
+#endif // TASKSCHEDULER_H
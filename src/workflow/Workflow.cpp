@@ -0,0 +1,154 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#include <cstring>
+
+#include "Workflow.h"
+
+SeriesWork::SeriesWork(SubTask *first, SeriesCallback callback)
+    : m_first(first), m_queue(m_buf), m_size(SERIES_QUEUE_SIZE), m_front(0),
+      m_back(0), m_context(nullptr), m_token(nullptr),
+      m_callback(std::move(callback))
+{
+        first->setPointer(this);
+}
+
+SeriesWork::~SeriesWork()
+{
+        if (m_queue != m_buf)
+                delete[] m_queue;
+}
+
+SeriesWork *SeriesWork::create(SubTask *first, SeriesCallback callback)
+{
+        return new SeriesWork(first, std::move(callback));
+}
+
+void SeriesWork::start()
+{
+        m_first->dispatch();
+}
+
+/* Called with the lock held and the ring full. */
+void SeriesWork::grow()
+{
+        const size_t size  = m_size * 2;
+        SubTask    **queue = new SubTask *[size];
+        size_t       n     = m_size - m_front;
+
+        memcpy(queue, m_queue + m_front, n * sizeof(SubTask *));
+        memcpy(queue + n, m_queue, m_front * sizeof(SubTask *));
+        if (m_queue != m_buf)
+                delete[] m_queue;
+
+        m_queue = queue;
+        m_front = 0;
+        m_back  = m_size;
+        m_size  = size;
+}
+
+void SeriesWork::pushBack(SubTask *task)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        task->setPointer(this);
+        m_queue[m_back] = task;
+        m_back          = (m_back + 1) & (m_size - 1);
+        if (m_back == m_front)
+                this->grow();
+}
+
+void SeriesWork::pushFront(SubTask *task)
+{
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        task->setPointer(this);
+        m_front          = (m_front - 1) & (m_size - 1);
+        m_queue[m_front] = task;
+        if (m_back == m_front)
+                this->grow();
+}
+
+SubTask *SeriesWork::pop()
+{
+        SubTask *task = nullptr;
+
+        {
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (m_front != m_back)
+                {
+                        task    = m_queue[m_front];
+                        m_front = (m_front + 1) & (m_size - 1);
+                }
+        }
+
+        if (task)
+                return task;
+
+        if (m_callback)
+                m_callback(this);
+
+        delete this;
+        return nullptr;
+}
+
+ParallelWork::ParallelWork(ParallelCallback callback)
+    : ParallelTask(nullptr, 0), m_context(nullptr),
+      m_callback(std::move(callback))
+{
+}
+
+ParallelWork *ParallelWork::create(ParallelCallback callback)
+{
+        return new ParallelWork(std::move(callback));
+}
+
+void ParallelWork::addSeries(SeriesWork *series)
+{
+        m_firsts.push_back(series->m_first);
+}
+
+void ParallelWork::addTask(SubTask *task)
+{
+        this->addSeries(SeriesWork::create(task, nullptr));
+}
+
+void ParallelWork::start()
+{
+        SeriesWork::create(this, nullptr)->start();
+}
+
+void ParallelWork::dispatch()
+{
+        m_subtasks = m_firsts.data();
+        m_n        = m_firsts.size();
+        ParallelTask::dispatch();
+}
+
+SubTask *ParallelWork::done()
+{
+        SeriesWork *series = seriesOf(this);
+
+        if (m_callback)
+                m_callback(this);
+
+        delete this;
+        return series->pop();
+}
+
+CancelToken *cancelTokenOf(const SubTask *task)
+{
+        SeriesWork *series;
+
+        /* A branch's first task has its parallel as parent. */
+        for (; task; task = task->getParent())
+        {
+                series = seriesOf(task);
+                if (series && series->getCancelToken())
+                        return series->getCancelToken();
+        }
+
+        return nullptr;
+}
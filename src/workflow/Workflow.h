@@ -0,0 +1,127 @@
+//
+// Created by yruns on 2026/10/19.
+//
+
+#ifndef WORKFLOW_H
+#define WORKFLOW_H
+
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "CancelToken.h"
+#include "SubTask.h"
+
+#define SERIES_QUEUE_SIZE 4
+
+class SeriesWork;
+class ParallelWork;
+
+using SeriesCallback   = std::function<void(const SeriesWork *)>;
+using ParallelCallback = std::function<void(const ParallelWork *)>;
+
+/*
+ * Runs its tasks one after another. Every task belongs to exactly one
+ * series (its pointer), and a finished task asks its series for the next
+ * one through pop(). Tasks may be pushed while the series runs, from any
+ * thread. Once the queue runs dry the callback is called and the series
+ * frees itself.
+ */
+class SeriesWork
+{
+    public:
+        static SeriesWork *create(SubTask *first, SeriesCallback callback);
+
+        void start();
+
+        void pushBack(SubTask *task);
+
+        void pushFront(SubTask *task);
+
+        /* Called from a finished task's done(). */
+        SubTask *pop();
+
+        void *getContext() const { return m_context; }
+
+        void setContext(void *context) { m_context = context; }
+
+        void setCallback(SeriesCallback callback)
+        {
+                m_callback = std::move(callback);
+        }
+
+        CancelToken *getCancelToken() const { return m_token; }
+
+        /* See CancelToken. Set before start(). */
+        void setCancelToken(CancelToken *token) { m_token = token; }
+
+        static void *operator new(size_t size) { return __subtask_alloc(size); }
+
+        static void operator delete(void *p, size_t size)
+        {
+                __subtask_free(p, size);
+        }
+
+    private:
+        SeriesWork(SubTask *first, SeriesCallback callback);
+
+        ~SeriesWork();
+
+        void grow();
+
+        SubTask       *m_first;
+        SubTask      **m_queue;
+        SubTask       *m_buf[SERIES_QUEUE_SIZE];
+        size_t         m_size;
+        size_t         m_front;
+        size_t         m_back;
+        void          *m_context;
+        CancelToken   *m_token;
+        SeriesCallback m_callback;
+        std::mutex     m_mutex;
+
+        friend class ParallelWork;
+};
+
+static inline SeriesWork *seriesOf(const SubTask *task)
+{
+        return static_cast<SeriesWork *>(task->getPointer());
+}
+
+/* The token of task's series, or of the nearest one it is nested in. */
+CancelToken *cancelTokenOf(const SubTask *task);
+
+/*
+ * Runs whole series side by side and finishes, in its own series, after
+ * the last of them. Series added here must not be started separately.
+ */
+class ParallelWork : public ParallelTask
+{
+    public:
+        static ParallelWork *create(ParallelCallback callback);
+
+        void addSeries(SeriesWork *series);
+
+        void addTask(SubTask *task);
+
+        size_t size() const { return m_firsts.size(); }
+
+        void start();
+
+        void dispatch() override;
+
+        void *getContext() const { return m_context; }
+
+        void setContext(void *context) { m_context = context; }
+
+    private:
+        explicit ParallelWork(ParallelCallback callback);
+
+        SubTask *done() override;
+
+        std::vector<SubTask *> m_firsts;
+        void                  *m_context;
+        ParallelCallback       m_callback;
+};
+
+#endif // WORKFLOW_H
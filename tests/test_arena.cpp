@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <stdint.h>
+
+#include "Arena.h"
+#include "Poller.h"
+
+namespace
+{
+  int append(const void *, size_t *, PollerMessage *) { return 1; }
+} // namespace
+
+class ArenaTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override { arena = new Arena(256); }
+
+  void TearDown() override { delete arena; }
+
+  Arena *arena;
+};
+
+TEST_F(ArenaTest, InitiallyEmpty) { EXPECT_EQ(arena->capacity(), 0); }
+
+TEST_F(ArenaTest, AllocIsAligned)
+{
+  for (size_t size = 1; size < 100; size += 7)
+  {
+    void *p = arena->alloc(size);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % ARENA_ALIGN, 0);
+  }
+}
+
+TEST_F(ArenaTest, MessageIsInline)
+{
+  PollerMessage *msg = arena->createMessage(64, append);
+
+  ASSERT_NE(msg, nullptr);
+  EXPECT_EQ(msg->arena, arena);
+  EXPECT_EQ(msg->append, append);
+  EXPECT_EQ(arena->capacity(), 256);
+}
+
+TEST_F(ArenaTest, ResetKeepsChunks)
+{
+  for (int i = 0; i < 20; i++)
+    arena->alloc(64);
+
+  const size_t capacity = arena->capacity();
+
+  for (int round = 0; round < 10; round++)
+  {
+    arena->reset();
+    for (int i = 0; i < 20; i++)
+      arena->alloc(64);
+  }
+
+  EXPECT_EQ(arena->capacity(), capacity);
+}
+
+TEST_F(ArenaTest, ReleaseLastMessageResets)
+{
+  PollerMessage *first  = arena->createMessage(16, append);
+  PollerMessage *second = arena->createMessage(16, append);
+
+  arena->release();
+  EXPECT_NE(arena->createMessage(16, append), first);
+  arena->release();
+  arena->release();
+  EXPECT_EQ(arena->createMessage(16, append), first);
+  (void) second;
+}
+
+TEST_F(ArenaTest, LargeAllocation)
+{
+  char *p = static_cast<char *>(arena->alloc(10000));
+
+  ASSERT_NE(p, nullptr);
+  p[9999] = 1;
+  EXPECT_GE(arena->capacity(), 10000);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
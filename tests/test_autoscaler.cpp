@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Autoscaler.h"
+#include "Executor.h"
+#include "Poller.h"
+
+namespace
+{
+  struct IdTask
+  {
+    ExecutorTask                   base;
+    std::mutex                    *mutex;
+    std::set<std::thread::id>     *ids;
+    std::atomic<int>              *left;
+  };
+
+  void recordId(ExecutorTask *task)
+  {
+    IdTask *t = reinterpret_cast<IdTask *>(task);
+
+    {
+      std::lock_guard<std::mutex> lock(*t->mutex);
+      t->ids->insert(std::this_thread::get_id());
+    }
+
+    t->left->fetch_sub(1);
+  }
+
+  /* Holds its worker until n of them run at once. */
+  struct BarrierTask
+  {
+    ExecutorTask      base;
+    std::atomic<int> *arrived;
+    std::atomic<int> *left;
+    int               n;
+  };
+
+  void barrier(ExecutorTask *task)
+  {
+    BarrierTask *t = reinterpret_cast<BarrierTask *>(task);
+
+    t->arrived->fetch_add(1);
+    while (t->arrived->load() < t->n)
+      std::this_thread::yield();
+
+    t->left->fetch_sub(1);
+  }
+} // namespace
+
+class AutoscalerTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    PollerParams params = {};
+
+    params.maxOpenFiles = 1024;
+    params.threads      = 3;
+    params.callback     = [this](PollerResult *res, void *)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ids[std::this_thread::get_id()]++;
+      }
+
+      /* Off the leader lock: another thread may take the lead. */
+      if (slow)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+      static_cast<std::promise<void> *>(res->data.context)->set_value();
+      delete reinterpret_cast<PollerNode *>(res);
+    };
+    poller.reset(new Poller(&params));
+    ASSERT_EQ(poller->start(), 0);
+    executor.reset(new Executor(4));
+    ASSERT_EQ(executor->start(), 0);
+  }
+
+  void TearDown() override
+  {
+    poller->stop();
+    executor->stop();
+  }
+
+  /* One timer, run and waited for. */
+  void tick()
+  {
+    std::promise<void> fired;
+
+    ASSERT_EQ(poller->addTimer(0, &fired), 0);
+    fired.get_future().wait();
+  }
+
+  std::set<std::thread::id> runTasks(int n)
+  {
+    std::vector<IdTask>       tasks(n);
+    std::set<std::thread::id> seen;
+    std::atomic<int>          left(n);
+
+    for (IdTask &task : tasks)
+    {
+      task.base.routine = recordId;
+      task.mutex        = &mutex;
+      task.ids          = &seen;
+      task.left         = &left;
+      executor->submit(&task.base);
+    }
+
+    while (left.load() > 0)
+      std::this_thread::yield();
+
+    return seen;
+  }
+
+  std::unique_ptr<Poller>   poller;
+  std::unique_ptr<Executor> executor;
+  std::mutex                mutex;
+  std::map<std::thread::id, int> ids; /* poller callbacks per thread */
+  std::atomic<bool>              slow{false};
+};
+
+TEST_F(AutoscalerTest, ExecutorParksAndWakesWorkers)
+{
+  std::vector<BarrierTask> tasks(4);
+  std::atomic<int>         arrived(0);
+  std::atomic<int>         left(4);
+
+  EXPECT_EQ(executor->setThreads(0), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(executor->setThreads(5), -1);
+
+  ASSERT_EQ(executor->setThreads(1), 0);
+  EXPECT_EQ(executor->threads(), 1);
+  EXPECT_EQ(runTasks(1000).size(), 1u);
+
+  /* All four must be running at once for any of these to finish. */
+  ASSERT_EQ(executor->setThreads(4), 0);
+  for (BarrierTask &task : tasks)
+  {
+    task.base.routine = barrier;
+    task.arrived      = &arrived;
+    task.left         = &left;
+    task.n            = 4;
+    executor->submit(&task.base);
+  }
+
+  while (left.load() > 0)
+    std::this_thread::yield();
+
+  ExecutorStats stats;
+
+  executor->getStats(&stats);
+  EXPECT_EQ(stats.threads, 4);
+  EXPECT_GE(stats.completed, 1000u);
+}
+
+TEST_F(AutoscalerTest, PollerParksFollowers)
+{
+  EXPECT_EQ(poller->setThreads(4), -1);
+  EXPECT_EQ(errno, EINVAL);
+  ASSERT_EQ(poller->setThreads(1), 0);
+  EXPECT_EQ(poller->threads(), 1);
+
+  /* Threads already waiting to lead get one more turn, at most. */
+  for (int i = 0; i < 100; i++)
+    tick();
+
+  int most = 0;
+
+  for (auto &count : ids)
+    most = std::max(most, count.second);
+
+  EXPECT_GE(most, 98);
+
+  ASSERT_EQ(poller->setThreads(3), 0);
+  slow = true;
+  ids.clear();
+  for (int i = 0; i < 200 && ids.size() < 2; i++)
+    tick();
+
+  EXPECT_GE(ids.size(), 2u);
+}
+
+TEST_F(AutoscalerTest, AdjustStepsWithinBounds)
+{
+  AutoscalerParams params = {};
+
+  params.minWorkers = 2;
+
+  Autoscaler scaler(poller.get(), executor.get(), &params);
+
+  /* Already at the pool sizes: nothing to add. */
+  EXPECT_EQ(scaler.adjust(0.9, 0.9, 0), 0);
+
+  EXPECT_EQ(scaler.adjust(0.1, 0.1, 0), -2);
+  EXPECT_EQ(poller->threads(), 2);
+  EXPECT_EQ(executor->threads(), 3);
+
+  /* In between: held. */
+  EXPECT_EQ(scaler.adjust(0.5, 0.5, 0), 0);
+
+  /* A long queue adds a worker however idle they look. */
+  EXPECT_EQ(scaler.adjust(0.5, 0.1, 5000), 1);
+  EXPECT_EQ(executor->threads(), 4);
+
+  for (int i = 0; i < 5; i++)
+    scaler.adjust(0.1, 0.1, 0);
+
+  EXPECT_EQ(poller->threads(), 1);
+  EXPECT_EQ(executor->threads(), 2);
+}
+
+TEST_F(AutoscalerTest, IdleThreadsParkInTheBackground)
+{
+  AutoscalerParams params = {};
+
+  params.interval = 10;
+
+  Autoscaler scaler(poller.get(), executor.get(), &params);
+  auto       start = std::chrono::steady_clock::now();
+
+  ASSERT_EQ(scaler.start(), 0);
+  while ((poller->threads() > 1 || executor->threads() > 1) &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  scaler.stop();
+  EXPECT_EQ(poller->threads(), 1);
+  EXPECT_EQ(executor->threads(), 1);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,246 @@
+#include <gtest/gtest.h>
+#include <time.h>
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ComputeExecutor.h"
+
+namespace
+{
+  struct SpinTask
+  {
+    ComputeTask       base;
+    int               id;
+    std::mutex       *mutex;
+    std::vector<int> *order;
+  };
+
+  int64_t cpuNow()
+  {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+  }
+
+  /* About 200us of CPU, then the queue it came from is recorded. */
+  void spin(ComputeTask *task)
+  {
+    SpinTask *t     = reinterpret_cast<SpinTask *>(task);
+    int64_t   start = cpuNow();
+
+    while (cpuNow() - start < 200000)
+      ;
+
+    std::lock_guard<std::mutex> lock(*t->mutex);
+    t->order->push_back(t->id);
+  }
+
+  struct GateTask
+  {
+    ComputeTask       base;
+    std::atomic<bool> entered{false};
+    std::atomic<bool> open{false};
+  };
+
+  void nap(ComputeTask *)
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+
+  void gate(ComputeTask *task)
+  {
+    GateTask *t = reinterpret_cast<GateTask *>(task);
+
+    t->entered = true;
+    while (!t->open)
+      std::this_thread::yield();
+  }
+} // namespace
+
+class ComputeExecutorTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override { ASSERT_EQ(executor.start(), 0); }
+
+  void TearDown() override { executor.stop(); }
+
+  /* n tasks for queue, labelled with its index. */
+  void submit(int queue, int n)
+  {
+    for (int i = 0; i < n; i++)
+    {
+      tasks.emplace_back(new SpinTask());
+      tasks.back()->base.routine = spin;
+      tasks.back()->id           = queue;
+      tasks.back()->mutex        = &mutex;
+      tasks.back()->order        = &order;
+      ASSERT_EQ(compute.submit(queue, &tasks.back()->base), 0);
+    }
+  }
+
+  /* Holds the only worker while the queues fill up. */
+  void hold(int queue)
+  {
+    blocker.base.routine = gate;
+    ASSERT_EQ(compute.submit(queue, &blocker.base), 0);
+    while (!blocker.entered)
+      std::this_thread::yield();
+  }
+
+  void release()
+  {
+    blocker.open = true;
+    wait();
+  }
+
+  void wait()
+  {
+    while (true)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (order.size() == tasks.size())
+          break;
+      }
+
+      std::this_thread::yield();
+    }
+  }
+
+  int count(int queue, size_t first)
+  {
+    int n = 0;
+
+    for (size_t i = 0; i < first && i < order.size(); i++)
+      n += order[i] == queue;
+
+    return n;
+  }
+
+  Executor                               executor{1};
+  ComputeExecutor                        compute{&executor};
+  GateTask                               blocker;
+  std::mutex                             mutex;
+  std::vector<int>                       order;
+  std::vector<std::unique_ptr<SpinTask>> tasks;
+};
+
+TEST_F(ComputeExecutorTest, NamedQueues)
+{
+  ComputeTask task = {};
+
+  EXPECT_EQ(compute.addQueue("batch", 0), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(compute.addQueue("batch", 1), 0);
+  EXPECT_EQ(compute.addQueue("online", 3), 1);
+  EXPECT_EQ(compute.addQueue("batch", 2), -1);
+  EXPECT_EQ(errno, EEXIST);
+
+  EXPECT_EQ(compute.findQueue("online"), 1);
+  EXPECT_EQ(compute.findQueue("nightly"), -1);
+  EXPECT_EQ(errno, ENOENT);
+
+  EXPECT_EQ(compute.submit(2, &task), -1);
+  EXPECT_EQ(errno, EINVAL);
+  EXPECT_EQ(compute.setWeight(0, 0), -1);
+  EXPECT_EQ(compute.setWeight(0, 2), 0);
+}
+
+TEST_F(ComputeExecutorTest, SharesFollowWeights)
+{
+  const int          batch  = compute.addQueue("batch", 1);
+  const int          online = compute.addQueue("online", 3);
+  ComputeQueueStats stats;
+
+  hold(compute.addQueue("gate", 1));
+  submit(batch, 40);
+  submit(online, 40);
+  release();
+
+  /* Three online tasks to each batch one while both are backlogged. */
+  EXPECT_GE(count(online, 40), 26);
+  EXPECT_LE(count(online, 40), 34);
+
+  ASSERT_EQ(compute.getStats(online, &stats), 0);
+  EXPECT_EQ(stats.weight, 3);
+  EXPECT_EQ(stats.queued, 0u);
+  EXPECT_EQ(stats.completed, 40u);
+  EXPECT_GE(stats.runTime, 40u * 200000);
+
+  size_t waited = 0;
+
+  /* All of them waited for the gate to open, which was well over 1us. */
+  for (int i = 0; i < COMPUTE_WAIT_BUCKETS; i++)
+    waited += stats.wait[i];
+
+  EXPECT_EQ(waited, 40u);
+  EXPECT_EQ(stats.wait[0], 0u);
+}
+
+TEST_F(ComputeExecutorTest, IdleQueueBanksNoCredit)
+{
+  const int a = compute.addQueue("a", 1);
+  const int b = compute.addQueue("b", 1);
+
+  /* a has had the executor to itself for a while... */
+  submit(a, 20);
+  wait();
+  order.clear();
+  tasks.clear();
+
+  /* ...which b, idle meanwhile, does not get to make up for. */
+  hold(compute.addQueue("gate", 1));
+  submit(a, 10);
+  submit(b, 10);
+  release();
+
+  EXPECT_GE(count(b, 10), 3);
+  EXPECT_LE(count(b, 10), 7);
+}
+
+TEST_F(ComputeExecutorTest, WaitCountsOnceStarted)
+{
+  const int         gate = compute.addQueue("gate", 1);
+  ComputeQueueStats stats;
+  size_t            waited = 0;
+
+  hold(gate);
+  ASSERT_EQ(compute.getStats(gate, &stats), 0);
+  for (int i = 0; i < COMPUTE_WAIT_BUCKETS; i++)
+    waited += stats.wait[i];
+
+  EXPECT_EQ(stats.completed, 0u);
+  EXPECT_EQ(waited, 1u);
+  release();
+}
+
+TEST_F(ComputeExecutorTest, SleepIsNotCharged)
+{
+  const int         queue = compute.addQueue("io", 1);
+  ComputeTask       task  = {};
+  ComputeQueueStats stats = {};
+
+  task.routine = nap;
+  ASSERT_EQ(compute.submit(queue, &task), 0);
+  while (stats.completed == 0)
+  {
+    std::this_thread::yield();
+    ASSERT_EQ(compute.getStats(queue, &stats), 0);
+  }
+
+  /* 20ms asleep, next to no CPU. */
+  EXPECT_LT(stats.runTime, 5000000u);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,270 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "CoreRuntime.h"
+#include "SpscRing.h"
+
+namespace
+{
+  /* Bounces between two cores until hops runs out. */
+  struct PingTask
+  {
+    ExecutorTask       base;
+    CoreRuntime       *runtime;
+    int                hops;
+    bool               wrongCore;
+    std::promise<void> done;
+  };
+
+  void ping(ExecutorTask *task)
+  {
+    PingTask *t    = reinterpret_cast<PingTask *>(task);
+    int       core = t->runtime->currentCore();
+
+    if (core != t->hops % 2)
+      t->wrongCore = true;
+
+    if (--t->hops < 0)
+    {
+      t->done.set_value();
+      return;
+    }
+
+    ASSERT_EQ(t->runtime->post(t->hops % 2, &t->base), 0);
+  }
+
+  struct WhereTask
+  {
+    ExecutorTask       base;
+    CoreRuntime       *runtime;
+    std::promise<int>  core;
+  };
+
+  void where(ExecutorTask *task)
+  {
+    WhereTask *t = reinterpret_cast<WhereTask *>(task);
+
+    t->core.set_value(t->runtime->currentCore());
+  }
+} // namespace
+
+TEST(SpscRingTest, BoundedAndOrdered)
+{
+  SpscRing<int> ring(3);
+  int           v;
+
+  EXPECT_EQ(ring.capacity(), 4u);
+  for (int i = 0; i < 4; i++)
+    EXPECT_TRUE(ring.push(i));
+
+  EXPECT_FALSE(ring.push(4));
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT_TRUE(ring.pop(&v));
+    EXPECT_EQ(v, i);
+  }
+
+  EXPECT_FALSE(ring.pop(&v));
+  EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRingTest, CrossThread)
+{
+  const int      n = 1000000;
+  SpscRing<int>  ring(64);
+  std::thread    producer(
+          [&]
+          {
+            for (int i = 0; i < n; i++)
+            {
+              while (!ring.push(i))
+                std::this_thread::yield();
+            }
+          });
+  int            v, expected = 0;
+
+  while (expected < n)
+  {
+    if (!ring.pop(&v))
+    {
+      std::this_thread::yield();
+      continue;
+    }
+
+    ASSERT_EQ(v, expected);
+    expected++;
+  }
+
+  producer.join();
+}
+
+class CoreRuntimeTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    CoreParams params = {};
+
+    params.cores        = 2;
+    params.ringSize     = 16;
+    params.maxOpenFiles = 4096;
+    runtime.reset(new CoreRuntime(&params));
+    ASSERT_EQ(runtime->start(), 0);
+  }
+
+  void TearDown() override { runtime->stop(); }
+
+  std::unique_ptr<CoreRuntime> runtime;
+};
+
+TEST_F(CoreRuntimeTest, PostsRunOnTheirCore)
+{
+  WhereTask tasks[2];
+
+  for (int i = 0; i < 2; i++)
+  {
+    tasks[i].base.routine = where;
+    tasks[i].runtime      = runtime.get();
+    ASSERT_EQ(runtime->post(i, &tasks[i].base), 0);
+  }
+
+  EXPECT_EQ(tasks[0].core.get_future().get(), 0);
+  EXPECT_EQ(tasks[1].core.get_future().get(), 1);
+  EXPECT_EQ(runtime->currentCore(), -1);
+}
+
+TEST_F(CoreRuntimeTest, CoresPingPongThroughRings)
+{
+  PingTask task;
+
+  task.base.routine = ping;
+  task.runtime      = runtime.get();
+  task.hops         = 10000;
+  task.wrongCore    = false;
+  ASSERT_EQ(runtime->post(0, &task.base), 0);
+  task.done.get_future().wait();
+  EXPECT_FALSE(task.wrongCore);
+}
+
+TEST_F(CoreRuntimeTest, FullRingPushesBack)
+{
+  struct Flood
+  {
+    ExecutorTask      base;
+    CoreRuntime      *runtime;
+    std::promise<int> refused;
+  } flood;
+  static ExecutorTask nop = {[](ExecutorTask *) {}, nullptr};
+
+  /* From core 0, post to core 1 faster than it can drain. */
+  flood.runtime      = runtime.get();
+  flood.base.routine = [](ExecutorTask *task)
+  {
+    Flood *f = reinterpret_cast<Flood *>(task);
+    int    i;
+
+    for (i = 0; i < 1000000; i++)
+    {
+      if (f->runtime->post(1, &nop) < 0)
+        break;
+    }
+
+    f->refused.set_value(i < 1000000 ? errno : 0);
+  };
+  ASSERT_EQ(runtime->post(0, &flood.base), 0);
+  EXPECT_EQ(flood.refused.get_future().get(), EAGAIN);
+}
+
+TEST_F(CoreRuntimeTest, StopFromACoreIsRefused)
+{
+  struct Stopper
+  {
+    ExecutorTask      base;
+    CoreRuntime      *runtime;
+    std::promise<int> error;
+  } stopper;
+  WhereTask tasks[2];
+
+  stopper.runtime      = runtime.get();
+  stopper.base.routine = [](ExecutorTask *task)
+  {
+    Stopper *s = reinterpret_cast<Stopper *>(task);
+
+    s->error.set_value(s->runtime->stop() < 0 ? errno : 0);
+  };
+  ASSERT_EQ(runtime->post(0, &stopper.base), 0);
+  EXPECT_EQ(stopper.error.get_future().get(), EDEADLK);
+
+  /* Both cores still run what is posted to them. */
+  for (int i = 0; i < 2; i++)
+  {
+    tasks[i].base.routine = where;
+    tasks[i].runtime      = runtime.get();
+    ASSERT_EQ(runtime->post(i, &tasks[i].base), 0);
+  }
+
+  EXPECT_EQ(tasks[0].core.get_future().get(), 0);
+  EXPECT_EQ(tasks[1].core.get_future().get(), 1);
+}
+
+TEST_F(CoreRuntimeTest, ReusePortSpreadsAccepts)
+{
+  const int          n = 32;
+  struct sockaddr_in addr = {};
+  std::mutex         mutex;
+  std::set<int>      cores;
+  std::atomic<int>   accepted{0};
+  std::vector<int>   fds;
+
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(runtime->listen(reinterpret_cast<struct sockaddr *>(&addr),
+                            sizeof addr,
+                            [&](int core, int fd)
+                            {
+                              EXPECT_EQ(runtime->currentCore(), core);
+                              {
+                                std::lock_guard<std::mutex> lock(mutex);
+                                cores.insert(core);
+                              }
+                              close(fd);
+                              accepted++;
+                            }),
+            0);
+  ASSERT_NE(addr.sin_port, 0);
+
+  for (int i = 0; i < n; i++)
+  {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    ASSERT_EQ(connect(fd, reinterpret_cast<struct sockaddr *>(&addr),
+                      sizeof addr),
+              0);
+    fds.push_back(fd);
+  }
+
+  while (accepted < n)
+    std::this_thread::yield();
+
+  for (int fd : fds)
+    close(fd);
+
+  /* Hashing on the client port: all on one core has odds of 2^-31. */
+  EXPECT_EQ(cores.size(), 2u);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,226 @@
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <future>
+#include <string>
+#include <thread>
+
+#include "Coroutine.h"
+#include "TaskScheduler.h"
+
+namespace
+{
+  CoTask sleepFor(TaskScheduler *scheduler, int ms,
+                  std::promise<std::thread::id> *done)
+  {
+    int ret = co_await CoSleep(scheduler, ms);
+
+    EXPECT_EQ(ret, 0);
+    co_await CoSwitch(scheduler->getExecutor());
+    done->set_value(std::this_thread::get_id());
+  }
+
+  CoTask echo(TaskScheduler *scheduler, int fd, std::promise<size_t> *done)
+  {
+    CoSocket socket(scheduler, fd);
+    char     buf[64];
+    size_t   total = 0;
+    ssize_t  n;
+
+    while ((n = co_await socket.read(buf, sizeof buf)) > 0)
+    {
+      EXPECT_EQ(co_await socket.write(buf, n), n);
+      total += n;
+    }
+
+    /* EOF took the fd out of the poller already. */
+    EXPECT_EQ(n, 0);
+    co_await socket.close();
+    done->set_value(total);
+  }
+
+  /* Reads nothing for ms, then everything up to EOF. */
+  CoTask drainLater(TaskScheduler *scheduler, int fd, int ms,
+                    std::promise<size_t> *done)
+  {
+    CoSocket socket(scheduler, fd);
+    char     buf[4096];
+    size_t   total = 0;
+    ssize_t  n;
+
+    EXPECT_EQ(co_await CoSleep(scheduler, ms), 0);
+    while ((n = co_await socket.read(buf, sizeof buf)) > 0)
+      total += n;
+
+    EXPECT_EQ(n, 0);
+    co_await socket.close();
+    done->set_value(total);
+  }
+
+  CoTask acceptOne(TaskScheduler *scheduler, int fd, std::promise<int> *done)
+  {
+    CoListener listener(scheduler, fd);
+    int        conn = co_await listener.accept();
+
+    co_await listener.close();
+    done->set_value(conn);
+  }
+
+  CoTask connectTo(TaskScheduler *scheduler, int fd,
+                   const struct sockaddr_in *addr, std::promise<int> *done)
+  {
+    int ret = co_await CoConnect(
+            scheduler, fd, reinterpret_cast<const struct sockaddr *>(addr),
+            sizeof *addr, 1000);
+
+    done->set_value(ret);
+  }
+
+  CoTask receive(TaskScheduler *scheduler, int fd,
+                 std::promise<std::string> *done)
+  {
+    CoDatagram datagram(scheduler, fd);
+    char       buf[64];
+    ssize_t    n = co_await datagram.recvfrom(buf, sizeof buf);
+
+    co_await datagram.close();
+    done->set_value(std::string(buf, n > 0 ? n : 0));
+  }
+} // namespace
+
+class CoroutineTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override { ASSERT_EQ(scheduler.start(), 0); }
+
+  void TearDown() override { scheduler.stop(); }
+
+  TaskScheduler scheduler{2, 4096};
+};
+
+TEST_F(CoroutineTest, SleepsThenSwitchesToTheExecutor)
+{
+  std::promise<std::thread::id> done;
+
+  sleepFor(&scheduler, 10, &done);
+  EXPECT_NE(done.get_future().get(), std::this_thread::get_id());
+}
+
+TEST_F(CoroutineTest, EchoesUntilEof)
+{
+  std::promise<size_t> done;
+  std::string          reply;
+  char                 buf[64];
+  int                  sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  echo(&scheduler, sv[0], &done);
+
+  /* The client end blocks. */
+  ASSERT_EQ(fcntl(sv[1], F_SETFL, 0), 0);
+  for (int i = 0; i < 100; i++)
+  {
+    std::string msg = "message " + std::to_string(i);
+
+    ASSERT_EQ(write(sv[1], msg.data(), msg.size()), (ssize_t) msg.size());
+    reply.clear();
+    while (reply.size() < msg.size())
+    {
+      ssize_t n = read(sv[1], buf, sizeof buf);
+
+      ASSERT_GT(n, 0);
+      reply.append(buf, n);
+    }
+
+    EXPECT_EQ(reply, msg);
+  }
+
+  shutdown(sv[1], SHUT_WR);
+  EXPECT_GT(done.get_future().get(), 0u);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST_F(CoroutineTest, UnreadBytesStopTheReads)
+{
+  std::promise<size_t> done;
+  std::string          chunk(65536, 'x');
+  size_t               written = 0;
+  int                  sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  drainLater(&scheduler, sv[0], 500, &done);
+
+  /* Whatever the poller buffers, the rest backs up into the socket. */
+  auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+  while (std::chrono::steady_clock::now() < until &&
+         written < 64 * chunk.size())
+  {
+    ssize_t n = write(sv[1], chunk.data(), chunk.size());
+
+    if (n > 0)
+      written += n;
+    else
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  EXPECT_LT(written, 32 * chunk.size());
+  shutdown(sv[1], SHUT_WR);
+  EXPECT_EQ(done.get_future().get(), written);
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST_F(CoroutineTest, AcceptsAndConnects)
+{
+  std::promise<int>  accepted, connected;
+  struct sockaddr_in addr = {};
+  socklen_t          len  = sizeof addr;
+  int                lfd, cfd, conn;
+
+  lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  ASSERT_GE(lfd, 0);
+  addr.sin_family      = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  ASSERT_EQ(bind(lfd, reinterpret_cast<struct sockaddr *>(&addr), len), 0);
+  ASSERT_EQ(getsockname(lfd, reinterpret_cast<struct sockaddr *>(&addr), &len),
+            0);
+  ASSERT_EQ(listen(lfd, 16), 0);
+
+  cfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+  ASSERT_GE(cfd, 0);
+  acceptOne(&scheduler, lfd, &accepted);
+  connectTo(&scheduler, cfd, &addr, &connected);
+
+  EXPECT_EQ(connected.get_future().get(), 0);
+  conn = accepted.get_future().get();
+  EXPECT_GE(conn, 0);
+
+  close(conn);
+  close(cfd);
+  close(lfd);
+}
+
+TEST_F(CoroutineTest, ReceivesDatagrams)
+{
+  std::promise<std::string> done;
+  int                       sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, sv), 0);
+  receive(&scheduler, sv[0], &done);
+  ASSERT_EQ(write(sv[1], "datagram", 8), 8);
+  EXPECT_EQ(done.get_future().get(), "datagram");
+  close(sv[0]);
+  close(sv[1]);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
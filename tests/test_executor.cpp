@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+#include "Executor.h"
+#include "Poller.h"
+
+namespace
+{
+  struct CountTask
+  {
+    ExecutorTask         base;
+    std::atomic<int>    *count;
+  };
+
+  void count(ExecutorTask *task)
+  {
+    reinterpret_cast<CountTask *>(task)->count->fetch_add(1);
+  }
+
+  /* Splits itself in two until depth runs out, from a worker. */
+  struct TreeTask
+  {
+    ExecutorTask               base;
+    Executor                  *executor;
+    int                        depth;
+    std::atomic<int>          *leaves;
+    std::mutex                *mutex;
+    std::set<std::thread::id> *threads;
+  };
+
+  void split(ExecutorTask *task)
+  {
+    TreeTask *t = reinterpret_cast<TreeTask *>(task);
+
+    {
+      std::lock_guard<std::mutex> lock(*t->mutex);
+      t->threads->insert(std::this_thread::get_id());
+    }
+
+    if (t->depth == 0)
+    {
+      t->leaves->fetch_add(1);
+      delete t;
+      return;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+      TreeTask *child = new TreeTask(*t);
+
+      child->depth--;
+      t->executor->submit(&child->base);
+    }
+
+    delete t;
+  }
+
+  /* Holds the worker that runs it until released. */
+  struct GateTask
+  {
+    ExecutorTask      base;
+    std::atomic<bool> entered{false};
+    std::atomic<bool> open{false};
+  };
+
+  void gate(ExecutorTask *task)
+  {
+    GateTask *t = reinterpret_cast<GateTask *>(task);
+
+    t->entered = true;
+    while (!t->open)
+      std::this_thread::yield();
+  }
+
+  struct OrderTask
+  {
+    ExecutorTask      base;
+    int               id;
+    std::vector<int> *order;
+  };
+
+  void record(ExecutorTask *task)
+  {
+    OrderTask *t = reinterpret_cast<OrderTask *>(task);
+
+    t->order->push_back(t->id);
+  }
+
+  int append(const void *, size_t *, PollerMessage *) { return 1; }
+
+  PollerMessage *createMessage(void *context)
+  {
+    return static_cast<Arena *>(context)->createMessage(0, append);
+  }
+} // namespace
+
+class ExecutorTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override { ASSERT_EQ(executor.start(), 0); }
+
+  void TearDown() override { executor.stop(); }
+
+  Executor executor{4};
+};
+
+TEST_F(ExecutorTest, RunsEverythingSubmittedFromOutside)
+{
+  const int              n = 100000;
+  std::atomic<int>       done{0};
+  std::vector<CountTask> tasks(n);
+
+  for (CountTask &task : tasks)
+  {
+    task.base.routine = count;
+    task.count        = &done;
+    executor.submit(&task.base);
+  }
+
+  executor.stop();
+  EXPECT_EQ(done, n);
+}
+
+TEST_F(ExecutorTest, WorkersStealSpawnedTasks)
+{
+  std::atomic<int>          leaves{0};
+  std::mutex                mutex;
+  std::set<std::thread::id> threads;
+  TreeTask                 *root = new TreeTask();
+
+  root->base.routine = split;
+  root->executor     = &executor;
+  root->depth        = 14;
+  root->leaves       = &leaves;
+  root->mutex        = &mutex;
+  root->threads      = &threads;
+  executor.submit(&root->base);
+
+  executor.stop();
+  EXPECT_EQ(leaves, 1 << 14);
+  EXPECT_FALSE(threads.count(std::this_thread::get_id()));
+}
+
+TEST(ExecutorDueTest, EarliestDeadlineFirst)
+{
+  Executor               one(1);
+  GateTask               blocker;
+  std::vector<int>       order;
+  std::vector<OrderTask> tasks(5);
+  const int64_t          deadlines[] = {50, 10, 40, 20, 30};
+
+  ASSERT_EQ(one.start(), 0);
+  blocker.base.routine = gate;
+  one.submit(&blocker.base);
+  while (!blocker.entered)
+    std::this_thread::yield();
+
+  for (int i = 0; i < 5; i++)
+  {
+    tasks[i].base.routine = record;
+    tasks[i].id           = deadlines[i];
+    tasks[i].order        = &order;
+    one.submit(&tasks[i].base, deadlines[i]);
+  }
+
+  blocker.open = true;
+  one.stop();
+  EXPECT_EQ(order, std::vector<int>({10, 20, 30, 40, 50}));
+}
+
+TEST(ExecutorDueTest, PlainTasksAreNotStarved)
+{
+  Executor               one(1);
+  GateTask               blocker;
+  std::vector<int>       order;
+  std::vector<OrderTask> tasks(101);
+
+  ASSERT_EQ(one.start(), 0);
+  blocker.base.routine = gate;
+  one.submit(&blocker.base);
+  while (!blocker.entered)
+    std::this_thread::yield();
+
+  for (int i = 0; i <= 100; i++)
+  {
+    tasks[i].base.routine = record;
+    tasks[i].id           = i;
+    tasks[i].order        = &order;
+    if (i < 100)
+      one.submit(&tasks[i].base, i);
+    else
+      one.submit(&tasks[i].base);
+  }
+
+  blocker.open = true;
+  one.stop();
+
+  /* After a burst (EXECUTOR_DUE_BURST) of due ones, not after all. */
+  ASSERT_EQ(order.size(), 101u);
+  EXPECT_EQ(order[8], 100);
+}
+
+TEST_F(ExecutorTest, PollerResultsRunOnWorkers)
+{
+  PollerParams                  params = {};
+  PollerData                    data   = {};
+  Arena                         arena;
+  std::promise<std::thread::id> ran;
+  std::atomic<int>              messages{0};
+  int                           sv[2];
+
+  params.maxOpenFiles = 4096;
+  params.executor     = &executor;
+  params.callback     = [&](PollerResult *res, void *)
+  {
+    if (res->data.operation == PD_OP_TIMER)
+      ran.set_value(std::this_thread::get_id());
+    else if (res->state == PR_ST_SUCCESS)
+      messages++;
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  ASSERT_EQ(poller.start(), 0);
+  ASSERT_EQ(poller.addTimer(0, nullptr), 0);
+  EXPECT_NE(ran.get_future().get(), std::this_thread::get_id());
+
+  /* Arena messages go back to the poller after each callback. */
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  data.operation     = PD_OP_READ;
+  data.flags         = PD_FL_PERSISTENT;
+  data.fd            = sv[0];
+  data.createMessage = createMessage;
+  data.context       = &arena;
+  ASSERT_EQ(poller.add(&data, -1), 0);
+  for (int i = 0; i < 100; i++)
+  {
+    ASSERT_EQ(write(sv[1], "x", 1), 1);
+    while (messages <= i)
+      std::this_thread::yield();
+  }
+
+  poller.stop();
+  close(sv[0]);
+  close(sv[1]);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
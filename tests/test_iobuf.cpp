@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <string.h>
+
+#include <string>
+
+#include "IOBuf.h"
+
+class IOBufTest : public ::testing::Test
+{
+  protected:
+  std::string toString(const IOBuf &buf)
+  {
+    std::string str(buf.length(), '\0');
+    buf.copyOut(&str[0], str.size());
+    return str;
+  }
+
+  IOBuf buf;
+};
+
+TEST_F(IOBufTest, InitiallyEmpty)
+{
+  EXPECT_TRUE(buf.empty());
+  EXPECT_EQ(buf.length(), 0);
+}
+
+TEST_F(IOBufTest, AppendCopiesIntoOneBlock)
+{
+  struct iovec iov[4];
+
+  buf.append("hello ", 6);
+  buf.append("world", 5);
+  EXPECT_EQ(toString(buf), "hello world");
+  EXPECT_EQ(buf.peekIovec(iov, 4), 1);
+}
+
+TEST_F(IOBufTest, CutFrontSharesBytes)
+{
+  IOBuf        head;
+  struct iovec before, after;
+
+  buf.append("header:body", 11);
+  buf.peekIovec(&before, 1);
+  EXPECT_EQ(buf.cutFront(7, &head), 7);
+  head.peekIovec(&after, 1);
+
+  EXPECT_EQ(after.iov_base, before.iov_base);
+  EXPECT_EQ(toString(head), "header:");
+  EXPECT_EQ(toString(buf), "body");
+}
+
+TEST_F(IOBufTest, SharedTailIsNotOverwritten)
+{
+  IOBuf copy;
+
+  buf.append("abc", 3);
+  copy = buf.clone();
+  buf.append("def", 3);
+  EXPECT_EQ(toString(copy), "abc");
+  EXPECT_EQ(toString(buf), "abcdef");
+}
+
+TEST_F(IOBufTest, ForwardChainWithoutCopy)
+{
+  IOBuf        out;
+  IOBufBlock  *block = IOBuf::newBlock(64);
+  struct iovec iov[2];
+
+  memcpy(block->data, "0123456789", 10);
+  block->used = 10;
+  buf.append(block, 0, 4);
+  buf.append(block, 4, 6);
+  IOBuf::unref(block);
+
+  out.append(std::move(buf));
+  EXPECT_TRUE(buf.empty());
+  ASSERT_EQ(out.peekIovec(iov, 2), 2);
+  EXPECT_EQ(iov[0].iov_base, static_cast<void *>(block->data));
+  EXPECT_EQ(toString(out), "0123456789");
+}
+
+TEST_F(IOBufTest, PopFrontAcrossSlices)
+{
+  IOBuf other;
+
+  buf.append("aaa", 3);
+  other.append("bbb", 3);
+  buf.append(std::move(other));
+  buf.popFront(4);
+  EXPECT_EQ(toString(buf), "bb");
+  buf.popFront(10);
+  EXPECT_TRUE(buf.empty());
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,181 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <future>
+#include <vector>
+
+#include "Poller.h"
+
+namespace
+{
+  /* Every read is a whole message. */
+  int append(const void *, size_t *, PollerMessage *) { return 1; }
+
+  PollerMessage *createMessage(void *)
+  {
+    PollerMessage *msg = static_cast<PollerMessage *>(calloc(1, sizeof *msg));
+
+    msg->append = append;
+    return msg;
+  }
+} // namespace
+
+class PollerAdaptTest : public ::testing::Test
+{
+  protected:
+  void start(PollerParams *params)
+  {
+    params->maxOpenFiles = 4096;
+    params->callback     = [this](PollerResult *res, void *)
+    {
+      PollerStats stats;
+
+      poller->getStats(&stats);
+      if (stats.readSize != 0)
+      {
+        readSizes[0] = std::min(readSizes[0], stats.readSize);
+        readSizes[1] = std::max(readSizes[1], stats.readSize);
+      }
+
+      waitEvents[0] = std::min(waitEvents[0], stats.waitEvents);
+      waitEvents[1] = std::max(waitEvents[1], stats.waitEvents);
+      if (res->data.operation == PD_OP_TIMER)
+        synced.set_value();
+      else if (res->data.operation == PD_OP_READ &&
+               res->state == PR_ST_SUCCESS)
+      {
+        free(res->data.message);
+        messages++;
+      }
+
+      delete reinterpret_cast<PollerNode *>(res);
+    };
+
+    poller = new Poller(params);
+    ASSERT_EQ(poller->start(), 0);
+  }
+
+  void TearDown() override
+  {
+    poller->stop();
+    delete poller;
+    for (int fd : fds)
+      close(fd);
+  }
+
+  /* Commands are applied in order, so a zero timer marks the ones before. */
+  void sync()
+  {
+    synced = std::promise<void>();
+    ASSERT_EQ(poller->addTimer(0, nullptr), 0);
+    synced.get_future().wait();
+  }
+
+  /* Until n messages in all. */
+  void waitMessages(const int n)
+  {
+    do
+      sync();
+    while (messages < n);
+  }
+
+  /* A reader; the other end is returned for writing. */
+  int reader(PollerData *data)
+  {
+    int sv[2];
+
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    *data               = {};
+    data->operation     = PD_OP_READ;
+    data->fd            = sv[0];
+    data->createMessage = createMessage;
+    return sv[1];
+  }
+
+  PollerStats stats()
+  {
+    PollerStats stats;
+
+    poller->getStats(&stats);
+    return stats;
+  }
+
+  Poller            *poller;
+  std::promise<void> synced;
+  std::atomic<int>   messages{0};
+  size_t             readSizes[2]  = {SIZE_MAX, 0}; /* min, max seen */
+  size_t             waitEvents[2] = {SIZE_MAX, 0};
+  std::vector<int>   fds;
+};
+
+TEST_F(PollerAdaptTest, ReadSizeFollowsTheTraffic)
+{
+  PollerParams      params = {};
+  PollerData        data;
+  std::vector<char> bulk(48 * 1024, 'x');
+  int               fd;
+
+  params.readSizeMin = 1024;
+  params.readSizeMax = 64 * 1024;
+  start(&params);
+
+  /* Past the first read, FIONREAD sizes the next: no doubling steps. */
+  fd = reader(&data);
+  ASSERT_EQ(write(fd, bulk.data(), bulk.size()), (ssize_t) bulk.size());
+  ASSERT_EQ(poller->add(&data, -1), 0);
+  while (stats().readBytes < bulk.size())
+    sync();
+
+  EXPECT_EQ(stats().readSize, params.readSizeMax);
+  EXPECT_LE(stats().readCalls, 3u);
+
+  /* Small requests halve it, down to the minimum and no further. */
+  for (int i = 0; i < 10; i++)
+  {
+    const int n = messages;
+
+    ASSERT_EQ(write(fd, "ping", 4), 4);
+    waitMessages(n + 1);
+  }
+
+  EXPECT_EQ(stats().readSize, params.readSizeMin);
+  EXPECT_EQ(readSizes[0], params.readSizeMin);
+  EXPECT_EQ(readSizes[1], params.readSizeMax);
+}
+
+TEST_F(PollerAdaptTest, BatchFollowsTheEvents)
+{
+  PollerParams            params = {};
+  const int               n      = 64;
+  std::vector<PollerData> data(n);
+
+  params.eventsMin = 4;
+  params.eventsMax = 16;
+  start(&params);
+
+  /* All ready at once: the batch comes back full until the maximum. */
+  for (PollerData &d : data)
+    ASSERT_EQ(write(reader(&d), "x", 1), 1);
+
+  ASSERT_EQ(poller->addBatch(data.data(), n, -1), 0);
+  waitMessages(n);
+  EXPECT_EQ(waitEvents[1], (size_t) params.eventsMax);
+
+  /* Idle, it falls back to the minimum. */
+  for (int i = 0; i < 8; i++)
+    sync();
+
+  EXPECT_EQ(stats().waitEvents, (size_t) params.eventsMin);
+  EXPECT_EQ(waitEvents[0], (size_t) params.eventsMin);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,218 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Poller.h"
+
+namespace
+{
+  PollerMessage *createMessage(void *) { return nullptr; }
+
+  struct Ended
+  {
+    int   fd;
+    int   state;
+    int   error;
+    void *context;
+  };
+} // namespace
+
+class PollerApiTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    PollerParams params = {};
+
+    params.maxOpenFiles = 4096;
+    params.callback     = [this](PollerResult *res, void *)
+    {
+      if (res->data.operation == PD_OP_TIMER)
+        synced.set_value();
+      else
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        ended.push_back(
+                {res->data.fd, res->state, res->error, res->data.context});
+      }
+
+      delete reinterpret_cast<PollerNode *>(res);
+    };
+
+    poller = new Poller(&params);
+    ASSERT_EQ(poller->start(), 0);
+  }
+
+  void TearDown() override
+  {
+    poller->stop();
+    delete poller;
+    for (int fd : fds)
+      close(fd);
+  }
+
+  /* Commands are applied in order, so a zero timer marks the ones before. */
+  void sync()
+  {
+    synced = std::promise<void>();
+    ASSERT_EQ(poller->addTimer(0, nullptr), 0);
+    synced.get_future().wait();
+  }
+
+  /* n readers on fresh socketpairs, to be added. */
+  std::vector<PollerData> readers(const int n)
+  {
+    std::vector<PollerData> data(n);
+    int                     sv[2];
+
+    for (int i = 0; i < n; i++)
+    {
+      EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+      fds.push_back(sv[0]);
+      fds.push_back(sv[1]);
+      data[i]               = {};
+      data[i].operation     = PD_OP_READ;
+      data[i].fd            = sv[0];
+      data[i].createMessage = createMessage;
+    }
+
+    return data;
+  }
+
+  size_t ctlCalls() const
+  {
+    PollerStats stats;
+
+    poller->getStats(&stats);
+    return stats.ctlCalls;
+  }
+
+  size_t endedCount()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    return ended.size();
+  }
+
+  Poller            *poller;
+  std::promise<void> synced;
+  std::mutex         mutex;
+  std::vector<Ended> ended;
+  std::vector<int>   fds;
+};
+
+TEST_F(PollerApiTest, BatchAddsAllWithOneCtlEach)
+{
+  const int               n    = 64;
+  std::vector<PollerData> data = readers(n);
+  const size_t            ctl  = ctlCalls();
+
+  ASSERT_EQ(poller->addBatch(data.data(), n, -1), 0);
+  sync();
+  EXPECT_EQ(ctlCalls(), ctl + n);
+  EXPECT_EQ(endedCount(), 0u);
+
+  /* All in: adding any of them again fails. */
+  ASSERT_EQ(poller->add(&data[n / 2], -1), 0);
+  sync();
+  ASSERT_EQ(endedCount(), 1u);
+  EXPECT_EQ(ended[0].error, EEXIST);
+}
+
+TEST_F(PollerApiTest, BatchWithABadEntryAddsNothing)
+{
+  const int               n    = 8;
+  std::vector<PollerData> data = readers(n);
+  const size_t            ctl  = ctlCalls();
+
+  data[n - 1].fd = 4096; /* past maxOpenFiles */
+  errno          = 0;
+  EXPECT_EQ(poller->addBatch(data.data(), n, -1), -1);
+  EXPECT_EQ(errno, EBADF);
+
+  data[n - 1].fd        = data[0].fd;
+  data[n - 1].operation = 0xff;
+  errno                 = 0;
+  EXPECT_EQ(poller->addBatch(data.data(), n, -1), -1);
+  EXPECT_EQ(errno, EINVAL);
+
+  sync();
+  EXPECT_EQ(ctlCalls(), ctl);
+  EXPECT_EQ(endedCount(), 0u);
+}
+
+TEST_F(PollerApiTest, DuplicateFdInABatchKeepsTheFirst)
+{
+  std::vector<PollerData> data = readers(2);
+  int                     first, second;
+
+  data.push_back(data[0]);
+  data[0].context = &first;
+  data[2].context = &second;
+  ASSERT_EQ(poller->addBatch(data.data(), 3, -1), 0);
+  sync();
+
+  ASSERT_EQ(endedCount(), 1u);
+  EXPECT_EQ(ended[0].context, &second);
+  EXPECT_EQ(ended[0].state, PR_ST_ERROR);
+  EXPECT_EQ(ended[0].error, EEXIST);
+
+  /* The node in is the first one. */
+  ASSERT_EQ(poller->del(data[0].fd), 0);
+  sync();
+  ASSERT_EQ(endedCount(), 2u);
+  EXPECT_EQ(ended[1].context, &first);
+  EXPECT_EQ(ended[1].state, PR_ST_DELETED);
+}
+
+TEST_F(PollerApiTest, BatchRearmsManyTimeouts)
+{
+  const int               n    = 64;
+  std::vector<PollerData> data = readers(n);
+  std::vector<int>        all;
+  auto                    start = std::chrono::steady_clock::now();
+
+  for (const PollerData &d : data)
+    all.push_back(d.fd);
+
+  ASSERT_EQ(poller->addBatch(data.data(), n, 200), 0);
+
+  /* Pushed well past the first deadline, then a bad batch changes none. */
+  ASSERT_EQ(poller->setTimeoutBatch(all.data(), n, 10000), 0);
+  all.push_back(4096);
+  EXPECT_EQ(poller->setTimeoutBatch(all.data(), n + 1, 0), -1);
+  EXPECT_EQ(errno, EBADF);
+  all.pop_back();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(400));
+  sync();
+  EXPECT_EQ(endedCount(), 0u);
+
+  /* And all brought in again at once. */
+  ASSERT_EQ(poller->setTimeoutBatch(all.data(), n, 10), 0);
+  while (endedCount() < (size_t) n)
+    std::this_thread::yield();
+
+  for (const Ended &e : ended)
+  {
+    EXPECT_EQ(e.state, PR_ST_ERROR);
+    EXPECT_EQ(e.error, ETIMEDOUT);
+  }
+
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::seconds(5));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,258 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "Poller.h"
+
+namespace
+{
+  const size_t MESSAGE_SIZE = 1000;
+
+  /* Fixed-size messages; a size of 0 never completes. */
+  struct FixedMessage
+  {
+    PollerMessage base;
+    size_t        size;
+  };
+
+  int append(const void *, size_t *n, PollerMessage *msg)
+  {
+    const size_t size = reinterpret_cast<FixedMessage *>(msg)->size;
+
+    if (size == 0)
+      return 0;
+
+    if (msg->bytes + *n >= size)
+    {
+      *n = size - msg->bytes;
+      return 1;
+    }
+
+    return 0;
+  }
+
+  PollerMessage *createMessage(void *context)
+  {
+    FixedMessage *msg = static_cast<FixedMessage *>(calloc(1, sizeof *msg));
+
+    msg->base.append = append;
+    msg->size        = reinterpret_cast<size_t>(context);
+    return &msg->base;
+  }
+} // namespace
+
+class PollerBudgetTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  }
+
+  void TearDown() override
+  {
+    poller->stop();
+    delete poller;
+    close(sv[0]);
+    close(sv[1]);
+    for (PollerResult *res : results)
+      release(res);
+  }
+
+  void start(PollerParams *params, size_t messageSize)
+  {
+    PollerData data = {};
+
+    params->maxOpenFiles = 4096;
+    params->callback     = [this](PollerResult *res, void *)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (res->data.operation == PD_OP_TIMER)
+      {
+        synced.set_value();
+        delete reinterpret_cast<PollerNode *>(res);
+      } else
+        results.push_back(res);
+    };
+
+    poller = new Poller(params);
+    ASSERT_EQ(poller->start(), 0);
+
+    data.operation     = PD_OP_READ;
+    data.flags         = PD_FL_PERSISTENT;
+    data.fd            = sv[0];
+    data.createMessage = createMessage;
+    data.context       = reinterpret_cast<void *>(messageSize);
+    ASSERT_EQ(poller->add(&data, -1), 0);
+  }
+
+  void sync()
+  {
+    synced = std::promise<void>();
+    ASSERT_EQ(poller->addTimer(0, nullptr), 0);
+    synced.get_future().wait();
+  }
+
+  void waitResults(size_t n)
+  {
+    while (1)
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      if (results.size() >= n)
+        break;
+    }
+  }
+
+  void release(PollerResult *res)
+  {
+    free(res->data.message);
+    delete reinterpret_cast<PollerNode *>(res);
+  }
+
+  Poller                     *poller = nullptr;
+  std::promise<void>          synced;
+  std::mutex                  mutex;
+  std::vector<PollerResult *> results;
+  int                         sv[2];
+};
+
+TEST_F(PollerBudgetTest, OversizedMessageFails)
+{
+  PollerParams      params = {};
+  const std::string body(64 * 1024, 'x');
+
+  params.readBudget = 16 * 1024;
+  start(&params, 0);
+  ASSERT_EQ(write(sv[1], body.data(), body.size()), (ssize_t)body.size());
+
+  while (1)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (!results.empty())
+      break;
+  }
+
+  EXPECT_EQ(results[0]->state, PR_ST_ERROR);
+  EXPECT_EQ(results[0]->error, EMSGSIZE);
+}
+
+TEST_F(PollerBudgetTest, ReadsPauseUntilReleased)
+{
+  PollerParams      params = {};
+  PollerStats       stats;
+  const size_t      count = 2000;
+  const std::string body(count * MESSAGE_SIZE, 'x');
+
+  params.pollerReadBudget = 10 * MESSAGE_SIZE;
+  start(&params, MESSAGE_SIZE);
+
+  std::thread writer([&]
+  {
+    for (size_t off = 0; off < body.size();)
+    {
+      const ssize_t n = write(sv[1], body.data() + off, body.size() - off);
+
+      if (n > 0)
+        off += n;
+      else
+        usleep(1000);
+    }
+  });
+
+  /* Reads go on until the budget is crossed, then stop. */
+  for (size_t n = 0; n == 0;)
+  {
+    poller->getStats(&stats);
+    n = stats.pausedReads;
+  }
+
+  sync();
+  poller->getStats(&stats);
+  EXPECT_GE(stats.inboundBytes, params.pollerReadBudget);
+  EXPECT_LT(stats.inboundBytes, body.size());
+  EXPECT_EQ(stats.pausedReads, 1u);
+
+  /* Releasing what was delivered lets the rest through. */
+  size_t received = 0;
+
+  while (received < count)
+  {
+    std::vector<PollerResult *> batch;
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      batch.swap(results);
+    }
+
+    for (PollerResult *res : batch)
+    {
+      EXPECT_EQ(res->state, PR_ST_SUCCESS);
+      EXPECT_EQ(poller->release(res), 0);
+      release(res);
+    }
+
+    received += batch.size();
+  }
+
+  writer.join();
+  sync();
+  poller->getStats(&stats);
+  EXPECT_EQ(stats.inboundBytes, 0u);
+  EXPECT_EQ(stats.pausedReads, 0u);
+}
+
+TEST_F(PollerBudgetTest, StaleReleaseLeavesTheNextNodeAlone)
+{
+  PollerParams      params = {};
+  PollerData        data   = {};
+  PollerStats       stats;
+  const std::string body(2 * MESSAGE_SIZE, 'x');
+
+  params.readBudget = 2 * MESSAGE_SIZE;
+  start(&params, MESSAGE_SIZE);
+  ASSERT_EQ(write(sv[1], body.data(), MESSAGE_SIZE), (ssize_t) MESSAGE_SIZE);
+  waitResults(1);
+  ASSERT_EQ(poller->del(sv[0]), 0);
+  waitResults(2);
+
+  /* The fd again, with a new node that fills its budget. */
+  data.operation     = PD_OP_READ;
+  data.flags         = PD_FL_PERSISTENT;
+  data.fd            = sv[0];
+  data.createMessage = createMessage;
+  data.context       = reinterpret_cast<void *>(MESSAGE_SIZE);
+  ASSERT_EQ(poller->add(&data, -1), 0);
+  ASSERT_EQ(write(sv[1], body.data(), body.size()), (ssize_t) body.size());
+  waitResults(4);
+  sync();
+  poller->getStats(&stats);
+  EXPECT_EQ(stats.pausedReads, 1u);
+
+  /* A message of the first node does not count against the second. */
+  EXPECT_EQ(poller->release(results[0]), 0);
+  sync();
+  poller->getStats(&stats);
+  EXPECT_EQ(stats.pausedReads, 1u);
+
+  EXPECT_EQ(poller->release(results[2]), 0);
+  EXPECT_EQ(poller->release(results[3]), 0);
+  sync();
+  poller->getStats(&stats);
+  EXPECT_EQ(stats.pausedReads, 0u);
+  EXPECT_EQ(stats.inboundBytes, 0u);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,295 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Poller.h"
+#include "Rebalancer.h"
+
+namespace
+{
+  const size_t MESSAGE_SIZE = 10;
+
+  int append(const void *, size_t *n, PollerMessage *msg)
+  {
+    if (msg->bytes + *n < MESSAGE_SIZE)
+      return 0;
+
+    *n = MESSAGE_SIZE - msg->bytes;
+    return 1;
+  }
+
+  PollerMessage *createMessage(void *)
+  {
+    PollerMessage *msg =
+            static_cast<PollerMessage *>(calloc(1, sizeof(PollerMessage)));
+
+    msg->append = append;
+    return msg;
+  }
+
+  struct Seen
+  {
+    int     poller; /* params.content of the poller that delivered it */
+    int     fd;
+    int     state;
+    int     error;
+    size_t  bytes;
+  };
+} // namespace
+
+class PollerMigrateTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      PollerParams params = {};
+
+      params.maxOpenFiles = 4096;
+      params.content      = reinterpret_cast<void *>((intptr_t) i);
+      params.callback     = [this](PollerResult *res, void *content)
+      {
+        Seen seen = {(int) reinterpret_cast<intptr_t>(content), res->data.fd,
+                     res->state, res->error, 0};
+
+        if (res->data.operation == PD_OP_READ && res->data.message)
+        {
+          seen.bytes = res->data.message->bytes;
+          free(res->data.message);
+        }
+
+        if (res->data.operation != PD_OP_TIMER)
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+
+          results.push_back(seen);
+        } else
+          synced[seen.poller].set_value();
+
+        delete reinterpret_cast<PollerNode *>(res);
+      };
+      pollers[i] = new Poller(&params);
+      ASSERT_EQ(pollers[i]->start(), 0);
+    }
+  }
+
+  void TearDown() override
+  {
+    for (Poller *poller : pollers)
+    {
+      poller->stop();
+      delete poller;
+    }
+
+    for (int fd : fds)
+      close(fd);
+  }
+
+  /* A socketpair whose first end is read by pollers[i]. */
+  int connect(int i, int *peer, int timeout = -1)
+  {
+    PollerData data = {};
+    int        sv[2];
+
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    data.operation     = PD_OP_READ;
+    data.flags         = PD_FL_PERSISTENT;
+    data.fd            = sv[0];
+    data.createMessage = createMessage;
+    EXPECT_EQ(pollers[i]->add(&data, timeout), 0);
+    *peer = sv[1];
+    return sv[0];
+  }
+
+  /* Both pollers have applied everything submitted before. */
+  void sync()
+  {
+    for (int i = 0; i < 2; i++)
+    {
+      synced[i] = std::promise<void>();
+      ASSERT_EQ(pollers[i]->addTimer(0, nullptr), 0);
+      synced[i].get_future().wait();
+    }
+  }
+
+  std::vector<Seen> take()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<Seen>           out;
+
+    out.swap(results);
+    return out;
+  }
+
+  Poller            *pollers[2];
+  std::promise<void> synced[2];
+  std::mutex         mutex;
+  std::vector<Seen>  results;
+  std::vector<int>   fds;
+};
+
+TEST_F(PollerMigrateTest, PartialMessageAndForwardedCommandsFollow)
+{
+  int         peer;
+  int         fd = connect(0, &peer);
+  char        buf[64];
+  IOBuf       out;
+  PollerStats stats;
+
+  /* Half a message is read by poller 0... */
+  ASSERT_EQ(write(peer, "01234", 5), 5);
+  do
+  {
+    std::this_thread::yield();
+    pollers[0]->getStats(&stats);
+  } while (stats.readBytes < 5);
+
+  /* ...and finished on poller 1. */
+  ASSERT_EQ(pollers[0]->migrate(fd, pollers[1]), 0);
+  sync();
+  sync();
+  ASSERT_EQ(write(peer, "56789", 5), 5);
+
+  /* Sent and deleted through the old poller: forwarded. */
+  out.append("pong", 4);
+  ASSERT_EQ(pollers[0]->send(fd, &out), 0);
+  sync();
+  sync();
+  EXPECT_EQ(read(peer, buf, sizeof buf), 4);
+  ASSERT_EQ(pollers[0]->del(fd), 0);
+  sync();
+  sync();
+
+  std::vector<Seen> seen = take();
+
+  ASSERT_EQ(seen.size(), 2u);
+  EXPECT_EQ(seen[0].poller, 1);
+  EXPECT_EQ(seen[0].state, PR_ST_SUCCESS);
+  EXPECT_EQ(seen[0].bytes, MESSAGE_SIZE);
+  EXPECT_EQ(seen[1].poller, 1);
+  EXPECT_EQ(seen[1].state, PR_ST_DELETED);
+
+  pollers[1]->getStats(&stats);
+  EXPECT_EQ(stats.inboundBytes, 0u);
+  EXPECT_EQ(stats.outboundBytes, 0u);
+}
+
+TEST_F(PollerMigrateTest, DeadlineMovesWithTheNode)
+{
+  int  peer;
+  int  fd    = connect(0, &peer, 100);
+  auto start = std::chrono::steady_clock::now();
+
+  ASSERT_EQ(pollers[0]->migrate(fd, pollers[1]), 0);
+  while (take().empty() &&
+         std::chrono::steady_clock::now() - start < std::chrono::seconds(5))
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+  auto elapsed = std::chrono::steady_clock::now() - start;
+
+  EXPECT_GE(elapsed, std::chrono::milliseconds(100));
+  EXPECT_LT(elapsed, std::chrono::seconds(2));
+}
+
+TEST_F(PollerMigrateTest, ShedMovesColdBeforeHot)
+{
+  int  peers[3];
+  int  fds3[3];
+  char msg[MESSAGE_SIZE] = {};
+
+  for (int i = 0; i < 3; i++)
+    fds3[i] = connect(0, &peers[i]);
+
+  /* fds3[0] gets 20 events, the others one each. */
+  for (int i = 0; i < 20; i++)
+  {
+    ASSERT_EQ(write(peers[0], msg, sizeof msg), (ssize_t) sizeof msg);
+    sync();
+  }
+
+  for (int i = 1; i < 3; i++)
+    ASSERT_EQ(write(peers[i], msg, sizeof msg), (ssize_t) sizeof msg);
+
+  sync();
+  take();
+
+  /* Half of 22 events: the hot node alone would overshoot. */
+  ASSERT_EQ(pollers[0]->shed(0.5, pollers[1]), 0);
+  sync();
+  sync();
+  for (int i = 0; i < 3; i++)
+    ASSERT_EQ(write(peers[i], msg, sizeof msg), (ssize_t) sizeof msg);
+
+  sync();
+
+  std::vector<Seen> seen = take();
+
+  ASSERT_EQ(seen.size(), 3u);
+  for (const Seen &s : seen)
+    EXPECT_EQ(s.poller, s.fd == fds3[0] ? 0 : 1);
+}
+
+TEST_F(PollerMigrateTest, RebalancerShedsFromTheBusiest)
+{
+  RebalancerParams params = {};
+  int              peers[2];
+  int              fd[2];
+  char             msg[MESSAGE_SIZE] = {};
+
+  /* fd[0] gets three events, fd[1] one. */
+  for (int i = 0; i < 2; i++)
+    fd[i] = connect(0, &peers[i]);
+
+  for (int i = 0; i < 4; i++)
+  {
+    ASSERT_EQ(write(peers[i < 3 ? 0 : 1], msg, sizeof msg),
+              (ssize_t) sizeof msg);
+    sync();
+  }
+
+  take();
+
+  Rebalancer rebalancer({pollers[0], pollers[1]}, &params);
+
+  EXPECT_EQ(rebalancer.balance({0.5, 0.4}), 0); /* not busy enough */
+  EXPECT_EQ(rebalancer.balance({0.9, 0.8}), 0); /* not far enough apart */
+  EXPECT_EQ(rebalancer.balance({0.9, 0.1}), 1);
+  sync();
+  sync();
+  for (int i = 0; i < 2; i++)
+    ASSERT_EQ(write(peers[i], msg, sizeof msg), (ssize_t) sizeof msg);
+
+  sync();
+
+  std::vector<Seen> seen = take();
+
+  ASSERT_EQ(seen.size(), 2u);
+  for (const Seen &s : seen)
+    EXPECT_EQ(s.poller, s.fd == fd[1] ? 1 : 0);
+
+  /* The background pass samples real busy time; idle pollers stay put. */
+  params.interval = 10;
+
+  Rebalancer background({pollers[0], pollers[1]}, &params);
+
+  ASSERT_EQ(background.start(), 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  background.stop();
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,685 @@
+#include <gtest/gtest.h>
+#include <dirent.h>
+#include <malloc.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "Arena.h"
+#include "List.h"
+#include "Poller.h"
+
+namespace
+{
+  PollerMessage *createMessage(void *) { return nullptr; }
+
+  /* Every read is a whole message. */
+  int append(const void *, size_t *, PollerMessage *) { return 1; }
+
+  PollerMessage *createArenaMessage(void *context)
+  {
+    return static_cast<Arena *>(context)->createMessage(0, append);
+  }
+
+  /* Takes every byte and never completes. */
+  int appendPartial(const void *, size_t *, PollerMessage *) { return 0; }
+
+  PollerMessage *createPartialMessage(void *context)
+  {
+    return static_cast<Arena *>(context)->createMessage(0, appendPartial);
+  }
+
+  int openFds()
+  {
+    DIR *dir = opendir("/proc/self/fd");
+    int  n   = 0;
+
+    while (readdir(dir))
+      n++;
+
+    closedir(dir);
+    return n;
+  }
+
+  /* Counts its calls, through context. */
+  void *countEvent(void *context)
+  {
+    ++*static_cast<std::atomic<int> *>(context);
+    return context;
+  }
+
+  /* One byte per message, so one read can carry several. */
+  struct ByteMessage
+  {
+    PollerMessage base;
+    char          byte;
+  };
+
+  int appendByte(const void *buf, size_t *n, PollerMessage *msg)
+  {
+    reinterpret_cast<ByteMessage *>(msg)->byte =
+            *static_cast<const char *>(buf);
+    *n = 1;
+    return 1;
+  }
+
+  PollerMessage *createByteMessage(void *)
+  {
+    ByteMessage *msg = static_cast<ByteMessage *>(calloc(1, sizeof *msg));
+
+    msg->base.append = appendByte;
+    return &msg->base;
+  }
+} // namespace
+
+class PollerNodeTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    PollerParams params = {};
+
+    start(&params);
+  }
+
+  void start(PollerParams *params)
+  {
+    params->maxOpenFiles = 4096;
+    params->callback     = [this](PollerResult *res, void *)
+    {
+      if (res->data.operation == PD_OP_TIMER && res->state == PR_ST_FINISHED)
+        synced.set_value();
+      else if (res->data.operation == PD_OP_READ &&
+               res->state == PR_ST_SUCCESS)
+        messages++;
+      else if (res->state == PR_ST_DELETED)
+        deleted++;
+      else if (res->data.operation == PD_OP_EVENT &&
+               res->state == PR_ST_SUCCESS)
+        events++;
+
+      delete reinterpret_cast<PollerNode *>(res);
+    };
+
+    poller = new Poller(params);
+    ASSERT_EQ(poller->start(), 0);
+  }
+
+  void TearDown() override
+  {
+    poller->stop();
+    delete poller;
+    for (int fd : fds)
+      close(fd);
+  }
+
+  /* Commands are applied in order, so a zero timer marks the ones before. */
+  void sync()
+  {
+    synced = std::promise<void>();
+    ASSERT_EQ(poller->addTimer(0, nullptr), 0);
+    synced.get_future().wait();
+  }
+
+  Poller            *poller;
+  std::promise<void> synced;
+  std::atomic<int>   messages{0};
+  std::atomic<int>   deleted{0};
+  std::atomic<int>   events{0};
+  std::vector<int>   fds;
+};
+
+TEST_F(PollerNodeTest, HotFieldsShareOneCacheLine)
+{
+  EXPECT_EQ(alignof(PollerNode), 64);
+  EXPECT_LE(offsetof(PollerNode, deadline) + sizeof(int64_t), 64);
+  EXPECT_EQ(offsetof(PollerNode, data), offsetof(PollerResult, data));
+}
+
+TEST_F(PollerNodeTest, BytesPerIdleConnection)
+{
+  const int              n = 256;
+  std::vector<PollerData> data(n);
+  size_t                  before, after;
+  int                     sv[2];
+
+  for (int i = 0; i < n; i++)
+  {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+
+    data[i]               = {};
+    data[i].operation     = PD_OP_READ;
+    data[i].flags         = PD_FL_PERSISTENT | PD_FL_EDGE;
+    data[i].fd            = sv[0];
+    data[i].createMessage = createMessage;
+  }
+
+  sync();
+  before = mallinfo2().uordblks;
+  ASSERT_EQ(poller->addBatch(data.data(), n, -1), 0);
+  sync();
+  after = mallinfo2().uordblks;
+
+  /* The fd table slot is preallocated; count it anyway. */
+  const size_t grown   = after - std::min(after, before);
+  const size_t perConn = grown / n + sizeof(PollerNode *);
+
+  RecordProperty("bytes_per_idle_connection", std::to_string(perConn));
+  EXPECT_LE(perConn, 2 * sizeof(PollerNode));
+}
+
+TEST_F(PollerNodeTest, IdleConnectionsAreTrimmed)
+{
+  const int                           n      = 1024;
+  PollerParams                        params = {};
+  std::vector<PollerData>             data(n);
+  std::vector<std::unique_ptr<Arena>> arenas;
+  size_t                              before, peak, after;
+  int                                 sv[2];
+
+  poller->stop();
+  delete poller;
+  params.idleTrimTimeout = 20;
+  start(&params);
+
+  for (int i = 0; i < n; i++)
+  {
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    arenas.emplace_back(new Arena());
+
+    data[i]               = {};
+    data[i].operation     = PD_OP_READ;
+    data[i].flags         = PD_FL_PERSISTENT | PD_FL_IOBUF;
+    data[i].fd            = sv[0];
+    data[i].createMessage = createArenaMessage;
+    data[i].context       = arenas.back().get();
+  }
+
+  ASSERT_EQ(poller->addBatch(data.data(), n, -1), 0);
+  sync();
+  before = mallinfo2().uordblks;
+
+  for (int i = 0; i < n; i++)
+    ASSERT_EQ(write(fds[2 * i + 1], "x", 1), 1);
+
+  while (messages < n)
+    std::this_thread::yield();
+
+  sync();
+  peak = mallinfo2().uordblks;
+
+  /* Up to two periods to be trimmed. */
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  sync();
+  after = mallinfo2().uordblks;
+
+  /* The shared block pool is not per connection. */
+  const size_t pool =
+          POLLER_BLOCK_POOL * (sizeof(IOBufBlock) + IOBUF_BLOCK_SIZE);
+  const size_t used    = peak - std::min(peak, before);
+  const size_t kept    = after - std::min(after, before);
+  const size_t perConn = (kept - std::min(kept, pool)) / n;
+
+  RecordProperty("bytes_per_used_connection", std::to_string(used / n));
+  RecordProperty("bytes_per_trimmed_connection", std::to_string(perConn));
+  EXPECT_GT(used, n * IOBUF_BLOCK_SIZE);
+  EXPECT_LE(perConn, 64u);
+}
+
+TEST_F(PollerNodeTest, PlacedBuffersStillRead)
+{
+  PollerParams params = {};
+  Arena        arena;
+  PollerData   data = {};
+  int          sv[2];
+
+  poller->stop();
+  delete poller;
+  params.memoryFlags = PP_MEM_LOCAL | PP_MEM_HUGE;
+  start(&params);
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  fds.push_back(sv[0]);
+  fds.push_back(sv[1]);
+  data.operation     = PD_OP_READ;
+  data.flags         = PD_FL_PERSISTENT;
+  data.fd            = sv[0];
+  data.createMessage = createArenaMessage;
+  data.context       = &arena;
+  ASSERT_EQ(poller->add(&data, -1), 0);
+
+  ASSERT_EQ(write(sv[1], "ping", 4), 4);
+  while (messages < 1)
+    std::this_thread::yield();
+
+  sync();
+}
+
+TEST_F(PollerNodeTest, StaleCancelLeavesTheNextOperation)
+{
+  PollerData   data = {};
+  PollerHandle first, second;
+  int          context;
+  int          sv[2];
+
+  /* Same context, and likely the same node memory. */
+  ASSERT_EQ(poller->addTimer(10000, &context, &first), 0);
+  ASSERT_EQ(poller->cancel(&first), 0);
+  sync();
+  EXPECT_EQ(deleted, 1);
+
+  ASSERT_EQ(poller->addTimer(10000, &context, &second), 0);
+  ASSERT_EQ(poller->cancel(&first), 0);
+  sync();
+  EXPECT_EQ(deleted, 1);
+  ASSERT_EQ(poller->cancel(&second), 0);
+  sync();
+  EXPECT_EQ(deleted, 2);
+
+  /* Same fd. */
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  fds.push_back(sv[0]);
+  fds.push_back(sv[1]);
+  data.operation     = PD_OP_READ;
+  data.fd            = sv[0];
+  data.createMessage = createMessage;
+  ASSERT_EQ(poller->add(&data, -1, &first), 0);
+  ASSERT_EQ(poller->cancel(&first), 0);
+  sync();
+  EXPECT_EQ(deleted, 3);
+
+  ASSERT_EQ(poller->add(&data, -1, &second), 0);
+  ASSERT_EQ(poller->cancel(&first), 0);
+  sync();
+  EXPECT_EQ(deleted, 3);
+  ASSERT_EQ(poller->cancel(&second), 0);
+  sync();
+  EXPECT_EQ(deleted, 4);
+}
+
+TEST_F(PollerNodeTest, QuietEventsDeliverNothing)
+{
+  PollerData       data = {};
+  std::atomic<int> calls{0};
+  const uint64_t   three = 3;
+  int              fd    = eventfd(0, EFD_NONBLOCK);
+
+  ASSERT_GE(fd, 0);
+  fds.push_back(fd);
+  data.operation = PD_OP_EVENT;
+  data.flags     = PD_FL_QUIET;
+  data.fd        = fd;
+  data.event     = countEvent;
+  data.context   = &calls;
+  ASSERT_EQ(poller->add(&data, -1), 0);
+  sync();
+
+  ASSERT_EQ(write(fd, &three, sizeof three), (ssize_t) sizeof three);
+  while (calls < 3)
+    std::this_thread::yield();
+
+  sync();
+  EXPECT_EQ(calls, 3);
+  EXPECT_EQ(events, 0);
+
+  /* Without the flag, one result per count. */
+  data.flags = 0;
+  ASSERT_EQ(poller->mod(&data, -1), 0);
+  sync();
+  ASSERT_EQ(write(fd, &three, sizeof three), (ssize_t) sizeof three);
+  while (calls < 6)
+    std::this_thread::yield();
+
+  sync();
+  EXPECT_EQ(events, 3);
+}
+
+TEST_F(PollerNodeTest, PartialMessageGivesItsArenaBack)
+{
+  Arena      arena;
+  PollerData data = {};
+  int        sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  fds.push_back(sv[0]);
+  data.operation     = PD_OP_READ;
+  data.fd            = sv[0];
+  data.createMessage = createPartialMessage;
+  data.context       = &arena;
+  ASSERT_EQ(poller->add(&data, -1), 0);
+  sync();
+
+  /* Ends in PR_ST_FINISHED with half a message. */
+  ASSERT_EQ(write(sv[1], "part", 4), 4);
+  close(sv[1]);
+  sync();
+
+  arena.trim();
+  EXPECT_EQ(arena.capacity(), 0u);
+}
+
+TEST_F(PollerNodeTest, ModFromCallbackWaitsForTheHandler)
+{
+  PollerParams       params = {};
+  PollerData         data   = {};
+  Poller            *self   = nullptr;
+  std::string        seen;
+  std::promise<void> wrote;
+  char               reply[] = "x";
+  struct iovec       iov     = {reply, 1};
+  char               buf[4];
+  int                sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  fds.push_back(sv[0]);
+  fds.push_back(sv[1]);
+
+  params.maxOpenFiles = 4096;
+  params.callback     = [&](PollerResult *res, void *)
+  {
+    if (res->data.operation == PD_OP_READ && res->state == PR_ST_SUCCESS)
+    {
+      seen += reinterpret_cast<ByteMessage *>(res->data.message)->byte;
+      free(res->data.message);
+
+      /* Answer the first; the second is in the same read. */
+      if (seen.size() == 1)
+      {
+        PollerData write = {};
+
+        write.operation = PD_OP_WRITE;
+        write.flags     = PD_FL_PERSISTENT | PD_FL_EDGE;
+        write.fd        = sv[0];
+        write.writeIov  = &iov;
+        write.iovcnt    = 1;
+        EXPECT_EQ(self->mod(&write, -1), 0);
+      }
+    } else if (res->data.operation == PD_OP_WRITE &&
+               res->state == PR_ST_FINISHED)
+      wrote.set_value();
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller pipelined(&params);
+
+  self = &pipelined;
+  ASSERT_EQ(pipelined.start(), 0);
+  data.operation     = PD_OP_READ;
+  data.flags         = PD_FL_PERSISTENT | PD_FL_EDGE;
+  data.fd            = sv[0];
+  data.createMessage = createByteMessage;
+  ASSERT_EQ(pipelined.add(&data, -1), 0);
+
+  ASSERT_EQ(write(sv[1], "ab", 2), 2);
+  wrote.get_future().wait();
+  EXPECT_EQ(read(sv[1], buf, sizeof buf), 1);
+  EXPECT_EQ(buf[0], 'x');
+  EXPECT_EQ(pipelined.stop(), 0);
+  EXPECT_EQ(seen, "ab");
+}
+
+/*
+ * Keep-alive traffic on a persistent edge-triggered connection: after the
+ * first add(), each request and response is a switch in place, with no
+ * epoll_ctl() at all.
+ */
+TEST_F(PollerNodeTest, KeepAliveTakesNoCtlCalls)
+{
+  const int    rounds  = 100;
+  PollerParams params  = {};
+  PollerData   data    = {};
+  PollerStats  first   = {};
+  PollerStats  last    = {};
+  Poller      *self    = nullptr;
+  char         reply[] = "x";
+  struct iovec iov;
+  char         c;
+  int          sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+  fds.push_back(sv[0]);
+  fds.push_back(sv[1]);
+
+  params.maxOpenFiles = 4096;
+  params.callback     = [&](PollerResult *res, void *)
+  {
+    PollerData next = {};
+
+    next.flags = PD_FL_PERSISTENT | PD_FL_EDGE;
+    next.fd    = sv[0];
+    if (res->data.operation == PD_OP_READ && res->state == PR_ST_SUCCESS)
+    {
+      free(res->data.message);
+      iov            = {reply, 1};
+      next.operation = PD_OP_WRITE;
+      next.writeIov  = &iov;
+      next.iovcnt    = 1;
+      EXPECT_EQ(self->mod(&next, -1), 0);
+    } else if (res->data.operation == PD_OP_WRITE &&
+               res->state == PR_ST_FINISHED)
+    {
+      next.operation     = PD_OP_READ;
+      next.createMessage = createByteMessage;
+      EXPECT_EQ(self->mod(&next, -1), 0);
+    }
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller keepAlive(&params);
+
+  self = &keepAlive;
+  ASSERT_EQ(keepAlive.start(), 0);
+  data.operation     = PD_OP_READ;
+  data.flags         = PD_FL_PERSISTENT | PD_FL_EDGE;
+  data.fd            = sv[0];
+  data.createMessage = createByteMessage;
+  ASSERT_EQ(keepAlive.add(&data, -1), 0);
+
+  for (int i = 0; i < rounds; i++)
+  {
+    ASSERT_EQ(write(sv[1], "a", 1), 1);
+    while (read(sv[1], &c, 1) != 1)
+      std::this_thread::yield();
+
+    if (i == 0)
+      keepAlive.getStats(&first);
+  }
+
+  keepAlive.getStats(&last);
+  EXPECT_EQ(first.ctlCalls, 1u);
+  EXPECT_EQ(last.ctlCalls, first.ctlCalls);
+  EXPECT_EQ(keepAlive.stop(), 0);
+}
+
+TEST_F(PollerNodeTest, DestructionClosesItsFds)
+{
+  PollerParams params = {};
+  PollerData   data   = {};
+  const int    before = openFds();
+
+  params.maxOpenFiles       = 4096;
+  params.callback           = [](PollerResult *, void *) {};
+  params.writeHighWatermark = 1024;
+  data.operation            = PD_OP_TIMER;
+  data.fd                   = -1;
+  for (int i = 0; i < 8; i++)
+  {
+    Poller started(&params);
+    Poller idle(&params);
+
+    ASSERT_EQ(started.start(), 0);
+    ASSERT_EQ(started.stop(), 0);
+
+    /* Never started: the command waits for nobody. */
+    ASSERT_EQ(idle.add(&data, 1000), 0);
+  }
+
+  EXPECT_EQ(openFds(), before);
+}
+
+/*
+ * A read's callback deletes the other node, whose event is later in the
+ * same epoll batch: that node is skipped, and freed only once the batch is
+ * over (use-after-free otherwise, under a sanitizer).
+ */
+TEST_F(PollerNodeTest, NodeDeletedInItsBatchIsSkipped)
+{
+  PollerParams             params = {};
+  PollerData               data   = {};
+  Poller                  *self   = nullptr;
+  std::promise<void>       held;
+  std::promise<void>       release;
+  std::shared_future<void> go = release.get_future().share();
+  std::atomic<int>         timers{0};
+  std::atomic<int>         read{0};
+  std::atomic<int>         gone{0};
+  int                      a[2], b[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, a), 0);
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, b), 0);
+  fds.insert(fds.end(), {a[0], a[1], b[0], b[1]});
+
+  params.maxOpenFiles = 4096;
+  params.callback     = [&](PollerResult *res, void *)
+  {
+    if (res->data.operation == PD_OP_TIMER && timers++ == 0)
+    {
+      held.set_value();
+      go.wait();
+    } else if (res->data.operation == PD_OP_READ &&
+               res->state == PR_ST_SUCCESS)
+    {
+      free(res->data.message);
+      read++;
+      EXPECT_EQ(self->del(res->data.fd == a[0] ? b[0] : a[0]), 0);
+    } else if (res->state == PR_ST_DELETED)
+      gone++;
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller batched(&params);
+
+  self = &batched;
+  ASSERT_EQ(batched.start(), 0);
+  data.operation     = PD_OP_READ;
+  data.createMessage = createByteMessage;
+  data.fd            = a[0];
+  ASSERT_EQ(batched.add(&data, -1), 0);
+  data.fd = b[0];
+  ASSERT_EQ(batched.add(&data, -1), 0);
+
+  /* Both become readable while the poller thread is busy. */
+  ASSERT_EQ(batched.addTimer(0, nullptr), 0);
+  held.get_future().wait();
+  ASSERT_EQ(write(a[1], "x", 1), 1);
+  ASSERT_EQ(write(b[1], "x", 1), 1);
+  release.set_value();
+
+  while (gone < 1)
+    std::this_thread::yield();
+
+  ASSERT_EQ(batched.addTimer(0, nullptr), 0);
+  while (timers < 2)
+    std::this_thread::yield();
+
+  EXPECT_EQ(read, 1);
+  EXPECT_EQ(gone, 1);
+  EXPECT_EQ(batched.stop(), 0);
+}
+
+/*
+ * del() and mod() race from two threads while the peer writes. Whichever
+ * lands first, the first node ends once (DELETED or MODIFIED) and so does
+ * the second (DELETED, or ENOENT if the fd had no node left).
+ */
+TEST_F(PollerNodeTest, RacingDelAndModEndEachNodeOnce)
+{
+  const int        rounds = 200;
+  PollerParams     params = {};
+  PollerData       data   = {};
+  std::atomic<int> ends{0};
+  std::atomic<int> timers{0};
+  int              sv[2];
+
+  params.maxOpenFiles = 4096;
+  params.callback     = [&](PollerResult *res, void *)
+  {
+    if (res->data.operation == PD_OP_TIMER)
+      timers++;
+    else if (res->state == PR_ST_SUCCESS)
+      free(res->data.message);
+    else
+      ends++;
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller raced(&params);
+
+  ASSERT_EQ(raced.start(), 0);
+  data.operation     = PD_OP_READ;
+  data.createMessage = createByteMessage;
+  for (int i = 0; i < rounds; i++)
+  {
+    std::atomic<bool> go{false};
+
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    data.fd = sv[0];
+    ASSERT_EQ(raced.add(&data, -1), 0);
+
+    std::thread del(
+            [&]
+            {
+              while (!go)
+                ;
+              EXPECT_EQ(raced.del(sv[0]), 0);
+            });
+    std::thread mod(
+            [&]
+            {
+              while (!go)
+                ;
+              EXPECT_EQ(raced.mod(&data, -1), 0);
+            });
+
+    go = true;
+    for (int j = 0; j < 8; j++)
+      write(sv[1], "x", 1);
+
+    del.join();
+    mod.join();
+    while (ends < 2 * (i + 1))
+      std::this_thread::yield();
+
+    /* And nothing more: the fd has no node left either way. */
+    ASSERT_EQ(raced.addTimer(0, nullptr), 0);
+    while (timers < i + 1)
+      std::this_thread::yield();
+
+    ASSERT_EQ(ends, 2 * (i + 1));
+    close(sv[0]);
+    close(sv[1]);
+  }
+
+  EXPECT_EQ(raced.stop(), 0);
+  EXPECT_EQ(ends, 2 * rounds);
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,210 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Executor.h"
+#include "Poller.h"
+
+namespace
+{
+  int append(const void *, size_t *, PollerMessage *) { return 1; }
+
+  PollerMessage *createMessage(void *)
+  {
+    PollerMessage *msg =
+            static_cast<PollerMessage *>(calloc(1, sizeof(PollerMessage)));
+
+    msg->append = append;
+    return msg;
+  }
+
+  /* Holds the worker that runs it until released. */
+  struct GateTask
+  {
+    ExecutorTask      base;
+    std::atomic<bool> entered{false};
+    std::atomic<bool> open{false};
+  };
+
+  void gate(ExecutorTask *task)
+  {
+    GateTask *t = reinterpret_cast<GateTask *>(task);
+
+    t->entered = true;
+    while (!t->open)
+      std::this_thread::yield();
+  }
+} // namespace
+
+class PollerPriorityTest : public ::testing::Test
+{
+  protected:
+  void TearDown() override
+  {
+    if (poller)
+      poller->stop();
+
+    if (executor)
+      executor->stop();
+
+    for (int fd : fds)
+      close(fd);
+  }
+
+  void start(Executor *exec, int dueHigh = 0, int dueBulk = 0)
+  {
+    PollerParams params = {};
+
+    params.maxOpenFiles = 1024;
+    params.executor     = exec;
+    params.dueHigh      = dueHigh;
+    params.dueBulk      = dueBulk;
+    params.callback     = [this](PollerResult *res, void *)
+    {
+      if (res->data.operation == PD_OP_TIMER)
+      {
+        /* Keeps the poller thread out of epoll_wait() meanwhile. */
+        if (res->data.context)
+          static_cast<std::shared_future<void> *>(res->data.context)->wait();
+
+        synced.set_value();
+      } else
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (res->state == PR_ST_SUCCESS)
+        {
+          order.push_back(static_cast<const char *>(res->data.context));
+          free(res->data.message);
+        }
+      }
+
+      delete reinterpret_cast<PollerNode *>(res);
+    };
+    poller.reset(new Poller(&params));
+    ASSERT_EQ(poller->start(), 0);
+  }
+
+  /* A socketpair read by the poller, its results labelled name. */
+  int connect(int flags, const char *name)
+  {
+    PollerData data = {};
+    int        sv[2];
+
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    data.operation     = PD_OP_READ;
+    data.flags         = PD_FL_PERSISTENT | flags;
+    data.fd            = sv[0];
+    data.context       = const_cast<char *>(name);
+    data.createMessage = createMessage;
+    EXPECT_EQ(poller->add(&data, -1), 0);
+    return sv[1];
+  }
+
+  void sync(void *hold = nullptr)
+  {
+    synced = std::promise<void>();
+    ASSERT_EQ(poller->addTimer(0, hold), 0);
+    if (!hold)
+      synced.get_future().wait();
+  }
+
+  /* With the executor's only worker held, results just queue up. */
+  void waitQueued(size_t n)
+  {
+    ExecutorStats stats;
+
+    do
+    {
+      std::this_thread::yield();
+      executor->getStats(&stats);
+    } while (stats.queued < n);
+  }
+
+  std::unique_ptr<Poller>   poller;
+  std::unique_ptr<Executor> executor;
+  std::promise<void>        synced;
+  std::mutex                mutex;
+  std::vector<std::string>  order;
+  std::vector<int>          fds;
+};
+
+TEST_F(PollerPriorityTest, HighFirstWithinABatch)
+{
+  start(nullptr);
+
+  int                     bulk   = connect(PD_FL_BULK, "bulk");
+  int                     normal = connect(0, "normal");
+  int                     high   = connect(PD_FL_HIGH, "high");
+  std::promise<void>      release;
+  std::shared_future<void> held = release.get_future().share();
+
+  sync();
+
+  /* Ready in this order, and all seen by the same epoll_wait(). */
+  sync(&held);
+  ASSERT_EQ(write(bulk, "b", 1), 1);
+  ASSERT_EQ(write(normal, "n", 1), 1);
+  ASSERT_EQ(write(high, "h", 1), 1);
+  release.set_value();
+  synced.get_future().wait();
+  sync();
+
+  EXPECT_EQ(order, std::vector<std::string>({"high", "normal", "bulk"}));
+}
+
+TEST_F(PollerPriorityTest, ExecutorRunsEarliestDueFirst)
+{
+  GateTask blocker;
+
+  executor.reset(new Executor(1));
+  ASSERT_EQ(executor->start(), 0);
+  start(executor.get(), 10000, 20000);
+
+  int bulk = connect(PD_FL_BULK, "bulk");
+  int high = connect(PD_FL_HIGH, "high");
+
+  blocker.base.routine = gate;
+  executor->submit(&blocker.base);
+  while (!blocker.entered)
+    std::this_thread::yield();
+
+  /* Bulk arrived first, but is due 10ms after the high one. */
+  ASSERT_EQ(write(bulk, "b", 1), 1);
+  waitQueued(1);
+  ASSERT_EQ(write(high, "h", 1), 1);
+  waitQueued(2);
+
+  /* Bulk waited past the high one's whole budget: its turn. */
+  ASSERT_EQ(write(bulk, "b", 1), 1);
+  waitQueued(3);
+  std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  ASSERT_EQ(write(high, "h", 1), 1);
+  waitQueued(4);
+
+  blocker.open = true;
+  poller->stop();
+  poller.reset();
+  executor->stop();
+
+  EXPECT_EQ(order,
+            std::vector<std::string>({"high", "bulk", "bulk", "high"}));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
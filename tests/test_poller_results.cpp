@@ -0,0 +1,293 @@
+#include <gtest/gtest.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+
+#include "Arena.h"
+#include "Poller.h"
+
+namespace
+{
+  /*
+   * Each byte is a message, which keeps a pointer to it in the ring. The
+   * message data is not pointer-aligned: copy it in and out.
+   */
+  int appendRef(const void *buf, size_t *n, PollerMessage *msg)
+  {
+    memcpy(msg->data, &buf, sizeof buf);
+    *n = 1;
+    return 1;
+  }
+
+  PollerMessage *createRefMessage(void *context)
+  {
+    return static_cast<Arena *>(context)->createMessage(sizeof(char *),
+                                                        appendRef);
+  }
+
+  char messageByte(const PollerResult *res)
+  {
+    const char *p;
+
+    memcpy(&p, res->data.message->data, sizeof p);
+    return *p;
+  }
+
+  /* Numbers its counts. */
+  void *countEvent(void *context)
+  {
+    return reinterpret_cast<void *>(++*static_cast<intptr_t *>(context));
+  }
+
+  struct Seen
+  {
+    int      operation;
+    int      state;
+    int      fd;
+    char     byte;  /* PD_OP_READ */
+    intptr_t count; /* PD_OP_EVENT */
+  };
+} // namespace
+
+class PollerResultsTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    PollerParams params = {};
+
+    params.maxOpenFiles  = 4096;
+    params.batchCallback = [this](PollerResult **res, size_t n, void *)
+    {
+      std::vector<Seen> batch;
+      PollerStats       stats;
+      bool              timer = false;
+
+      poller->getStats(&stats);
+      waits.push_back(stats.waitCalls);
+      for (size_t i = 0; i < n; i++)
+      {
+        Seen seen = {res[i]->data.operation, res[i]->state, res[i]->data.fd,
+                     0, 0};
+
+        if (seen.operation == PD_OP_READ && seen.state == PR_ST_SUCCESS)
+          seen.byte = messageByte(res[i]);
+        else if (seen.operation == PD_OP_EVENT &&
+                 seen.state == PR_ST_SUCCESS)
+          seen.count = reinterpret_cast<intptr_t>(res[i]->data.result);
+        else if (seen.operation == PD_OP_TIMER)
+          timer = true;
+
+        batch.push_back(seen);
+      }
+
+      if (inspect)
+        inspect(res, n);
+
+      for (size_t i = 0; i < n; i++)
+        delete reinterpret_cast<PollerNode *>(res[i]);
+
+      std::lock_guard<std::mutex> lock(mutex);
+
+      batches.push_back(std::move(batch));
+      if (timer)
+        synced.set_value();
+    };
+
+    poller = new Poller(&params);
+    ASSERT_EQ(poller->start(), 0);
+  }
+
+  void TearDown() override
+  {
+    poller->stop();
+    delete poller;
+    for (int fd : fds)
+      close(fd);
+  }
+
+  /* Commands are applied in order, so a zero timer marks the ones before. */
+  void sync()
+  {
+    synced = std::promise<void>();
+    ASSERT_EQ(poller->addTimer(0, nullptr), 0);
+    synced.get_future().wait();
+  }
+
+  /* Successful results of operation so far. */
+  int delivered(const int operation)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    int                         n = 0;
+
+    for (const std::vector<Seen> &batch : batches)
+      for (const Seen &seen : batch)
+        n += seen.operation == operation && seen.state == PR_ST_SUCCESS;
+
+    return n;
+  }
+
+  /* A ring reader of the bytes already written to it. */
+  PollerData reader(const char *bytes)
+  {
+    PollerData data = {};
+    int        sv[2];
+
+    EXPECT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+    fds.push_back(sv[0]);
+    fds.push_back(sv[1]);
+    EXPECT_EQ(write(sv[1], bytes, strlen(bytes)), (ssize_t) strlen(bytes));
+    data.operation     = PD_OP_READ;
+    data.flags         = PD_FL_RING;
+    data.fd            = sv[0];
+    data.createMessage = createRefMessage;
+    data.context       = &arena;
+    return data;
+  }
+
+  /* An eventfd already counted up to n. */
+  PollerData event(const unsigned long long n)
+  {
+    PollerData data = {};
+    int        fd   = eventfd(0, EFD_NONBLOCK);
+
+    fds.push_back(fd);
+    EXPECT_EQ(write(fd, &n, sizeof n), (ssize_t) sizeof n);
+    data.operation = PD_OP_EVENT;
+    data.fd        = fd;
+    data.event     = countEvent;
+    data.context   = &counted;
+    return data;
+  }
+
+  Poller                                     *poller;
+  std::promise<void>                          synced;
+  std::function<void(PollerResult **, size_t)> inspect;
+  std::mutex                                  mutex;
+  std::vector<std::vector<Seen>>              batches;
+  std::vector<size_t>                         waits;
+  Arena                                       arena;
+  intptr_t                                    counted = 0;
+  std::vector<int>                            fds;
+};
+
+TEST_F(PollerResultsTest, OneCallPerLoopIteration)
+{
+  PollerData   data = event(0);
+  const int    fd   = data.fd;
+  const size_t one  = 1;
+
+  ASSERT_EQ(poller->add(&data, -1), 0);
+  for (int i = 0; i < 20; i++)
+  {
+    ASSERT_EQ(write(fd, &one, sizeof one), (ssize_t) sizeof one);
+    sync();
+  }
+
+  while (delivered(PD_OP_EVENT) < 20)
+    sync();
+
+  ASSERT_GE(batches.size(), 20u);
+  for (size_t i = 0; i < batches.size(); i++)
+  {
+    EXPECT_FALSE(batches[i].empty());
+    if (i > 0)
+    {
+      EXPECT_GT(waits[i], waits[i - 1]);
+    }
+  }
+
+  EXPECT_EQ(counted, 20);
+}
+
+TEST_F(PollerResultsTest, GroupedByOperationInNodeOrder)
+{
+  /* The eventfd goes in first, so its events are ready first. */
+  PollerData data[2] = {event(3), reader("abc")};
+
+  ASSERT_EQ(poller->addBatch(data, 2, -1), 0);
+  while (delivered(PD_OP_EVENT) < 3 || delivered(PD_OP_READ) < 3)
+    sync();
+
+  /* The first iteration with any, less the sync timer. */
+  std::vector<Seen> both;
+
+  for (const std::vector<Seen> &batch : batches)
+  {
+    for (const Seen &seen : batch)
+      if (seen.operation == PD_OP_READ || seen.operation == PD_OP_EVENT)
+        both.push_back(seen);
+
+    if (!both.empty())
+      break;
+  }
+
+  ASSERT_EQ(both.size(), 6u) << "not in one iteration";
+  for (int i = 0; i < 3; i++)
+  {
+    EXPECT_EQ(both[i].operation, PD_OP_READ);
+    EXPECT_EQ(both[i].state, PR_ST_SUCCESS);
+    EXPECT_EQ(both[i].byte, "abc"[i]);
+  }
+
+  /* One result per count, each with its own event() value. */
+  for (int i = 0; i < 3; i++)
+  {
+    EXPECT_EQ(both[3 + i].operation, PD_OP_EVENT);
+    EXPECT_EQ(both[3 + i].state, PR_ST_SUCCESS);
+    EXPECT_EQ(both[3 + i].count, i + 1);
+  }
+}
+
+TEST_F(PollerResultsTest, ArenaAndRingOutliveTheBatch)
+{
+  PollerData  data  = reader("xyz");
+  PollerNode *node  = nullptr;
+  int         reads = 0;
+
+  inspect = [&](PollerResult **res, size_t n)
+  {
+    for (size_t i = 0; i < n; i++)
+    {
+      if (res[i]->data.operation != PD_OP_READ ||
+          res[i]->state != PR_ST_SUCCESS)
+        continue;
+
+      /* Still live: the arena keeps its chunks, the ring its bytes. */
+      node = res[i]->data.message->node;
+      arena.trim();
+      EXPECT_NE(arena.capacity(), 0u);
+      EXPECT_FALSE(node->ring->empty());
+      EXPECT_EQ(messageByte(res[i]), "xyz"[reads]);
+      reads++;
+    }
+  };
+
+  ASSERT_EQ(poller->add(&data, -1), 0);
+  while (delivered(PD_OP_READ) < 3)
+    sync();
+
+  ASSERT_EQ(reads, 3);
+
+  /* Given back once the batch returned, before the next one. */
+  inspect = [&](PollerResult **, size_t)
+  {
+    arena.trim();
+    EXPECT_EQ(arena.capacity(), 0u);
+    EXPECT_TRUE(node->ring->empty());
+  };
+  sync();
+  inspect = nullptr;
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,457 @@
+#include <gtest/gtest.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <future>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Poller.h"
+
+namespace
+{
+  /* One byte per message, kept to check the order. */
+  struct ByteMessage
+  {
+    PollerMessage base;
+    char          byte;
+  };
+
+  int append(const void *buf, size_t *n, PollerMessage *msg)
+  {
+    reinterpret_cast<ByteMessage *>(msg)->byte =
+            *static_cast<const char *>(buf);
+    *n = 1;
+    return 1;
+  }
+
+  PollerMessage *createMessage(void *)
+  {
+    ByteMessage *msg = static_cast<ByteMessage *>(calloc(1, sizeof *msg));
+
+    msg->base.append = append;
+    return &msg->base;
+  }
+
+  /* Reads one byte, then waits for another thread to get back from epoll. */
+  struct Probe
+  {
+    Poller           *poller;
+    int               wake;
+    std::atomic<bool> led;
+    std::atomic<int>  parsed;
+    std::atomic<bool> overlapped; /* parsed while waitAppend() waited */
+  };
+
+  struct ProbeMessage
+  {
+    PollerMessage base;
+    Probe        *probe;
+  };
+
+  int probeAppend(const void *, size_t *n, PollerMessage *msg)
+  {
+    Probe      *probe = reinterpret_cast<ProbeMessage *>(msg)->probe;
+    PollerStats before, now;
+
+    probe->poller->getStats(&before);
+    EXPECT_EQ(write(probe->wake, "x", 1), 1);
+    for (int i = 0; i < 1000 && !probe->led; i++)
+    {
+      probe->poller->getStats(&now);
+      if (now.waitCalls > before.waitCalls)
+        probe->led = true;
+      else
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    *n = 1;
+    return 1;
+  }
+
+  /* Reads one byte, then waits for another thread to parse one. */
+  int waitAppend(const void *, size_t *n, PollerMessage *msg)
+  {
+    Probe *probe = reinterpret_cast<ProbeMessage *>(msg)->probe;
+
+    EXPECT_EQ(write(probe->wake, "x", 1), 1);
+    for (int i = 0; i < 1000 && probe->parsed == 0; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    probe->overlapped = probe->parsed != 0;
+    *n                = 1;
+    return 1;
+  }
+
+  int countAppend(const void *, size_t *n, PollerMessage *msg)
+  {
+    reinterpret_cast<ProbeMessage *>(msg)->probe->parsed++;
+    *n = 1;
+    return 1;
+  }
+
+  PollerMessage *newProbeMessage(void *context,
+                                 int (*append)(const void *, size_t *,
+                                               PollerMessage *))
+  {
+    ProbeMessage *msg = static_cast<ProbeMessage *>(calloc(1, sizeof *msg));
+
+    msg->base.append = append;
+    msg->probe       = static_cast<Probe *>(context);
+    return &msg->base;
+  }
+
+  PollerMessage *createProbeMessage(void *context)
+  {
+    return newProbeMessage(context, probeAppend);
+  }
+
+  PollerMessage *createWaitMessage(void *context)
+  {
+    return newProbeMessage(context, waitAppend);
+  }
+
+  PollerMessage *createCountMessage(void *context)
+  {
+    return newProbeMessage(context, countAppend);
+  }
+} // namespace
+
+class PollerThreadTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    params.maxOpenFiles = 4096;
+    params.callback     = [this](PollerResult *res, void *)
+    {
+      if (res->data.operation == PD_OP_TIMER)
+        ran.set_value(sched_getcpu());
+
+      delete reinterpret_cast<PollerNode *>(res);
+    };
+  }
+
+  PollerParams      params = {};
+  std::promise<int> ran;
+};
+
+TEST_F(PollerThreadTest, PinnedAndPrefaulted)
+{
+  params.cpus        = {0};
+  params.memoryFlags = PP_MEM_LOCAL | PP_MEM_PREFAULT;
+
+  Poller poller(&params);
+
+  ASSERT_EQ(poller.start(), 0);
+  ASSERT_EQ(poller.addTimer(0, nullptr), 0);
+  EXPECT_EQ(ran.get_future().get(), 0);
+  poller.stop();
+}
+
+TEST_F(PollerThreadTest, BadSetupFailsStart)
+{
+  params.cpus = {CPU_SETSIZE};
+
+  Poller poller(&params);
+
+  EXPECT_EQ(poller.start(), -1);
+  EXPECT_EQ(errno, EINVAL);
+
+  /* Nothing was left behind; a good setup still starts. */
+  params.cpus.clear();
+
+  Poller again(&params);
+
+  ASSERT_EQ(again.start(), 0);
+  again.stop();
+}
+
+TEST_F(PollerThreadTest, LeaderFollowerHoldsEachNode)
+{
+  const int                  nfds = 4, count = 40;
+  int                        sv[nfds][2];
+  std::atomic<int>           busy[nfds] = {};
+  std::atomic<int>           left(nfds * count);
+  std::atomic<bool>          overlapped(false);
+  std::mutex                 mutex;
+  std::set<std::thread::id>  threads;
+  std::vector<char>          seen[nfds];
+  std::promise<void>         done;
+
+  params.threads  = 4;
+  params.callback = [&](PollerResult *res, void *)
+  {
+    const int i = (int) reinterpret_cast<intptr_t>(res->data.context);
+
+    if (res->state == PR_ST_SUCCESS)
+    {
+      if (busy[i]++ != 0)
+        overlapped = true;
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        threads.insert(std::this_thread::get_id());
+        seen[i].push_back(
+                reinterpret_cast<ByteMessage *>(res->data.message)->byte);
+      }
+
+      /* Long enough for another thread to lead meanwhile. */
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+      busy[i]--;
+      free(res->data.message);
+      if (--left == 0)
+        done.set_value();
+    }
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  ASSERT_EQ(poller.start(), 0);
+  for (int i = 0; i < nfds; i++)
+  {
+    PollerData data = {};
+
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]), 0);
+    data.operation     = PD_OP_READ;
+    data.flags         = PD_FL_PERSISTENT;
+    data.fd            = sv[i][0];
+    data.createMessage = createMessage;
+    data.context       = reinterpret_cast<void *>((intptr_t) i);
+    ASSERT_EQ(poller.add(&data, -1), 0);
+  }
+
+  /* A few bytes at a time, to every connection, so reads interleave. */
+  for (int b = 0; b < count; b += 4)
+  {
+    for (int i = 0; i < nfds; i++)
+    {
+      char buf[4] = {(char) b, (char) (b + 1), (char) (b + 2), (char) (b + 3)};
+
+      ASSERT_EQ(write(sv[i][1], buf, sizeof buf), 4);
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(300));
+  }
+
+  done.get_future().wait();
+  poller.stop();
+  EXPECT_FALSE(overlapped);
+  EXPECT_GT(threads.size(), 1u);
+  for (int i = 0; i < nfds; i++)
+  {
+    ASSERT_EQ(seen[i].size(), (size_t) count);
+    for (int b = 0; b < count; b++)
+      EXPECT_EQ(seen[i][b], (char) b);
+
+    close(sv[i][0]);
+    close(sv[i][1]);
+  }
+}
+
+TEST_F(PollerThreadTest, NextLeaderWaitsDuringTheReads)
+{
+  int                sv[2][2];
+  Probe              probe = {};
+  std::promise<void> done;
+
+  params.threads  = 2;
+  params.callback = [&](PollerResult *res, void *)
+  {
+    if (res->state == PR_ST_SUCCESS)
+    {
+      free(res->data.message);
+      if (res->data.context == &probe)
+        done.set_value();
+    }
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  ASSERT_EQ(poller.start(), 0);
+  for (int i = 0; i < 2; i++)
+  {
+    PollerData data = {};
+
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]), 0);
+    data.operation     = PD_OP_READ;
+    data.fd            = sv[i][0];
+    data.createMessage = i == 0 ? createProbeMessage : createMessage;
+    data.context       = i == 0 ? &probe : nullptr;
+    ASSERT_EQ(poller.add(&data, -1), 0);
+  }
+
+  probe.poller = &poller;
+  probe.wake   = sv[1][1];
+  ASSERT_EQ(write(sv[0][1], "x", 1), 1);
+  done.get_future().wait();
+  EXPECT_TRUE(probe.led);
+  poller.stop();
+  for (int i = 0; i < 2; i++)
+  {
+    close(sv[i][0]);
+    close(sv[i][1]);
+  }
+}
+
+TEST_F(PollerThreadTest, HandlersRunOffTheStateLock)
+{
+  int                sv[2][2];
+  Probe              probe = {};
+  std::promise<void> done;
+  PollerStats        stats;
+
+  params.threads  = 2;
+  params.callback = [&](PollerResult *res, void *)
+  {
+    if (res->state == PR_ST_SUCCESS)
+    {
+      free(res->data.message);
+      if (res->data.fd == sv[0][0])
+        done.set_value();
+    }
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  ASSERT_EQ(poller.start(), 0);
+  for (int i = 0; i < 2; i++)
+  {
+    PollerData data = {};
+
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]), 0);
+    data.operation     = PD_OP_READ;
+    data.fd            = sv[i][0];
+    data.createMessage = i == 0 ? createWaitMessage : createCountMessage;
+    data.context       = &probe;
+    ASSERT_EQ(poller.add(&data, -1), 0);
+  }
+
+  /* The other thread parses while this one is still in its handler. */
+  probe.wake = sv[1][1];
+  ASSERT_EQ(write(sv[0][1], "x", 1), 1);
+  done.get_future().wait();
+  EXPECT_TRUE(probe.overlapped);
+
+  /* Which the state lock was not held for. */
+  poller.getStats(&stats);
+  EXPECT_GT(stats.stateTime, 0u);
+  EXPECT_LT(stats.stateTime, stats.busyTime / 2);
+  poller.stop();
+  for (int i = 0; i < 2; i++)
+  {
+    close(sv[i][0]);
+    close(sv[i][1]);
+  }
+}
+
+TEST_F(PollerThreadTest, LeaderFollowerTakesNoExecutor)
+{
+  Executor executor(1);
+
+  params.threads  = 2;
+  params.executor = &executor;
+
+  Poller poller(&params);
+
+  EXPECT_EQ(poller.start(), -1);
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST_F(PollerThreadTest, StopFromCallbackIsRefused)
+{
+  Poller            *self = nullptr;
+  std::promise<int> stopped;
+
+  params.callback = [&](PollerResult *res, void *)
+  {
+    if (res->data.operation == PD_OP_TIMER)
+      stopped.set_value(self->stop() < 0 ? errno : 0);
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  self = &poller;
+  ASSERT_EQ(poller.start(), 0);
+  ASSERT_EQ(poller.addTimer(0, nullptr), 0);
+  EXPECT_EQ(stopped.get_future().get(), EDEADLK);
+  EXPECT_EQ(poller.stop(), 0);
+}
+
+TEST_F(PollerThreadTest, NodeAddedWhileStoppingIsStopped)
+{
+  Executor          executor(1);
+  Poller           *self = nullptr;
+  int               sv[2][2];
+  std::atomic<int>  stopped[2] = {};
+
+  ASSERT_EQ(executor.start(), 0);
+  params.executor = &executor;
+  params.callback = [&](PollerResult *res, void *)
+  {
+    const int i = (int) reinterpret_cast<intptr_t>(res->data.context);
+
+    if (res->state == PR_ST_STOPPED)
+    {
+      /* Comes once the loop is over: too late to be added. */
+      if (stopped[i]++ == 0 && i == 0)
+      {
+        PollerData data = {};
+
+        data.operation     = PD_OP_READ;
+        data.fd            = sv[1][0];
+        data.createMessage = createMessage;
+        data.context       = reinterpret_cast<void *>((intptr_t) 1);
+        self->add(&data, -1);
+      }
+    }
+
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  self = &poller;
+  ASSERT_EQ(poller.start(), 0);
+  for (int i = 0; i < 2; i++)
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv[i]), 0);
+
+  PollerData data = {};
+
+  data.operation     = PD_OP_READ;
+  data.fd            = sv[0][0];
+  data.createMessage = createMessage;
+  ASSERT_EQ(poller.add(&data, -1), 0);
+
+  ASSERT_EQ(poller.stop(), 0);
+  EXPECT_EQ(stopped[0], 1);
+  EXPECT_EQ(stopped[1], 1);
+  executor.stop();
+  for (int i = 0; i < 2; i++)
+  {
+    close(sv[i][0]);
+    close(sv[i][1]);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "Poller.h"
+#include "RingBuffer.h"
+
+namespace
+{
+  /* One line per message, kept as a view into the ring. */
+  struct LineMessage
+  {
+    PollerMessage base;
+    const char   *start;
+  };
+
+  int append(const void *buf, size_t *n, PollerMessage *msg)
+  {
+    LineMessage *line = reinterpret_cast<LineMessage *>(msg);
+    const char  *p    = static_cast<const char *>(buf);
+    const void  *nl   = memchr(p, '\n', *n);
+
+    if (!line->start)
+      line->start = p;
+
+    if (!nl)
+      return 0;
+
+    *n = static_cast<const char *>(nl) - p + 1;
+    return 1;
+  }
+
+  PollerMessage *createMessage(void *)
+  {
+    LineMessage *msg = new LineMessage();
+
+    msg->base.append = append;
+    return &msg->base;
+  }
+} // namespace
+
+class RingBufferTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override
+  {
+    ring = RingBuffer::create(4096);
+    ASSERT_NE(ring, nullptr);
+  }
+
+  void TearDown() override { delete ring; }
+
+  void put(const std::string &s)
+  {
+    ASSERT_LE(s.size(), ring->writable());
+    memcpy(ring->writePtr(), s.data(), s.size());
+    ring->produce(s.size());
+  }
+
+  RingBuffer *ring;
+};
+
+TEST_F(RingBufferTest, SizeIsRoundedToPages)
+{
+  RingBuffer *small = RingBuffer::create(1);
+
+  ASSERT_NE(small, nullptr);
+  EXPECT_GE(small->capacity(), 4096u);
+  EXPECT_EQ(small->capacity() & (small->capacity() - 1), 0u);
+  delete small;
+}
+
+TEST_F(RingBufferTest, WrappedDataIsContiguous)
+{
+  const size_t      cap = ring->capacity();
+  const std::string head(cap - 10, 'a');
+  const std::string body = "0123456789abcdefghij";
+
+  put(head);
+  ring->consume(head.size());
+  ring->release();
+
+  /* Straddles the end of the mapping. */
+  put(body);
+  ASSERT_EQ(ring->readable(), body.size());
+  EXPECT_EQ(std::string(ring->readPtr(), body.size()), body);
+}
+
+TEST_F(RingBufferTest, ParsedBytesStayUntilReleased)
+{
+  put("header;body");
+  const char *header = ring->readPtr();
+
+  ring->consume(7);
+  EXPECT_EQ(ring->writable(), ring->capacity() - 11);
+  EXPECT_EQ(std::string(header, 7), "header;");
+
+  ring->consume(4);
+  ring->release();
+  EXPECT_TRUE(ring->empty());
+  EXPECT_EQ(ring->writable(), ring->capacity());
+}
+
+TEST(PollerRingTest, LinesStraddlingReadsAreContiguous)
+{
+  PollerParams             params = {};
+  PollerData               data   = {};
+  std::vector<std::string> lines;
+  std::promise<void>       done;
+  std::string              expected;
+  int                      sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sv), 0);
+  params.maxOpenFiles = 4096;
+  params.ringSize     = 4096;
+  params.callback     = [&](PollerResult *res, void *)
+  {
+    LineMessage *msg = reinterpret_cast<LineMessage *>(res->data.message);
+
+    if (res->state == PR_ST_SUCCESS)
+    {
+      lines.emplace_back(msg->start, msg->base.bytes);
+      if (lines.size() == 200)
+        done.set_value();
+    }
+
+    delete msg;
+    delete reinterpret_cast<PollerNode *>(res);
+  };
+
+  Poller poller(&params);
+
+  ASSERT_EQ(poller.start(), 0);
+  data.operation     = PD_OP_READ;
+  data.flags         = PD_FL_PERSISTENT | PD_FL_RING;
+  data.fd            = sv[0];
+  data.createMessage = createMessage;
+  ASSERT_EQ(poller.add(&data, -1), 0);
+
+  /* 200 lines of 50 bytes wrap the 4K ring twice, in odd-sized writes. */
+  for (int i = 0; i < 200; i++)
+    expected += std::string(49, 'a' + i % 26) + "\n";
+
+  for (size_t off = 0; off < expected.size(); off += 37)
+  {
+    const size_t n = std::min<size_t>(37, expected.size() - off);
+
+    ASSERT_EQ(write(sv[1], expected.data() + off, n), (ssize_t)n);
+    usleep(100);
+  }
+
+  done.get_future().wait();
+  poller.stop();
+  close(sv[0]);
+  close(sv[1]);
+
+  ASSERT_EQ(lines.size(), 200u);
+  for (int i = 0; i < 200; i++)
+    EXPECT_EQ(lines[i], expected.substr(i * 50, 50));
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,323 @@
+#include <gtest/gtest.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CancelToken.h"
+#include "Task.h"
+#include "TaskScheduler.h"
+#include "Workflow.h"
+
+namespace
+{
+  /* Messages are lines. */
+  int parseLine(const void *buf, size_t *n, std::string *response)
+  {
+    const char *p   = static_cast<const char *>(buf);
+    const char *end = static_cast<const char *>(memchr(p, '\n', *n));
+
+    if (end)
+      *n = end - p + 1;
+
+    response->append(p, *n);
+    return end ? 1 : 0;
+  }
+} // namespace
+
+class WorkflowTest : public ::testing::Test
+{
+  protected:
+  void SetUp() override { ASSERT_EQ(scheduler.start(), 0); }
+
+  void TearDown() override { scheduler.stop(); }
+
+  TaskScheduler scheduler{4, 4096};
+};
+
+TEST_F(WorkflowTest, SeriesRunsInOrder)
+{
+  std::vector<int>   order;
+  std::promise<void> finished;
+  SeriesWork        *series;
+
+  series = SeriesWork::create(
+          new TimerTask(&scheduler, 10,
+                        [&](TimerTask *task)
+                        {
+                          EXPECT_EQ(task->getState(), PR_ST_SUCCESS);
+                          order.push_back(1);
+                        }),
+          [&](const SeriesWork *) { finished.set_value(); });
+  series->pushBack(new GoTask(
+          &scheduler, [&] { order.push_back(2); },
+          [&](GoTask *) { order.push_back(3); }));
+  series->pushBack(new TimerTask(&scheduler, 0,
+                                 [&](TimerTask *) { order.push_back(4); }));
+  series->start();
+
+  finished.get_future().wait();
+  EXPECT_EQ(order, std::vector<int>({1, 2, 3, 4}));
+}
+
+TEST_F(WorkflowTest, ParallelFansOutAndIn)
+{
+  const int          n = 64;
+  std::atomic<int>   branches{0};
+  std::atomic<int>   leaves{0};
+  std::promise<int>  joined;
+  ParallelWork      *parallel;
+
+  parallel = ParallelWork::create(
+          [&](const ParallelWork *work)
+          {
+            EXPECT_EQ(work->size(), (size_t) n);
+            joined.set_value(leaves);
+          });
+
+  for (int i = 0; i < n; i++)
+  {
+    SeriesWork *series = SeriesWork::create(
+            new GoTask(&scheduler, [&] { leaves++; }, nullptr),
+            [&](const SeriesWork *) { branches++; });
+
+    series->pushBack(new TimerTask(&scheduler, i % 5, nullptr));
+    series->pushBack(new GoTask(&scheduler, [&] { leaves++; }, nullptr));
+    parallel->addSeries(series);
+  }
+
+  parallel->start();
+  EXPECT_EQ(joined.get_future().get(), 2 * n);
+  EXPECT_EQ(branches, n);
+}
+
+TEST_F(WorkflowTest, EmptyParallelFinishes)
+{
+  std::promise<void> joined;
+
+  ParallelWork::create([&](const ParallelWork *) { joined.set_value(); })
+          ->start();
+  joined.get_future().wait();
+}
+
+TEST_F(WorkflowTest, NetTaskExchangesOneMessage)
+{
+  std::promise<std::string> response;
+  std::promise<int>         state;
+  int                       sv[2];
+  NetTask                  *task;
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+
+  /* The peer answers each line with a line. */
+  std::thread peer(
+          [&]
+          {
+            std::string line;
+            char        c;
+
+            while (line.empty() || line.back() != '\n')
+            {
+              if (read(sv[1], &c, 1) == 1)
+                line += c;
+            }
+
+            line = "re: " + line;
+            ASSERT_EQ(write(sv[1], line.data(), line.size()),
+                      (ssize_t) line.size());
+          });
+
+  task = new NetTask(&scheduler, sv[0],
+                     [&](NetTask *t)
+                     {
+                       state.set_value(t->getState());
+                       response.set_value(t->getResponse());
+                     });
+  task->setRequest("ping\n", 5);
+  task->setParser(parseLine);
+  task->setTimeout(1000);
+  task->start();
+
+  EXPECT_EQ(state.get_future().get(), PR_ST_SUCCESS);
+  EXPECT_EQ(response.get_future().get(), "re: ping\n");
+  peer.join();
+
+  /* The node is gone, so the fd can be used again. */
+  std::promise<int> again;
+
+  task = new NetTask(&scheduler, sv[0],
+                     [&](NetTask *t) { again.set_value(t->getError()); });
+  task->setParser(parseLine);
+  task->setTimeout(10);
+  task->start();
+  EXPECT_EQ(again.get_future().get(), ETIMEDOUT);
+
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST_F(WorkflowTest, CancelEndsPendingTimerAndSkipsTheRest)
+{
+  CancelToken        token;
+  std::promise<int>  timer;
+  std::promise<int>  go;
+  std::promise<void> finished;
+  std::atomic<bool>  ran{false};
+  SeriesWork        *series;
+  auto               start = std::chrono::steady_clock::now();
+
+  series = SeriesWork::create(
+          new TimerTask(&scheduler, 10000,
+                        [&](TimerTask *t) { timer.set_value(t->getError()); }),
+          [&](const SeriesWork *) { finished.set_value(); });
+  series->pushBack(new GoTask(
+          &scheduler, [&] { ran = true; },
+          [&](GoTask *t) { go.set_value(t->getError()); }));
+  series->setCancelToken(&token);
+  series->start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  token.cancel();
+  EXPECT_EQ(timer.get_future().get(), ECANCELED);
+  EXPECT_EQ(go.get_future().get(), ECANCELED);
+  finished.get_future().wait();
+  EXPECT_FALSE(ran);
+  EXPECT_LT(std::chrono::steady_clock::now() - start,
+            std::chrono::seconds(5));
+}
+
+TEST_F(WorkflowTest, CancelCascadesIntoParallelBranches)
+{
+  CancelToken        request;
+  CancelToken        hedge(&request);
+  std::promise<int>  net;
+  std::promise<int>  timer;
+  std::promise<void> joined;
+  ParallelWork      *parallel;
+  SeriesWork        *series;
+  NetTask           *task;
+  int                sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+
+  /* A read that would wait forever, and a timer under a child token. */
+  task = new NetTask(&scheduler, sv[0],
+                     [&](NetTask *t) { net.set_value(t->getError()); });
+  task->setParser(parseLine);
+  parallel = ParallelWork::create(nullptr);
+  parallel->addTask(task);
+  series = SeriesWork::create(
+          new TimerTask(&scheduler, 10000,
+                        [&](TimerTask *t) { timer.set_value(t->getError()); }),
+          nullptr);
+  series->setCancelToken(&hedge);
+  parallel->addSeries(series);
+
+  series = SeriesWork::create(parallel,
+                              [&](const SeriesWork *) { joined.set_value(); });
+  series->setCancelToken(&request);
+  series->start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  request.cancel();
+  EXPECT_EQ(net.get_future().get(), ECANCELED);
+  EXPECT_EQ(timer.get_future().get(), ECANCELED);
+  joined.get_future().wait();
+
+  /* The read node went at once, so the fd can be used again. */
+  std::promise<int> again;
+
+  task = new NetTask(&scheduler, sv[0],
+                     [&](NetTask *t) { again.set_value(t->getError()); });
+  task->setParser(parseLine);
+  task->setTimeout(10);
+  task->start();
+  EXPECT_EQ(again.get_future().get(), ETIMEDOUT);
+
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST_F(WorkflowTest, CancellingAHedgeLeavesTheOthers)
+{
+  CancelToken        request;
+  CancelToken        hedges[2] = {CancelToken(&request),
+                                  CancelToken(&request)};
+  std::promise<int>  results[2];
+  std::promise<void> joined;
+  ParallelWork      *parallel;
+
+  parallel = ParallelWork::create(
+          [&](const ParallelWork *) { joined.set_value(); });
+  for (int i = 0; i < 2; i++)
+  {
+    SeriesWork *series = SeriesWork::create(
+            new TimerTask(&scheduler, i == 0 ? 10000 : 20,
+                          [&, i](TimerTask *t)
+                          { results[i].set_value(t->getState()); }),
+            nullptr);
+
+    series->setCancelToken(&hedges[i]);
+    parallel->addSeries(series);
+  }
+
+  parallel->start();
+  hedges[0].cancel();
+  EXPECT_EQ(results[0].get_future().get(), PR_ST_ERROR);
+  EXPECT_EQ(results[1].get_future().get(), PR_ST_SUCCESS);
+  joined.get_future().wait();
+  EXPECT_FALSE(request.isCancelled());
+}
+
+TEST_F(WorkflowTest, NetTaskFailsWhenItsNodeIsTakenAway)
+{
+  std::promise<void> started;
+  std::promise<int>  state;
+  std::promise<int>  error;
+  NetTask           *task;
+  int                sv[2];
+
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv), 0);
+
+  /* A read that would wait forever, its node deleted by someone else. */
+  task = new NetTask(&scheduler, sv[0],
+                     [&](NetTask *t)
+                     {
+                       state.set_value(t->getState());
+                       error.set_value(t->getError());
+                     });
+  task->setParser(parseLine);
+  task->start();
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  ASSERT_EQ(scheduler.getPoller()->del(sv[0]), 0);
+  EXPECT_EQ(state.get_future().get(), PR_ST_ERROR);
+  EXPECT_EQ(error.get_future().get(), ECANCELED);
+
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST_F(WorkflowTest, TasksAreRecycled)
+{
+  SubTask *task = new EmptyTask();
+  void    *p    = task;
+
+  delete task;
+  task = new EmptyTask();
+  EXPECT_EQ(static_cast<void *>(task), p);
+  delete task;
+}
+
+int main(int argc, char **argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}